@@ -22,6 +22,10 @@
 // assuming average event size of ~256 bytes (sizeof(write_event))
 #define RINGBUF_SIZE (256 * 1024)
 
+// Upper bound on the number of ring buffers (and possible CPUs) of the
+// per-CPU / per-node ring buffer layouts
+#define MAX_RINGS 1024
+
 // Maximum number of threads/processes that can be tracked simultaneously
 // Set to support large parallel applications (e.g., MPI jobs with 10k ranks)
 #define MAX_TRACKED_THREADS 10240
@@ -31,6 +35,7 @@ struct config {
   __u32 target_pid;
   __u32 num_fds;
   __u32 target_fds[MAX_FDS];
+  __u32 num_rings; // 0: shared `events` ring buffer, else use `event_rings`
 };
 
 // Event structure, shared by the user space code
@@ -58,6 +63,28 @@ struct {
   __uint(max_entries, RINGBUF_SIZE);
 } events SEC(".maps");
 
+// Optional ring buffer per CPU (or per NUMA node). Inner ring buffers are
+// created and inserted by user space, which also fills cpu_ring with the
+// index of the ring buffer each CPU submits to.
+struct ringbuf_map {
+  __uint(type, BPF_MAP_TYPE_RINGBUF);
+  __uint(max_entries, RINGBUF_SIZE);
+};
+
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY_OF_MAPS);
+  __uint(max_entries, MAX_RINGS);
+  __type(key, __u32);
+  __array(values, struct ringbuf_map);
+} event_rings SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __uint(max_entries, MAX_RINGS);
+  __type(key, __u32);
+  __type(value, __u32);
+} cpu_ring SEC(".maps");
+
 struct {
   __uint(type, BPF_MAP_TYPE_HASH);
   __uint(max_entries, MAX_TRACKED_THREADS);
@@ -109,8 +136,23 @@ int trace_write_enter(struct trace_event_raw_sys_enter *ctx) {
     return 0;
   }
 
-  // Reserve space in ring buffer
-  struct write_event *event = bpf_ringbuf_reserve(&events, sizeof(*event), 0);
+  // Reserve space in ring buffer: the shared one, or the one of this CPU
+  // so producers on different CPUs do not contend on the same lock
+  struct write_event *event;
+  if (cfg->num_rings > 0) {
+    __u32 cpu = bpf_get_smp_processor_id();
+    __u32 *ring_idx = bpf_map_lookup_elem(&cpu_ring, &cpu);
+    if (!ring_idx) {
+      return 0;
+    }
+    void *ring = bpf_map_lookup_elem(&event_rings, ring_idx);
+    if (!ring) {
+      return 0;
+    }
+    event = bpf_ringbuf_reserve(ring, sizeof(*event), 0);
+  } else {
+    event = bpf_ringbuf_reserve(&events, sizeof(*event), 0);
+  }
   if (!event) {
     return 0;
   }
@@ -0,0 +1,106 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"compress/gzip"
+	"errors"
+	"flag"
+	"fmt"
+	"io"
+	"os"
+
+	"write-tracer/internal/tracefile"
+
+	"github.com/klauspost/compress/zstd"
+)
+
+// runDecode implements "write-tracer decode": it converts binary trace files
+// (--file-format=binary), compressed or not, to the JSON lines the tracer
+// prints, and returns the process exit status.
+func runDecode(args []string) int {
+	flags := flag.NewFlagSet("decode", flag.ExitOnError)
+	flags.Usage = func() {
+		fmt.Fprintf(os.Stderr, "Usage: %s decode [file ...]\n\n", os.Args[0])
+		fmt.Fprintln(os.Stderr, "Decodes binary trace files (optionally gzip or zstd compressed) to JSON lines on stdout. Reads stdin when no file (or -) is given.")
+		flags.PrintDefaults()
+	}
+	flags.Parse(args)
+
+	files := flags.Args()
+	if len(files) == 0 {
+		files = []string{"-"}
+	}
+
+	out := bufio.NewWriterSize(os.Stdout, 256*1024)
+	status := 0
+	for _, name := range files {
+		if err := decodeFile(out, name); err != nil {
+			fmt.Fprintf(os.Stderr, "decode %s: %v\n", name, err)
+			status = 1
+		}
+	}
+	if err := out.Flush(); err != nil {
+		fmt.Fprintf(os.Stderr, "decode: %v\n", err)
+		status = 1
+	}
+	return status
+}
+
+func decodeFile(out *bufio.Writer, name string) error {
+	in := io.Reader(os.Stdin)
+	if name != "-" {
+		f, err := os.Open(name)
+		if err != nil {
+			return err
+		}
+		defer f.Close()
+		in = f
+	}
+
+	in, err := decompress(in)
+	if err != nil {
+		return err
+	}
+	if c, ok := in.(io.Closer); ok {
+		defer c.Close()
+	}
+
+	r := tracefile.NewReader(in)
+	var line []byte
+	for block := 0; ; block++ {
+		_, recs, err := r.Next()
+		if errors.Is(err, io.EOF) {
+			return nil
+		}
+		if err != nil {
+			return fmt.Errorf("block %d: %w", block, err)
+		}
+		for i := range recs {
+			line = recs[i].AppendJSON(line[:0])
+			line = append(line, '\n')
+			if _, err := out.Write(line); err != nil {
+				return err
+			}
+		}
+	}
+}
+
+// decompress wraps in with a decoder when it starts with a gzip or zstd
+// header, as written by --file-compression.
+func decompress(in io.Reader) (io.Reader, error) {
+	br := bufio.NewReader(in)
+	head, _ := br.Peek(4)
+	switch {
+	case bytes.HasPrefix(head, []byte{0x1f, 0x8b}):
+		return gzip.NewReader(br)
+	case bytes.HasPrefix(head, []byte{0x28, 0xb5, 0x2f, 0xfd}):
+		zr, err := zstd.NewReader(br)
+		if err != nil {
+			return nil, err
+		}
+		return zr.IOReadCloser(), nil
+	default:
+		return br, nil
+	}
+}
@@ -16,6 +16,15 @@ import (
 )
 
 func main() {
+	if len(os.Args) > 1 {
+		switch os.Args[1] {
+		case "decode":
+			os.Exit(runDecode(os.Args[2:]))
+		case "query":
+			os.Exit(runQuery(os.Args[2:]))
+		}
+	}
+
 	cfg := config.Parse()
 
 	if cfg.MetricsPort > 0 {
@@ -61,7 +70,7 @@ func main() {
 
 	// If a CLI PID was provided, register it in the registry (so liveness monitoring works)
 	if cfg.TargetPID != 0 {
-		if _, err := registry.RegisterPID(cfg.TargetPID); err != nil {
+		if _, err := registry.RegisterPID(cfg.TargetPID, nil); err != nil {
 			// We already initialized it in loader, but we want it in the registry too.
 			// Currently loader does it directly. Let's rely on loader for initial setup
 			// but RegisterPID will track it for liveness monitoring.
@@ -82,7 +91,8 @@ func main() {
 	// Update processor to use registry methods if needed, or just let it run.
 	// The processor mainly consumes events. The liveness monitor runs separately.
 
-	if err := ebpf.StartProcessing(ctx, cfg, coll.Maps["events"], coll.Maps["tracked_pids"]); err != nil {
+	done, err := ebpf.StartProcessing(ctx, cfg, coll, registry)
+	if err != nil {
 		slog.Error("Failed to start processing", "error", err)
 		os.Exit(1)
 	}
@@ -90,4 +100,7 @@ func main() {
 	slog.Info("Tracing write calls... Hit Ctrl-C to stop.")
 	<-ctx.Done()
 	slog.Info("Shutting down...")
+
+	// Wait for buffered output to be flushed before exiting.
+	<-done
 }
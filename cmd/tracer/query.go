@@ -0,0 +1,216 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"errors"
+	"flag"
+	"fmt"
+	"io"
+	"io/fs"
+	"math"
+	"os"
+	"strings"
+
+	"write-tracer/internal/tracefile"
+)
+
+// query selects records by timestamp range, pid, tid and fd. Negative ids
+// match any.
+type query struct {
+	from, to      uint64
+	pid, tid, fd  int64
+	indexed, read int // segments with an index, and segments read
+}
+
+func (q *query) match(ts uint64, pid, tid, fd uint32) bool {
+	return ts >= q.from && ts <= q.to &&
+		(q.pid < 0 || int64(pid) == q.pid) &&
+		(q.tid < 0 || int64(tid) == q.tid) &&
+		(q.fd < 0 || int64(fd) == q.fd)
+}
+
+// runQuery implements "write-tracer query": it prints, as JSON lines, the
+// records of file output segments (JSON or binary, compressed or not) that
+// match a timestamp range and a pid, tid or fd. With --file-index, segments
+// that cannot match are skipped using their index sidecar, and only the
+// checkpoints of the others that overlap the time range are read. Segments
+// without an index, such as the live one, are scanned in full.
+func runQuery(args []string) int {
+	flags := flag.NewFlagSet("query", flag.ExitOnError)
+	from := flags.Uint64("from", 0, "Earliest timestamp, in nanoseconds as in the output")
+	to := flags.Uint64("to", math.MaxUint64, "Latest timestamp, in nanoseconds as in the output")
+	pid := flags.Int64("pid", -1, "Only records of this process")
+	tid := flags.Int64("tid", -1, "Only records of this thread")
+	fd := flags.Int64("fd", -1, "Only records of this file descriptor")
+	verbose := flags.Bool("v", false, "Report the segments skipped and read on stderr")
+	flags.Usage = func() {
+		fmt.Fprintf(os.Stderr, "Usage: %s query [flags] segment ...\n\n", os.Args[0])
+		fmt.Fprintln(os.Stderr, "Prints the records of file output segments matching the flags as JSON lines on stdout, e.g.")
+		fmt.Fprintf(os.Stderr, "  %s query --pid 1234 --from 1000000000 /tmp/trace.log.*\n\n", os.Args[0])
+		flags.PrintDefaults()
+	}
+	flags.Parse(args)
+	if flags.NArg() == 0 {
+		flags.Usage()
+		return 2
+	}
+
+	q := &query{from: *from, to: *to, pid: *pid, tid: *tid, fd: *fd}
+	out := bufio.NewWriterSize(os.Stdout, 256*1024)
+	status := 0
+	segments := 0
+	for _, name := range flags.Args() {
+		// Globs over the output path also match the sidecars.
+		if strings.HasSuffix(name, tracefile.IndexExt) || strings.HasSuffix(name, ".tmp") {
+			continue
+		}
+		segments++
+		if err := querySegment(out, name, q); err != nil {
+			fmt.Fprintf(os.Stderr, "query %s: %v\n", name, err)
+			status = 1
+		}
+	}
+	if err := out.Flush(); err != nil {
+		fmt.Fprintf(os.Stderr, "query: %v\n", err)
+		status = 1
+	}
+	if *verbose {
+		fmt.Fprintf(os.Stderr, "query: %d segments, %d indexed, %d read\n", segments, q.indexed, q.read)
+	}
+	return status
+}
+
+// indexPath returns the index sidecar of a segment, named after the segment
+// without its compression extension.
+func indexPath(segment string) string {
+	segment = strings.TrimSuffix(segment, ".zst")
+	return strings.TrimSuffix(segment, ".gz") + tracefile.IndexExt
+}
+
+func querySegment(out *bufio.Writer, name string, q *query) error {
+	ranges := []tracefile.Range{{Start: 0, End: -1}}
+	idx, err := tracefile.ReadIndex(indexPath(name))
+	switch {
+	case err == nil:
+		q.indexed++
+		if !idx.Contains(q.from, q.to, q.pid, q.tid, q.fd) {
+			return nil
+		}
+		ranges = idx.Ranges(q.from, q.to)
+	case !errors.Is(err, fs.ErrNotExist):
+		fmt.Fprintf(os.Stderr, "query %s: %v, scanning the whole segment\n", name, err)
+	}
+	if len(ranges) == 0 {
+		return nil
+	}
+	q.read++
+
+	f, err := os.Open(name)
+	if err != nil {
+		return err
+	}
+	defer f.Close()
+
+	// Uncompressed segments are read at the checkpoint offsets; compressed
+	// ones are decompressed and discarded up to them.
+	head := make([]byte, 4)
+	n, _ := f.ReadAt(head, 0)
+	head = head[:n]
+	var stream io.Reader
+	if bytes.HasPrefix(head, []byte{0x1f, 0x8b}) || bytes.HasPrefix(head, []byte{0x28, 0xb5, 0x2f, 0xfd}) {
+		if stream, err = decompress(f); err != nil {
+			return err
+		}
+		if c, ok := stream.(io.Closer); ok {
+			defer c.Close()
+		}
+	}
+
+	var pos int64
+	for _, rg := range ranges {
+		var section io.Reader
+		if stream == nil {
+			end := rg.End
+			if end < 0 {
+				end = math.MaxInt64
+			}
+			section = io.NewSectionReader(f, rg.Start, end-rg.Start)
+		} else {
+			if _, err := io.CopyN(io.Discard, stream, rg.Start-pos); err != nil {
+				return fmt.Errorf("seeking to offset %d: %w", rg.Start, err)
+			}
+			section = stream
+			if rg.End >= 0 {
+				section = io.LimitReader(stream, rg.End-rg.Start)
+			}
+			pos = rg.End
+		}
+		if err := queryRange(out, section, q); err != nil {
+			return fmt.Errorf("offset %d: %w", rg.Start, err)
+		}
+	}
+	return nil
+}
+
+// queryRange writes the matching records of one part of a segment,
+// telling the binary format from JSON lines by the block magic.
+func queryRange(out *bufio.Writer, in io.Reader, q *query) error {
+	br := bufio.NewReaderSize(in, 256*1024)
+	head, _ := br.Peek(4)
+	if string(head) == "WTRB" {
+		return queryBinary(out, br, q)
+	}
+	return queryJSON(out, br, q)
+}
+
+func queryBinary(out *bufio.Writer, in io.Reader, q *query) error {
+	r := tracefile.NewReader(in)
+	var line []byte
+	for {
+		_, recs, err := r.Next()
+		if errors.Is(err, io.EOF) {
+			return nil
+		}
+		if err != nil {
+			return err
+		}
+		for i := range recs {
+			rec := &recs[i]
+			if !q.match(rec.Timestamp, rec.PID, rec.TID, rec.FD) {
+				continue
+			}
+			line = rec.AppendJSON(line[:0])
+			line = append(line, '\n')
+			if _, err := out.Write(line); err != nil {
+				return err
+			}
+		}
+	}
+}
+
+func queryJSON(out *bufio.Writer, in io.Reader, q *query) error {
+	sc := bufio.NewScanner(in)
+	sc.Buffer(make([]byte, 64*1024), 16<<20)
+	for sc.Scan() {
+		line := sc.Bytes()
+		var rec struct {
+			Timestamp uint64 `json:"timestamp"`
+			PID       uint32 `json:"pid"`
+			TID       uint32 `json:"tid"`
+			FD        uint32 `json:"fd"`
+		}
+		if err := json.Unmarshal(line, &rec); err != nil {
+			return err
+		}
+		if !q.match(rec.Timestamp, rec.PID, rec.TID, rec.FD) {
+			continue
+		}
+		out.Write(line)
+		if err := out.WriteByte('\n'); err != nil {
+			return err
+		}
+	}
+	return sc.Err()
+}
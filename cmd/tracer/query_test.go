@@ -0,0 +1,170 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"math"
+	"path/filepath"
+	"slices"
+	"strings"
+	"testing"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+	"write-tracer/internal/output"
+	"write-tracer/internal/tracefile"
+)
+
+const (
+	testSegmentRecords = 1000
+	testSegments       = 3
+)
+
+// writeTestSegments writes indexed segments of testSegmentRecords records
+// each, with timestamps 1, 2, ... and pids alternating between 1 and 2, in
+// chunks of 10 so that segments have many checkpoints. It returns the
+// segment files, sorted.
+func writeTestSegments(t *testing.T, format, compression string) []string {
+	t.Helper()
+	dir := t.TempDir()
+	w, err := output.NewFileWriter(filepath.Join(dir, "t.log"), output.FileOptions{
+		Rotation:      output.Rotation{MaxRecords: testSegmentRecords},
+		Format:        format,
+		Compression:   compression,
+		Index:         true,
+		IndexInterval: 1024,
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	for ts := uint64(1); ts <= testSegments*testSegmentRecords; ts += 10 {
+		c := output.NewChunk()
+		for i := ts; i < ts+10; i++ {
+			c.Add(&event.Record{Timestamp: i, PID: uint32(1 + i%2), TID: 7, FD: 1, Comm: []byte("x"), Data: []byte("a line of output\n")})
+		}
+		if err := w.Write(c); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := w.Close(); err != nil {
+		t.Fatal(err)
+	}
+
+	names, err := filepath.Glob(filepath.Join(dir, "t.log.*"))
+	if err != nil {
+		t.Fatal(err)
+	}
+	var segments []string
+	for _, name := range names {
+		if !strings.HasSuffix(name, tracefile.IndexExt) {
+			segments = append(segments, name)
+		}
+	}
+	if len(segments) != testSegments {
+		t.Fatalf("segments = %v, want %d", segments, testSegments)
+	}
+	return segments
+}
+
+func TestQuerySegment(t *testing.T) {
+	formats := []string{config.FileFormatJSON, config.FileFormatBinary}
+	compressions := []string{config.FileCompressionNone, config.FileCompressionGzip, config.FileCompressionZstd}
+	queries := []struct {
+		name    string
+		q       query
+		want    []uint64 // timestamps
+		indexed int
+		read    int
+	}{
+		{"all", query{from: 0, to: math.MaxUint64, pid: -1, tid: -1, fd: -1}, testTimestamps(1, 3000, -1), 3, 3},
+		// Checkpoints within the second segment only.
+		{"window", query{from: 1234, to: 1456, pid: -1, tid: -1, fd: -1}, testTimestamps(1234, 1456, -1), 3, 1},
+		{"window across segments", query{from: 990, to: 2010, pid: 2, tid: -1, fd: -1}, testTimestamps(990, 2010, 2), 3, 3},
+		{"no such pid", query{from: 0, to: math.MaxUint64, pid: 3, tid: -1, fd: -1}, nil, 3, 0},
+		{"after the end", query{from: 3001, to: math.MaxUint64, pid: -1, tid: -1, fd: -1}, nil, 3, 0},
+	}
+	for _, format := range formats {
+		for _, compression := range compressions {
+			t.Run(format+"/"+compression, func(t *testing.T) {
+				segments := writeTestSegments(t, format, compression)
+				// A window inside the second segment is read from a
+				// checkpoint after its start up to another before its end.
+				idx, err := tracefile.ReadIndex(indexPath(segments[1]))
+				if err != nil {
+					t.Fatal(err)
+				}
+				if ranges := idx.Ranges(1234, 1456); len(ranges) != 1 || ranges[0].Start == 0 || ranges[0].End < 0 {
+					t.Fatalf("ranges of the window = %v, want one within the segment", ranges)
+				}
+				for _, tt := range queries {
+					t.Run(tt.name, func(t *testing.T) {
+						q := tt.q
+						var buf bytes.Buffer
+						out := bufio.NewWriter(&buf)
+						for _, name := range segments {
+							if err := querySegment(out, name, &q); err != nil {
+								t.Fatalf("%s: %v", name, err)
+							}
+						}
+						if err := out.Flush(); err != nil {
+							t.Fatal(err)
+						}
+
+						var got []uint64
+						for _, line := range bytes.Split(bytes.TrimSuffix(buf.Bytes(), []byte("\n")), []byte("\n")) {
+							if len(line) == 0 {
+								continue
+							}
+							var rec struct {
+								Timestamp uint64 `json:"timestamp"`
+							}
+							if err := json.Unmarshal(line, &rec); err != nil {
+								t.Fatalf("%q: %v", line, err)
+							}
+							got = append(got, rec.Timestamp)
+						}
+						if !slices.Equal(got, tt.want) {
+							t.Errorf("got %d records %v, want %d %v", len(got), testSpan(got), len(tt.want), testSpan(tt.want))
+						}
+						if q.indexed != tt.indexed || q.read != tt.read {
+							t.Errorf("%d segments indexed, %d read, want %d and %d", q.indexed, q.read, tt.indexed, tt.read)
+						}
+					})
+				}
+			})
+		}
+	}
+}
+
+// testTimestamps returns the timestamps from..to of the records of pid, or
+// of any pid if negative.
+func testTimestamps(from, to uint64, pid int64) []uint64 {
+	var ts []uint64
+	for i := from; i <= to; i++ {
+		if pid < 0 || int64(1+i%2) == pid {
+			ts = append(ts, i)
+		}
+	}
+	return ts
+}
+
+// testSpan summarizes timestamps for error messages.
+func testSpan(ts []uint64) []uint64 {
+	if len(ts) == 0 {
+		return nil
+	}
+	return []uint64{ts[0], ts[len(ts)-1]}
+}
+
+func TestIndexPath(t *testing.T) {
+	for segment, want := range map[string]string{
+		"t.log.00000001":     "t.log.00000001.idx",
+		"t.log.00000001.gz":  "t.log.00000001.idx",
+		"t.log.00000001.zst": "t.log.00000001.idx",
+	} {
+		if got := indexPath(segment); got != want {
+			t.Errorf("indexPath(%q) = %q, want %q", segment, got, want)
+		}
+	}
+}
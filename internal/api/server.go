@@ -20,7 +20,8 @@ type Server struct {
 
 // RegisterRequest is the JSON payload for registering a PID.
 type RegisterRequest struct {
-	PID uint32 `json:"pid"`
+	PID    uint32            `json:"pid"`
+	Labels map[string]string `json:"labels,omitempty"`
 }
 
 // RegisterResponse is returned after successfully registering a PID.
@@ -38,9 +39,10 @@ type ListResponse struct {
 
 // ProcessInfo contains information about a tracked process.
 type ProcessInfo struct {
-	PID          uint32 `json:"pid"`
-	ThreadCount  int    `json:"thread_count"`
-	RegisteredAt string `json:"registered_at"`
+	PID          uint32            `json:"pid"`
+	ThreadCount  int               `json:"thread_count"`
+	RegisteredAt string            `json:"registered_at"`
+	Labels       map[string]string `json:"labels,omitempty"`
 }
 
 // ErrorResponse is returned on errors.
@@ -126,6 +128,7 @@ func (s *Server) listPids(w http.ResponseWriter, _ *http.Request) {
 			PID:          p.ParentPID,
 			ThreadCount:  len(p.ThreadIDs),
 			RegisteredAt: p.RegisteredAt.Format("2006-01-02T15:04:05Z07:00"),
+			Labels:       p.Labels,
 		}
 	}
 
@@ -144,7 +147,7 @@ func (s *Server) registerPid(w http.ResponseWriter, r *http.Request) {
 		return
 	}
 
-	threads, err := s.registry.RegisterPID(req.PID)
+	threads, err := s.registry.RegisterPID(req.PID, req.Labels)
 	if err != nil {
 		s.writeError(w, http.StatusBadRequest, err.Error())
 		return
@@ -177,6 +180,7 @@ func (s *Server) getPid(w http.ResponseWriter, pid uint32) {
 				PID:          p.ParentPID,
 				ThreadCount:  len(p.ThreadIDs),
 				RegisteredAt: p.RegisteredAt.Format("2006-01-02T15:04:05Z07:00"),
+				Labels:       p.Labels,
 			})
 			return
 		}
@@ -5,15 +5,61 @@ import (
 	"fmt"
 	"log/slog"
 	"os"
+	"runtime"
 	"strconv"
 	"strings"
 	"time"
+
+	"write-tracer/internal/queue"
 )
 
 const (
 	MaxFDs          = 64
 	MaxDataSize     = 256
 	MaxExecNameSize = 16
+
+	// Ring buffer layouts
+	RingLayoutShared  = "shared"
+	RingLayoutPerCPU  = "per-cpu"
+	RingLayoutPerNode = "per-node"
+
+	// File output formats
+	FileFormatJSON   = "json"
+	FileFormatBinary = "binary"
+
+	// File output compression
+	FileCompressionNone = "none"
+	FileCompressionGzip = "gzip"
+	FileCompressionZstd = "zstd"
+
+	// File output sync policies
+	FileSyncNone     = "none"
+	FileSyncInterval = "interval"
+	FileSyncRotate   = "rotate"
+
+	// Loki push request encodings
+	LokiEncodingJSON     = "json"
+	LokiEncodingProtobuf = "protobuf"
+
+	// Where Loki entry metadata goes
+	LokiMetadataStructured = "structured"
+	LokiMetadataLine       = "line"
+
+	// Default Loki stream labels and entry metadata: a few streams per
+	// job and host, with the per process fields in the entries.
+	DefaultLokiLabels   = "app=write-tracer,host={host},job={job}"
+	DefaultLokiMetadata = "comm={comm},pid={pid},tid={tid},fd={fd}"
+
+	// OTLP request compression
+	OTLPCompressionNone = "none"
+	OTLPCompressionGzip = "gzip"
+
+	// Demux output stream keys
+	DemuxByPID          = "pid"
+	DemuxByRegistration = "registration"
+
+	// maxAutoShards caps the shard count picked when --shards is not set.
+	maxAutoShards = 64
 )
 
 type Config struct {
@@ -21,13 +67,68 @@ type Config struct {
 	NumFDs               uint32
 	TargetFDs            [MaxFDs]uint32
 	LokiEndpoint         string
+	LokiBatchBytes       int
+	LokiBatchWait        time.Duration
+	LokiWorkers          int
+	LokiEncoding         string
+	LokiSpoolDir         string
+	LokiSpoolMaxBytes    int64
+	LokiLabels           []LabelTemplate
+	LokiMetadata         []LabelTemplate
+	LokiMetadataMode     string
+	OTLPEndpoint         string
+	OTLPBatchBytes       int
+	OTLPBatchWait        time.Duration
+	OTLPWorkers          int
+	OTLPCompression      string
+	OTLPRetryMaxBytes    int64
 	FileOutput           string
+	FileFormat           string
+	FileCompression      string
+	FileCompressionLevel int
+	FileSync             string
+	FileSyncInterval     time.Duration
+	FilePreallocate      int64
+	CompressRotated      bool
+	CompressWorkers      int
+	CompressThreads      int
+	FileIndex            bool
+	FileIndexInterval    int64
+	ParquetOutput        string
+	ParquetCompression   string
+	ParquetRowGroupSize  int
+	DemuxDir             string
+	DemuxBy              string
+	DemuxMaxOpen         int
+	RawDir               string
+	RawIndexBytes        int64
 	TrackingInterval     time.Duration
 	MaxRecordsFileOutput int
 	MaxBackups           int
+	MaxFileBytes         int64
+	RotateInterval       time.Duration
+	MaxTotalBytes        int64
 	MetricsPort          int
 	RESTPort             int
 	SilenceStdout        bool
+	StdoutBufferSize     int
+	StdoutFlushInterval  time.Duration
+	Shards               int
+	ShardQueueDepth      int
+	Backpressure         queue.Policy
+	SpillDir             string
+	SpillMaxBytes        int64
+	BusyPoll             bool
+	BusyPollSpin         time.Duration
+	RingLayout           string
+	RingBufferSize       uint32
+	ReorderWindow        time.Duration
+	ReorderMaxEvents     int
+	LineMode             bool
+	LineMaxBytes         int
+	LineIdleFlush        time.Duration
+	SinkQueueDepth       int
+	SinkBackpressure     map[string]queue.Policy
 }
 
 func Parse() Config {
@@ -41,10 +142,52 @@ func Parse() Config {
 
 	lokiEndpointPtr := flag.String("loki-endpoint", "", "URL of the Loki server push endpoint")
 	lokiEndpointShorthandPtr := flag.String("l", "", "Shorthand for --loki-endpoint")
+	lokiBatchBytesPtr := flag.Int("loki-batch-bytes", 1<<20, "Push a Loki batch once its log lines reach this many bytes")
+	lokiBatchWaitPtr := flag.Duration("loki-batch-wait", time.Second, "Maximum time log lines wait in a Loki batch")
+	lokiWorkersPtr := flag.Int("loki-workers", 4, "Concurrent Loki push requests")
+	lokiSpoolDirPtr := flag.String("loki-spool-dir", "", "Directory to spool Loki push requests to while Loki is unavailable, replayed in order once it recovers")
+	lokiSpoolMaxBytesPtr := flag.Int64("loki-spool-max-bytes", 1<<30, "Maximum size of the Loki spool; the oldest requests are dropped beyond it")
+	lokiLabelsPtr := flag.String("loki-labels", DefaultLokiLabels, "Loki stream labels, as name=template pairs; templates may refer to {host}, {comm}, {pid}, {tid}, {fd}, {registration} and registration labels such as {job}")
+	lokiMetadataPtr := flag.String("loki-metadata", DefaultLokiMetadata, "Per entry Loki metadata, as name=template pairs like --loki-labels")
+	lokiMetadataModePtr := flag.String("loki-metadata-mode", LokiMetadataLine, "Where Loki entry metadata goes: line (logfmt prefix of the line) or structured (structured metadata, Loki 3 or later)")
+	otlpEndpointPtr := flag.String("otlp-endpoint", "", "URL of an OTLP/HTTP logs endpoint, e.g. http://localhost:4318/v1/logs")
+	otlpBatchBytesPtr := flag.Int("otlp-batch-bytes", 1<<20, "Export an OTLP batch once its log records reach this many bytes")
+	otlpBatchWaitPtr := flag.Duration("otlp-batch-wait", time.Second, "Maximum time log records wait in an OTLP batch")
+	otlpWorkersPtr := flag.Int("otlp-workers", 4, "Concurrent OTLP export requests")
+	otlpCompressionPtr := flag.String("otlp-compression", OTLPCompressionGzip, "OTLP request compression: gzip or none")
+	otlpRetryMaxBytesPtr := flag.Int64("otlp-retry-max-bytes", 64<<20, "Memory held by OTLP export requests waiting to be retried; the oldest are dropped beyond it")
+	lokiEncodingPtr := flag.String("loki-encoding", LokiEncodingJSON, "Loki push request encoding: json or protobuf (snappy compressed)")
 
 	fileOutputPtr := flag.String("file-output", "", "File to write captured outputs")
 	fileOutputShorthandPtr := flag.String("o", "", "Shorthand for --file-output")
 
+	fileFormatPtr := flag.String("file-format", FileFormatJSON, "File output format: json (JSON lines) or binary (compact blocks, see the decode subcommand)")
+
+	fileCompressionPtr := flag.String("file-compression", FileCompressionNone, "File output compression: none, gzip or zstd (streamed, one stream per rotated file)")
+	fileCompressionLevelPtr := flag.Int("file-compression-level", 0, "File output compression level: gzip 1-9 or zstd 1-22 (0 = codec default)")
+
+	fileSyncPtr := flag.String("file-sync", FileSyncNone, "File output durability: none, interval (fdatasync every --file-sync-interval) or rotate (fsync each file when it is rotated)")
+	fileSyncIntervalPtr := flag.Duration("file-sync-interval", 100*time.Millisecond, "Interval between fdatasync calls with --file-sync=interval")
+	filePreallocatePtr := flag.Int64("file-preallocate", 64<<20, "Reserve file output space with fallocate in steps of this many bytes (0 = disabled)")
+
+	compressRotatedPtr := flag.Bool("compress-rotated", false, "Compress rotated file output segments to .zst in the background")
+	compressWorkersPtr := flag.Int("compress-rotated-workers", 1, "Rotated segments compressed concurrently")
+	compressThreadsPtr := flag.Int("compress-rotated-threads", 2, "zstd encoder threads per rotated segment")
+
+	fileIndexPtr := flag.Bool("file-index", false, "Write an index sidecar (time range, pids, tids, fds and offsets) for every closed file output segment, used by the query subcommand")
+	fileIndexIntervalPtr := flag.Int64("file-index-interval", 1<<20, "Bytes of file output between two index checkpoints")
+
+	parquetOutputPtr := flag.String("parquet-output", "", "Parquet file to write captured outputs (rotated like --file-output)")
+	parquetCompressionPtr := flag.String("parquet-compression", "snappy", "Parquet compression: none, snappy, gzip or zstd, optionally followed by column=codec overrides")
+	parquetRowGroupSizePtr := flag.Int("parquet-row-group-size", 65536, "Rows per Parquet row group")
+
+	demuxDirPtr := flag.String("demux-dir", "", "Directory to write one output file per stream (rotated like --file-output)")
+	demuxByPtr := flag.String("demux-by", DemuxByRegistration, "Demux output stream key: registration (registered PID and its descendants) or pid")
+	demuxMaxOpenPtr := flag.Int("demux-max-open", 256, "Maximum demux (and raw) output files kept open; the least recently written are closed beyond it")
+
+	rawDirPtr := flag.String("raw-dir", "", "Directory to write the raw captured bytes to, one file per process and file descriptor (rotated like --file-output)")
+	rawIndexBytesPtr := flag.Int64("raw-index-bytes", 0, "Write a timestamp index entry every this many raw output bytes (0 = no index)")
+
 	trackingIntervalPtr := flag.Int("tracking-interval", 5, "Interval in seconds for tracking status updates")
 	trackingIntervalShorthandPtr := flag.Int("i", 5, "Shorthand for --tracking-interval")
 
@@ -52,12 +195,41 @@ func Parse() Config {
 	maxRecordsShorthandPtr := flag.Int("n", 0, "Shorthand for --max-records-fileoutput")
 
 	maxBackupsPtr := flag.Int("max-backups", 50, "Maximum number of rotated backup files to keep (0 = unlimited)")
+	maxFileBytesPtr := flag.Int64("max-file-bytes", 0, "Rotate output files once they reach this many bytes (0 = no size limit)")
+	rotateIntervalPtr := flag.Duration("rotate-interval", 0, "Rotate output files older than this (0 = no age limit)")
+	maxTotalBytesPtr := flag.Int64("max-total-bytes", 0, "Maximum total bytes of rotated files to keep (0 = unlimited)")
 
 	metricsPortPtr := flag.Int("metrics-port", 2112, "Port for Prometheus metrics endpoint (0 to disable)")
 
 	restPortPtr := flag.Int("rest-port", 9092, "Port for REST API endpoint (0 to disable)")
 	restPortShorthandPtr := flag.Int("r", 0, "Shorthand for --rest-port")
 
+	stdoutBufferSizePtr := flag.Int("stdout-buffer-size", 1<<20, "Bytes of stdout output buffered before a flush")
+	stdoutFlushIntervalPtr := flag.Duration("stdout-flush-interval", 50*time.Millisecond, "Maximum time stdout output stays buffered")
+
+	shardsPtr := flag.Int("shards", 0, "Number of event processing shards (0 = one per CPU, up to 64)")
+	shardQueueDepthPtr := flag.Int("shard-queue-depth", 64, "Number of event batches buffered per shard")
+
+	backpressurePtr := flag.String("backpressure", "drop-newest", "Policy when a shard queue is full: block, drop-newest, drop-oldest or spill")
+	spillDirPtr := flag.String("spill-dir", os.TempDir(), "Directory for spilled events with --backpressure=spill")
+	spillMaxBytesPtr := flag.Int64("spill-max-bytes", 1<<30, "Maximum bytes of spilled events across all shards")
+
+	pollModePtr := flag.String("poll-mode", "epoll", "Ring buffer consumer mode: epoll or busy (spin on a pinned thread for lowest latency)")
+	busyPollSpinPtr := flag.Duration("busy-poll-spin", 200*time.Microsecond, "Maximum spin time before busy polling backs off to epoll")
+
+	ringLayoutPtr := flag.String("ringbuf-layout", RingLayoutShared, "Ring buffer layout: shared, per-cpu or per-node (one consumer per ring, pinned to its NUMA node)")
+	ringBufferSizePtr := flag.Int("ringbuf-size", 256*1024, "Size in bytes of each ring buffer (power of two, multiple of the page size)")
+
+	reorderWindowPtr := flag.Duration("reorder-window", 0, "Hold events up to this long to emit them in kernel timestamp order (0 = disabled)")
+	reorderMaxEventsPtr := flag.Int("reorder-max-events", 65536, "Maximum number of events held by the reorder stage")
+
+	lineModePtr := flag.Bool("line-mode", false, "Reassemble writes into one record per logical line, per thread and file descriptor")
+	lineMaxBytesPtr := flag.Int("line-max-bytes", 64*1024, "Maximum length of a reassembled line before it is emitted as is")
+	lineIdleFlushPtr := flag.Duration("line-idle-flush", time.Second, "Emit a partial line once its thread has not written to it for this long")
+
+	sinkQueueDepthPtr := flag.Int("sink-queue-depth", 64, "Number of encoded chunks buffered per output sink")
+	sinkBackpressurePtr := flag.String("sink-backpressure", "drop-newest", "Policy when a sink queue is full: a policy for every sink, or a list such as stdout=block,file=block,loki=drop-oldest")
+
 	silenceStdoutPtr := flag.Bool("no-stdout", false, "Deactivate logging to stdout")
 	silenceStdoutShorthandPtr := flag.Bool("q", false, "Shorthand for --no-stdout")
 
@@ -91,16 +263,198 @@ func Parse() Config {
 		maxRecords = 50000
 	}
 
+	shards := *shardsPtr
+	if *reorderWindowPtr > 0 {
+		// The shards publish to the sinks independently, which would undo
+		// the global order of the reorder stage.
+		if shards > 1 {
+			slog.Warn("Using a single shard to keep the reorder window order", "shards", shards)
+		}
+		shards = 1
+	}
+	if shards <= 0 {
+		shards = min(runtime.NumCPU(), maxAutoShards)
+	}
+	shardQueueDepth := *shardQueueDepthPtr
+	if shardQueueDepth <= 0 {
+		shardQueueDepth = 64
+	}
+
+	stdoutBufferSize := *stdoutBufferSizePtr
+	if stdoutBufferSize <= 0 {
+		stdoutBufferSize = 1 << 20
+	}
+	stdoutFlushInterval := *stdoutFlushIntervalPtr
+	if stdoutFlushInterval <= 0 {
+		stdoutFlushInterval = 50 * time.Millisecond
+	}
+
+	backpressure, err := queue.ParsePolicy(*backpressurePtr)
+	if err != nil {
+		slog.Error("Invalid backpressure policy", "error", err)
+		os.Exit(1)
+	}
+
+	sinkQueueDepth := *sinkQueueDepthPtr
+	if sinkQueueDepth <= 0 {
+		sinkQueueDepth = 64
+	}
+	sinkBackpressure, err := parseSinkPolicies(*sinkBackpressurePtr)
+	if err != nil {
+		slog.Error("Invalid sink backpressure policy", "error", err)
+		os.Exit(1)
+	}
+
+	switch *fileFormatPtr {
+	case FileFormatJSON, FileFormatBinary:
+	default:
+		slog.Error("Invalid file format", "file_format", *fileFormatPtr)
+		os.Exit(1)
+	}
+
+	switch *fileCompressionPtr {
+	case FileCompressionNone, FileCompressionGzip, FileCompressionZstd:
+	default:
+		slog.Error("Invalid file compression", "file_compression", *fileCompressionPtr)
+		os.Exit(1)
+	}
+
+	switch *fileSyncPtr {
+	case FileSyncNone, FileSyncInterval, FileSyncRotate:
+	default:
+		slog.Error("Invalid file sync policy", "file_sync", *fileSyncPtr)
+		os.Exit(1)
+	}
+	fileSyncInterval := *fileSyncIntervalPtr
+	if fileSyncInterval <= 0 {
+		fileSyncInterval = 100 * time.Millisecond
+	}
+
+	switch *lokiEncodingPtr {
+	case LokiEncodingJSON, LokiEncodingProtobuf:
+	default:
+		slog.Error("Invalid Loki encoding", "loki_encoding", *lokiEncodingPtr)
+		os.Exit(1)
+	}
+
+	lokiLabels, err := ParseLabelTemplates(*lokiLabelsPtr)
+	if err != nil {
+		slog.Error("Invalid Loki labels", "error", err)
+		os.Exit(1)
+	}
+	lokiMetadata, err := ParseLabelTemplates(*lokiMetadataPtr)
+	if err != nil {
+		slog.Error("Invalid Loki metadata", "error", err)
+		os.Exit(1)
+	}
+	switch *lokiMetadataModePtr {
+	case LokiMetadataStructured, LokiMetadataLine:
+	default:
+		slog.Error("Invalid Loki metadata mode", "loki_metadata_mode", *lokiMetadataModePtr)
+		os.Exit(1)
+	}
+
+	switch *otlpCompressionPtr {
+	case OTLPCompressionNone, OTLPCompressionGzip:
+	default:
+		slog.Error("Invalid OTLP compression", "otlp_compression", *otlpCompressionPtr)
+		os.Exit(1)
+	}
+
+	switch *demuxByPtr {
+	case DemuxByPID, DemuxByRegistration:
+	default:
+		slog.Error("Invalid demux stream key", "demux_by", *demuxByPtr)
+		os.Exit(1)
+	}
+
+	var busyPoll bool
+	switch *pollModePtr {
+	case "epoll":
+	case "busy":
+		busyPoll = true
+	default:
+		slog.Error("Invalid poll mode", "poll_mode", *pollModePtr)
+		os.Exit(1)
+	}
+
+	switch *ringLayoutPtr {
+	case RingLayoutShared, RingLayoutPerCPU, RingLayoutPerNode:
+	default:
+		slog.Error("Invalid ring buffer layout", "ringbuf_layout", *ringLayoutPtr)
+		os.Exit(1)
+	}
+	ringBufferSize := *ringBufferSizePtr
+	if ringBufferSize < os.Getpagesize() || ringBufferSize&(ringBufferSize-1) != 0 {
+		slog.Error("Ring buffer size must be a power of two and at least one page", "ringbuf_size", ringBufferSize)
+		os.Exit(1)
+	}
+
 	cfg := Config{
 		TargetPID:            uint32(targetPID),
 		LokiEndpoint:         lokiEndpoint,
+		LokiBatchBytes:       max(*lokiBatchBytesPtr, 1),
+		LokiBatchWait:        max(*lokiBatchWaitPtr, time.Millisecond),
+		LokiWorkers:          max(*lokiWorkersPtr, 1),
+		LokiEncoding:         *lokiEncodingPtr,
+		LokiSpoolDir:         *lokiSpoolDirPtr,
+		LokiSpoolMaxBytes:    max(*lokiSpoolMaxBytesPtr, 1),
+		LokiLabels:           lokiLabels,
+		LokiMetadata:         lokiMetadata,
+		LokiMetadataMode:     *lokiMetadataModePtr,
+		OTLPEndpoint:         *otlpEndpointPtr,
+		OTLPBatchBytes:       max(*otlpBatchBytesPtr, 1),
+		OTLPBatchWait:        max(*otlpBatchWaitPtr, time.Millisecond),
+		OTLPWorkers:          max(*otlpWorkersPtr, 1),
+		OTLPCompression:      *otlpCompressionPtr,
+		OTLPRetryMaxBytes:    max(*otlpRetryMaxBytesPtr, 0),
 		FileOutput:           fileOutput,
+		FileFormat:           *fileFormatPtr,
+		FileCompression:      *fileCompressionPtr,
+		FileCompressionLevel: *fileCompressionLevelPtr,
+		FileSync:             *fileSyncPtr,
+		FileSyncInterval:     fileSyncInterval,
+		FilePreallocate:      max(*filePreallocatePtr, 0),
+		CompressRotated:      *compressRotatedPtr,
+		CompressWorkers:      max(*compressWorkersPtr, 1),
+		CompressThreads:      max(*compressThreadsPtr, 1),
+		FileIndex:            *fileIndexPtr,
+		FileIndexInterval:    max(*fileIndexIntervalPtr, 1),
+		ParquetOutput:        *parquetOutputPtr,
+		ParquetCompression:   *parquetCompressionPtr,
+		ParquetRowGroupSize:  max(*parquetRowGroupSizePtr, 1),
+		DemuxDir:             *demuxDirPtr,
+		DemuxBy:              *demuxByPtr,
+		DemuxMaxOpen:         max(*demuxMaxOpenPtr, 1),
+		RawDir:               *rawDirPtr,
+		RawIndexBytes:        max(*rawIndexBytesPtr, 0),
 		TrackingInterval:     time.Duration(trackingInterval) * time.Second,
 		MaxRecordsFileOutput: maxRecords,
 		MaxBackups:           *maxBackupsPtr,
+		MaxFileBytes:         max(*maxFileBytesPtr, 0),
+		RotateInterval:       max(*rotateIntervalPtr, 0),
+		MaxTotalBytes:        max(*maxTotalBytesPtr, 0),
 		MetricsPort:          *metricsPortPtr,
 		RESTPort:             restPort,
 		SilenceStdout:        *silenceStdoutPtr || *silenceStdoutShorthandPtr,
+		StdoutBufferSize:     stdoutBufferSize,
+		StdoutFlushInterval:  stdoutFlushInterval,
+		Shards:               shards,
+		ShardQueueDepth:      shardQueueDepth,
+		Backpressure:         backpressure,
+		SpillDir:             *spillDirPtr,
+		SpillMaxBytes:        *spillMaxBytesPtr,
+		BusyPoll:             busyPoll,
+		BusyPollSpin:         *busyPollSpinPtr,
+		RingLayout:           *ringLayoutPtr,
+		RingBufferSize:       uint32(ringBufferSize),
+		ReorderWindow:        *reorderWindowPtr,
+		ReorderMaxEvents:     *reorderMaxEventsPtr,
+		LineMode:             *lineModePtr,
+		LineMaxBytes:         *lineMaxBytesPtr,
+		LineIdleFlush:        *lineIdleFlushPtr,
+		SinkQueueDepth:       sinkQueueDepth,
+		SinkBackpressure:     sinkBackpressure,
 	}
 
 	if fdString != "" {
@@ -120,6 +474,112 @@ func Parse() Config {
 	return cfg
 }
 
+// Sinks lists the output sink names accepted by --sink-backpressure.
+var Sinks = []string{"stdout", "file", "parquet", "demux", "raw", "loki", "otlp"}
+
+// parseSinkPolicies parses --sink-backpressure. A bare policy applies to every
+// sink; otherwise each comma-separated name=policy entry overrides the
+// drop-newest default of one sink. Spill is not available for sinks.
+func parseSinkPolicies(s string) (map[string]queue.Policy, error) {
+	policies := make(map[string]queue.Policy, len(Sinks))
+	for _, name := range Sinks {
+		policies[name] = queue.DropNewest
+	}
+
+	if !strings.Contains(s, "=") {
+		p, err := queue.ParsePolicy(strings.TrimSpace(s))
+		if err != nil {
+			return nil, err
+		}
+		if p == queue.Spill {
+			return nil, fmt.Errorf("spill is not supported for sinks")
+		}
+		for name := range policies {
+			policies[name] = p
+		}
+		return policies, nil
+	}
+
+	for _, part := range strings.Split(s, ",") {
+		name, value, ok := strings.Cut(strings.TrimSpace(part), "=")
+		if !ok {
+			return nil, fmt.Errorf("expected sink=policy, got %q", part)
+		}
+		if _, known := policies[name]; !known {
+			return nil, fmt.Errorf("unknown sink %q (want %s)", name, strings.Join(Sinks, ", "))
+		}
+		p, err := queue.ParsePolicy(value)
+		if err != nil {
+			return nil, err
+		}
+		if p == queue.Spill {
+			return nil, fmt.Errorf("spill is not supported for sink %q", name)
+		}
+		policies[name] = p
+	}
+	return policies, nil
+}
+
+// LabelTemplate is a label whose value is rendered per record: literal text
+// with {field} references, such as {pid} or a registration label like {job}.
+type LabelTemplate struct {
+	Name  string
+	Value string
+}
+
+// ParseLabelTemplates parses a comma-separated list of name=template pairs.
+// Names must be valid Prometheus label names, unique, and braces balanced.
+func ParseLabelTemplates(s string) ([]LabelTemplate, error) {
+	var templates []LabelTemplate
+	seen := make(map[string]bool)
+	for _, part := range strings.Split(s, ",") {
+		part = strings.TrimSpace(part)
+		if part == "" {
+			continue
+		}
+		name, value, ok := strings.Cut(part, "=")
+		if !ok {
+			return nil, fmt.Errorf("expected name=template, got %q", part)
+		}
+		if !isLabelName(name) {
+			return nil, fmt.Errorf("invalid label name %q", name)
+		}
+		if seen[name] {
+			return nil, fmt.Errorf("duplicate label %q", name)
+		}
+		seen[name] = true
+
+		for rest := value; rest != ""; {
+			open := strings.IndexAny(rest, "{}")
+			if open < 0 {
+				break
+			}
+			if rest[open] == '}' {
+				return nil, fmt.Errorf("unbalanced braces in %q", part)
+			}
+			end := strings.IndexByte(rest[open:], '}')
+			if end < 0 || !isLabelName(rest[open+1:open+end]) {
+				return nil, fmt.Errorf("invalid field reference in %q", part)
+			}
+			rest = rest[open+end+1:]
+		}
+		templates = append(templates, LabelTemplate{Name: name, Value: value})
+	}
+	return templates, nil
+}
+
+func isLabelName(s string) bool {
+	if s == "" {
+		return false
+	}
+	for i, c := range s {
+		if c != '_' && (c < 'a' || c > 'z') && (c < 'A' || c > 'Z') && (i == 0 || c < '0' || c > '9') {
+			return false
+		}
+	}
+	return true
+}
+
 func initLogger() {
 	level := slog.LevelInfo
 	switch strings.ToUpper(os.Getenv("LOG_LEVEL")) {
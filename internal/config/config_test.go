@@ -0,0 +1,45 @@
+package config
+
+import (
+	"reflect"
+	"testing"
+)
+
+func TestParseLabelTemplates(t *testing.T) {
+	tests := []struct {
+		in      string
+		want    []LabelTemplate
+		wantErr bool
+	}{
+		{in: "", want: nil},
+		{in: "app=write-tracer", want: []LabelTemplate{{"app", "write-tracer"}}},
+		{
+			in:   DefaultLokiLabels,
+			want: []LabelTemplate{{"app", "write-tracer"}, {"host", "{host}"}, {"job", "{job}"}},
+		},
+		{
+			in:   " rank=r{rank} , empty= ,",
+			want: []LabelTemplate{{"rank", "r{rank}"}, {"empty", ""}},
+		},
+		{in: "stream={host}-{pid}/{fd}", want: []LabelTemplate{{"stream", "{host}-{pid}/{fd}"}}},
+		{in: "app", wantErr: true},
+		{in: "rank =x", wantErr: true},
+		{in: "1app=x", wantErr: true},
+		{in: "a-b=x", wantErr: true},
+		{in: "app=x,app=y", wantErr: true},
+		{in: "pid={pid", wantErr: true},
+		{in: "pid=pid}", wantErr: true},
+		{in: "pid={}", wantErr: true},
+		{in: "pid={p-id}", wantErr: true},
+	}
+	for _, tt := range tests {
+		got, err := ParseLabelTemplates(tt.in)
+		if (err != nil) != tt.wantErr {
+			t.Errorf("ParseLabelTemplates(%q) error = %v, want error %v", tt.in, err, tt.wantErr)
+			continue
+		}
+		if !tt.wantErr && !reflect.DeepEqual(got, tt.want) {
+			t.Errorf("ParseLabelTemplates(%q) = %v, want %v", tt.in, got, tt.want)
+		}
+	}
+}
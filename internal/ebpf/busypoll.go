@@ -0,0 +1,112 @@
+package ebpf
+
+import (
+	"context"
+	"errors"
+	"os"
+	"runtime"
+	"time"
+
+	"github.com/cilium/ebpf/ringbuf"
+)
+
+const (
+	// busyPollCheckEvery is how many empty polls pass between clock reads
+	// while spinning.
+	busyPollCheckEvery = 64
+	// busyPollMinSpin is the floor of the adaptive spin budget.
+	busyPollMinSpin = time.Microsecond
+	// busyPollBlockTimeout bounds each blocking epoll wait once the poller
+	// has backed off, so cancellation is noticed without closing the reader
+	// under a concurrent spin.
+	busyPollBlockTimeout = 100 * time.Millisecond
+)
+
+// busyPoller reads the ring buffer for lowest latency. While records keep
+// coming it never sleeps: an empty ring buffer is detected by spinning on the
+// mmap'd producer and consumer positions (AvailableBytes, no syscall) on a
+// goroutine locked to its OS thread. The spin budget adapts: it doubles up to
+// maxSpin when spinning finds new data and halves when it expires, in which
+// case the poller falls back to a blocking epoll wait like the default mode.
+type busyPoller struct {
+	ctx     context.Context
+	rd      *ringbuf.Reader
+	spin    time.Duration
+	maxSpin time.Duration
+	locked  bool
+}
+
+func newBusyPoller(ctx context.Context, rd *ringbuf.Reader, maxSpin time.Duration) *busyPoller {
+	return &busyPoller{
+		ctx:     ctx,
+		rd:      rd,
+		spin:    maxSpin,
+		maxSpin: max(maxSpin, busyPollMinSpin),
+	}
+}
+
+// read has the contract of ringbuf.Reader.ReadInto. The poller owns the
+// reader: it closes it once ctx is cancelled and then returns ErrClosed.
+func (p *busyPoller) read(rec *ringbuf.Record) error {
+	if !p.locked {
+		runtime.LockOSThread()
+		p.locked = true
+	}
+
+	// A deadline in the past turns the epoll wait inside ReadInto into a
+	// non-blocking check, so an empty ring buffer returns immediately.
+	p.rd.SetDeadline(time.Unix(1, 0))
+
+	for {
+		if p.ctx.Err() != nil {
+			return p.close()
+		}
+
+		err := p.rd.ReadInto(rec)
+		if !errors.Is(err, os.ErrDeadlineExceeded) {
+			return err
+		}
+		if p.spinUntilData() {
+			continue
+		}
+
+		// Spin budget exhausted: block in epoll until data arrives.
+		for {
+			p.rd.SetDeadline(time.Now().Add(busyPollBlockTimeout))
+			err := p.rd.ReadInto(rec)
+			if !errors.Is(err, os.ErrDeadlineExceeded) {
+				return err
+			}
+			if p.ctx.Err() != nil {
+				return p.close()
+			}
+		}
+	}
+}
+
+// spinUntilData polls the ring buffer positions until data is available or
+// the spin budget runs out, adapting the budget to the outcome.
+func (p *busyPoller) spinUntilData() bool {
+	start := time.Now()
+	for i := 1; ; i++ {
+		if p.rd.AvailableBytes() > 0 {
+			p.spin = min(p.spin*2, p.maxSpin)
+			return true
+		}
+		if i%busyPollCheckEvery == 0 {
+			if p.ctx.Err() != nil || time.Since(start) >= p.spin {
+				p.spin = max(p.spin/2, busyPollMinSpin)
+				return false
+			}
+		}
+	}
+}
+
+func (p *busyPoller) close() error {
+	p.rd.Close()
+	if p.locked {
+		runtime.UnlockOSThread()
+		p.locked = false
+	}
+	return ringbuf.ErrClosed
+}
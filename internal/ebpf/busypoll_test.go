@@ -0,0 +1,126 @@
+package ebpf
+
+import (
+	"context"
+	"encoding/binary"
+	"slices"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/asm"
+	"github.com/cilium/ebpf/ringbuf"
+	"github.com/cilium/ebpf/rlimit"
+	"golang.org/x/sys/unix"
+)
+
+// newTestRing returns a ring buffer and a program that emits one 8-byte
+// record carrying bpf_ktime_get_ns() into it per run. It skips the benchmark
+// when BPF is unavailable, e.g. without CAP_BPF.
+func newTestRing(b *testing.B) (*ebpf.Map, *ebpf.Program) {
+	b.Helper()
+	if err := rlimit.RemoveMemlock(); err != nil {
+		b.Skip("removing memlock limit:", err)
+	}
+	ring, err := ebpf.NewMap(&ebpf.MapSpec{Type: ebpf.RingBuf, MaxEntries: 1 << 20})
+	if err != nil {
+		b.Skip("creating ring buffer:", err)
+	}
+	b.Cleanup(func() { ring.Close() })
+
+	prog, err := ebpf.NewProgram(&ebpf.ProgramSpec{
+		Type:    ebpf.SocketFilter,
+		License: "GPL",
+		Instructions: asm.Instructions{
+			asm.FnKtimeGetNs.Call(),
+			asm.StoreMem(asm.RFP, -8, asm.R0, asm.DWord),
+			asm.LoadMapPtr(asm.R1, ring.FD()),
+			asm.Mov.Reg(asm.R2, asm.RFP),
+			asm.Add.Imm(asm.R2, -8),
+			asm.Mov.Imm(asm.R3, 8),
+			asm.Mov.Imm(asm.R4, 0),
+			asm.FnRingbufOutput.Call(),
+			asm.Mov.Imm(asm.R0, 0),
+			asm.Return(),
+		},
+	})
+	if err != nil {
+		b.Skip("loading program:", err)
+	}
+	b.Cleanup(func() { prog.Close() })
+	return ring, prog
+}
+
+// BenchmarkReadLatency measures the time from bpf_ringbuf_output in the
+// kernel to the record being in the hands of the reader, for the default
+// blocking epoll reads and for busy polling. Events are produced one at a
+// time, each after the previous one was consumed, as in interactive use.
+func BenchmarkReadLatency(b *testing.B) {
+	modes := []struct {
+		name string
+		read func(ctx context.Context, rd *ringbuf.Reader) func(*ringbuf.Record) error
+	}{
+		{"epoll", func(ctx context.Context, rd *ringbuf.Reader) func(*ringbuf.Record) error {
+			// As in the pipeline, closing the reader ends a blocked read.
+			go func() {
+				<-ctx.Done()
+				rd.Close()
+			}()
+			return rd.ReadInto
+		}},
+		{"busy-poll", func(ctx context.Context, rd *ringbuf.Reader) func(*ringbuf.Record) error {
+			return newBusyPoller(ctx, rd, 200*time.Microsecond).read
+		}},
+	}
+	for _, mode := range modes {
+		b.Run(mode.name, func(b *testing.B) {
+			ring, prog := newTestRing(b)
+			rd, err := ringbuf.NewReader(ring)
+			if err != nil {
+				b.Fatal(err)
+			}
+			ctx, cancel := context.WithCancel(context.Background())
+			read := mode.read(ctx, rd)
+
+			var consumed atomic.Int64
+			latencies := make([]time.Duration, 0, b.N)
+			done := make(chan struct{})
+			go func() {
+				defer close(done)
+				var rec ringbuf.Record
+				var now unix.Timespec
+				for read(&rec) == nil {
+					unix.ClockGettime(unix.CLOCK_MONOTONIC, &now)
+					sent := binary.NativeEndian.Uint64(rec.RawSample)
+					latencies = append(latencies, time.Duration(uint64(now.Nano())-sent))
+					consumed.Add(1)
+				}
+			}()
+
+			// Socket filters need at least an Ethernet header of input.
+			opts := &ebpf.RunOptions{Data: make([]byte, 14)}
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				if _, err := prog.Run(opts); err != nil {
+					b.Fatal(err)
+				}
+				for consumed.Load() <= int64(i) {
+					// Wait for the reader without sleeping.
+				}
+			}
+			b.StopTimer()
+
+			cancel()
+			<-done
+			rd.Close()
+			slices.Sort(latencies)
+			var sum time.Duration
+			for _, l := range latencies {
+				sum += l
+			}
+			b.ReportMetric(float64(sum.Nanoseconds())/float64(len(latencies)), "ns/event")
+			b.ReportMetric(float64(latencies[len(latencies)*99/100].Nanoseconds()), "p99-ns/event")
+		})
+	}
+}
@@ -0,0 +1,115 @@
+package ebpf
+
+import (
+	"log/slog"
+	"time"
+
+	"write-tracer/internal/event"
+	"write-tracer/internal/output"
+	"write-tracer/internal/queue"
+)
+
+// dropLog rate-limits overflow warnings across all dispatchers.
+var dropLog = queue.NewLogLimiter(5 * time.Second)
+
+// dispatcher collects events into one pending batch per shard and hands
+// batches to the shard queues, applying the backpressure policy when a queue
+// is full. A dispatcher is owned by a single producer goroutine; several
+// dispatchers may feed the same shard queues.
+type dispatcher struct {
+	shards     []chan *event.Batch
+	pending    []*event.Batch
+	policy     queue.Policy
+	spills     []*spill
+	dropReason string
+}
+
+func newDispatcher(shards []chan *event.Batch, policy queue.Policy, spills []*spill) *dispatcher {
+	d := &dispatcher{
+		shards:     shards,
+		pending:    make([]*event.Batch, len(shards)),
+		policy:     policy,
+		spills:     spills,
+		dropReason: "queue_full",
+	}
+	if policy == queue.DropOldest {
+		d.dropReason = "queue_evicted"
+	}
+	for i := range d.pending {
+		d.pending[i] = event.NewBatch()
+	}
+	return d
+}
+
+// decode decodes a raw ring buffer sample in place into the pending batch of
+// its shard.
+func (d *dispatcher) decode(raw []byte) error {
+	s := shardFor(event.PeekPID(raw), len(d.shards))
+	err := d.pending[s].Decode(raw)
+	if d.pending[s].Full() {
+		d.send(s)
+	}
+	return err
+}
+
+// add copies ev into the pending batch of its shard.
+func (d *dispatcher) add(ev *event.WriteEvent) {
+	s := shardFor(ev.PID, len(d.shards))
+	d.pending[s].Add(ev)
+	if d.pending[s].Full() {
+		d.send(s)
+	}
+}
+
+// flush sends every non-empty pending batch.
+func (d *dispatcher) flush() {
+	for i, b := range d.pending {
+		if b.Len() > 0 {
+			d.send(i)
+		}
+	}
+}
+
+// close delivers the pending batches, blocking if needed so nothing is lost
+// on shutdown, and releases the dispatcher's slabs.
+func (d *dispatcher) close() {
+	for i, b := range d.pending {
+		switch {
+		case b.Len() == 0:
+			b.Release()
+		case d.spills != nil:
+			d.spills[i].offer(b)
+		default:
+			d.shards[i] <- b
+		}
+		d.pending[i] = nil
+	}
+}
+
+func (d *dispatcher) send(s int) {
+	batch := d.pending[s]
+	d.pending[s] = event.NewBatch()
+	if d.spills != nil {
+		d.spills[s].offer(batch)
+		return
+	}
+	queue.Offer(d.shards[s], batch, d.policy, d.drop)
+}
+
+func (d *dispatcher) drop(batch *event.Batch) {
+	output.AddDroppedEvents(d.dropReason, batch.Len())
+	if suppressed, ok := dropLog.Allow(); ok {
+		slog.Warn("Shard queue full, dropping events", "policy", d.policy.String(),
+			"count", batch.Len(), "suppressed_warnings", suppressed)
+	}
+	batch.Release()
+}
+
+// shardFor maps a process ID onto one of n shards. Sharding by PID keeps all
+// threads of a process on the same worker, which preserves per-thread (and
+// per-process) event order while spreading processes across cores.
+func shardFor(pid uint32, n int) int {
+	// Fibonacci hashing followed by a multiply-shift range reduction.
+	h := pid * 2654435761
+	return int(uint64(h) * uint64(n) >> 32)
+}
@@ -0,0 +1,113 @@
+package ebpf
+
+import (
+	"sync"
+	"testing"
+
+	"write-tracer/internal/event"
+	"write-tracer/internal/queue"
+)
+
+// rawEvent returns a ring buffer sample for pid carrying seq as timestamp.
+func rawEvent(pid uint32, seq uint64) []byte {
+	e := event.WriteEvent{Timestamp: seq, Count: 43, PID: pid, TID: pid, FD: 1}
+	copy(e.Comm[:], "mpi_rank")
+	copy(e.Data[:], "step 100 loss=0.0312 lr=0.001 elapsed=1.2s\n")
+	return e.AppendRaw(nil)
+}
+
+func TestDispatcherOrder(t *testing.T) {
+	const shards, pids, perPID = 4, 16, 1000
+	chans := make([]chan *event.Batch, shards)
+	for i := range chans {
+		chans[i] = make(chan *event.Batch, pids*perPID/event.BatchSize+shards)
+	}
+	d := newDispatcher(chans, queue.Block, nil)
+	for seq := uint64(1); seq <= perPID; seq++ {
+		for pid := uint32(1); pid <= pids; pid++ {
+			if err := d.decode(rawEvent(pid, seq)); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	d.close()
+
+	// Every event reaches the shard of its PID, in the order it was read.
+	last := make(map[uint32]uint64)
+	total := 0
+	for i, ch := range chans {
+		close(ch)
+		for b := range ch {
+			for _, e := range b.Events {
+				if s := shardFor(e.PID, shards); s != i {
+					t.Fatalf("pid %d on shard %d, want %d", e.PID, i, s)
+				}
+				if e.Timestamp != last[e.PID]+1 {
+					t.Fatalf("pid %d: event %d after %d", e.PID, e.Timestamp, last[e.PID])
+				}
+				last[e.PID] = e.Timestamp
+				total++
+			}
+			b.Release()
+		}
+	}
+	if total != pids*perPID {
+		t.Fatalf("got %d events, want %d", total, pids*perPID)
+	}
+}
+
+// BenchmarkTransport compares handing events from the reader to a processor
+// one by value per channel operation with handing them over in batches.
+// Both queues hold the same number of events.
+func BenchmarkTransport(b *testing.B) {
+	const depth = 4096
+	raw := rawEvent(1234, 1)
+
+	b.Run("per-event", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(event.Size)
+		ch := make(chan event.WriteEvent, depth)
+		var wg sync.WaitGroup
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for e := range ch {
+				_ = e.Count
+			}
+		}()
+		var e event.WriteEvent
+		for i := 0; i < b.N; i++ {
+			if err := e.Decode(raw); err != nil {
+				b.Fatal(err)
+			}
+			ch <- e
+		}
+		close(ch)
+		wg.Wait()
+	})
+	b.Run("per-batch", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(event.Size)
+		ch := make(chan *event.Batch, depth/event.BatchSize)
+		var wg sync.WaitGroup
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for batch := range ch {
+				for i := range batch.Events {
+					_ = batch.Events[i].Count
+				}
+				batch.Release()
+			}
+		}()
+		d := newDispatcher([]chan *event.Batch{ch}, queue.Block, nil)
+		for i := 0; i < b.N; i++ {
+			if err := d.decode(raw); err != nil {
+				b.Fatal(err)
+			}
+		}
+		d.close()
+		close(ch)
+		wg.Wait()
+	})
+}
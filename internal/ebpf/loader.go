@@ -13,6 +13,9 @@ import (
 	"github.com/cilium/ebpf/rlimit"
 )
 
+// maxRings mirrors MAX_RINGS in bpf/write_tracer.bpf.c.
+const maxRings = 1024
+
 //go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang -cflags $BPF_CFLAGS bpf ../../bpf/write_tracer.bpf.c -- -I../../bpf/headers
 
 func Load(cfg config.Config) (*ebpf.Collection, []link.Link, error) {
@@ -24,6 +27,8 @@ func Load(cfg config.Config) (*ebpf.Collection, []link.Link, error) {
 	if err != nil {
 		return nil, nil, fmt.Errorf("load spec: %w", err)
 	}
+	spec.Maps["events"].MaxEntries = cfg.RingBufferSize
+	spec.Maps["event_rings"].InnerMap.MaxEntries = cfg.RingBufferSize
 
 	coll, err := ebpf.NewCollection(spec)
 	if err != nil {
@@ -35,6 +40,15 @@ func Load(cfg config.Config) (*ebpf.Collection, []link.Link, error) {
 		NumFds:    cfg.NumFDs,
 		TargetFds: cfg.TargetFDs,
 	}
+	if cfg.RingLayout != config.RingLayoutShared {
+		n, err := setupRings(coll, spec.Maps["event_rings"].InnerMap, cfg.RingLayout)
+		if err != nil {
+			coll.Close()
+			return nil, nil, fmt.Errorf("set up %s ring buffers: %w", cfg.RingLayout, err)
+		}
+		bpfCfg.NumRings = uint32(n)
+		slog.Info("Using multiple ring buffers", "layout", cfg.RingLayout, "rings", n)
+	}
 	if err := coll.Maps["config_map"].Update(uint32(0), bpfCfg, ebpf.UpdateAny); err != nil {
 		coll.Close()
 		return nil, nil, fmt.Errorf("update config map: %w", err)
@@ -1,74 +1,356 @@
 package ebpf
 
 import (
-	"bytes"
 	"context"
-	"encoding/binary"
 	"errors"
-	"fmt"
 	"log/slog"
+	"sync"
 	"time"
 
 	"write-tracer/internal/config"
 	"write-tracer/internal/event"
 	"write-tracer/internal/output"
+	"write-tracer/internal/pidmgr"
+	"write-tracer/internal/queue"
 
 	"github.com/cilium/ebpf"
 	"github.com/cilium/ebpf/ringbuf"
 )
 
-func StartProcessing(ctx context.Context, cfg config.Config, eventsMap, trackedPidsMap *ebpf.Map) error {
-	rd, err := ringbuf.NewReader(eventsMap)
+// StartProcessing starts one reader per ring buffer and the shard workers.
+// The returned channel is closed once the pipeline has drained and every sink
+// has been flushed and closed after ctx is cancelled. registry maps records
+// to their registration for the demux sink.
+func StartProcessing(ctx context.Context, cfg config.Config, coll *ebpf.Collection, registry *pidmgr.PIDRegistry) (<-chan struct{}, error) {
+	readers, err := openRingReaders(cfg, coll)
 	if err != nil {
-		return fmt.Errorf("create ring buffer reader: %w", err)
+		return nil, err
 	}
+	closeReaders := func() {
+		for _, r := range readers {
+			r.close()
+		}
+	}
+
+	// Every sink gets its own bounded queue and worker behind the fan-out,
+	// so a slow sink drops (or, under block, delays) only its own output.
+	sinks := output.NewFanout()
+	rotation := output.Rotation{
+		MaxRecords:    cfg.MaxRecordsFileOutput,
+		MaxBytes:      cfg.MaxFileBytes,
+		MaxAge:        cfg.RotateInterval,
+		MaxBackups:    cfg.MaxBackups,
+		MaxTotalBytes: cfg.MaxTotalBytes,
+	}
+	if !cfg.SilenceStdout {
+		sinks.Add(output.NewStdoutWriter(cfg.StdoutBufferSize, cfg.StdoutFlushInterval),
+			cfg.SinkQueueDepth, cfg.SinkBackpressure["stdout"])
+	}
+	if cfg.FileOutput != "" {
+		fw, err := output.NewFileWriter(cfg.FileOutput, output.FileOptions{
+			Rotation:         rotation,
+			Format:           cfg.FileFormat,
+			Compression:      cfg.FileCompression,
+			CompressionLevel: cfg.FileCompressionLevel,
+			Sync:             cfg.FileSync,
+			SyncInterval:     cfg.FileSyncInterval,
+			Preallocate:      cfg.FilePreallocate,
+			CompressRotated:  cfg.CompressRotated,
+			CompressWorkers:  cfg.CompressWorkers,
+			CompressThreads:  cfg.CompressThreads,
+			Index:            cfg.FileIndex,
+			IndexInterval:    cfg.FileIndexInterval,
+		})
+		if err != nil {
+			sinks.Close()
+			closeReaders()
+			return nil, err
+		}
+		sinks.Add(fw, cfg.SinkQueueDepth, cfg.SinkBackpressure["file"])
+	}
+	if cfg.ParquetOutput != "" {
+		pw, err := output.NewParquetWriter(cfg.ParquetOutput, cfg.ParquetCompression, cfg.ParquetRowGroupSize, rotation)
+		if err != nil {
+			sinks.Close()
+			closeReaders()
+			return nil, err
+		}
+		sinks.Add(pw, cfg.SinkQueueDepth, cfg.SinkBackpressure["parquet"])
+	}
+	// Records of processes that ended before their owner could be resolved
+	// fall back to a registration of their own.
+	owner := func(pid uint32) uint32 {
+		if owner, ok := registry.Owner(pid); ok {
+			return owner
+		}
+		return pid
+	}
+	if cfg.DemuxDir != "" {
+		prefix, key := "pid", func(pid uint32) uint32 { return pid }
+		if cfg.DemuxBy == config.DemuxByRegistration {
+			prefix, key = "job", owner
+		}
+		dw, err := output.NewDemuxWriter(cfg.DemuxDir, prefix, cfg.DemuxMaxOpen, rotation, key, owner)
+		if err != nil {
+			sinks.Close()
+			closeReaders()
+			return nil, err
+		}
+		registry.OnUnregister(dw.Release)
+		sinks.Add(dw, cfg.SinkQueueDepth, cfg.SinkBackpressure["demux"])
+	}
+	if cfg.RawDir != "" {
+		if cfg.LineMode {
+			slog.Warn("Raw output loses the newlines split off by --line-mode")
+		}
+		rw, err := output.NewRawWriter(cfg.RawDir, cfg.DemuxMaxOpen, rotation, cfg.RawIndexBytes, owner)
+		if err != nil {
+			sinks.Close()
+			closeReaders()
+			return nil, err
+		}
+		registry.OnUnregister(rw.Release)
+		sinks.Add(rw, cfg.SinkQueueDepth, cfg.SinkBackpressure["raw"])
+	}
+	if cfg.LokiEndpoint != "" {
+		loki, err := output.NewLokiClient(cfg.LokiEndpoint, output.LokiOptions{
+			BatchBytes:    cfg.LokiBatchBytes,
+			BatchWait:     cfg.LokiBatchWait,
+			Workers:       cfg.LokiWorkers,
+			Encoding:      cfg.LokiEncoding,
+			SpoolDir:      cfg.LokiSpoolDir,
+			SpoolMaxBytes: cfg.LokiSpoolMaxBytes,
+
+			Labels:             cfg.LokiLabels,
+			Metadata:           cfg.LokiMetadata,
+			MetadataInLine:     cfg.LokiMetadataMode == config.LokiMetadataLine,
+			Owner:              registry.Owner,
+			RegistrationLabels: registry.Labels,
+		})
+		if err != nil {
+			sinks.Close()
+			closeReaders()
+			return nil, err
+		}
+		registry.OnUnregister(loki.Release)
+		sinks.Add(loki, cfg.SinkQueueDepth, cfg.SinkBackpressure["loki"])
+	}
+	if cfg.OTLPEndpoint != "" {
+		otlp, err := output.NewOTLPExporter(cfg.OTLPEndpoint, output.OTLPOptions{
+			BatchBytes:         cfg.OTLPBatchBytes,
+			BatchWait:          cfg.OTLPBatchWait,
+			Workers:            cfg.OTLPWorkers,
+			Compression:        cfg.OTLPCompression,
+			RetryMaxBytes:      cfg.OTLPRetryMaxBytes,
+			Owner:              registry.Owner,
+			RegistrationLabels: registry.Labels,
+		})
+		if err != nil {
+			sinks.Close()
+			closeReaders()
+			return nil, err
+		}
+		registry.OnUnregister(otlp.Release)
+		sinks.Add(otlp, cfg.SinkQueueDepth, cfg.SinkBackpressure["otlp"])
+	}
+
+	// One queue and worker per shard. Each queue slot carries up to
+	// event.BatchSize events. Spills are created before the workers start,
+	// so a failure leaves nothing running.
+	shards := make([]chan *event.Batch, cfg.Shards)
+	for i := range shards {
+		shards[i] = make(chan *event.Batch, cfg.ShardQueueDepth)
+	}
+
+	var spills []*spill
+	if cfg.Backpressure == queue.Spill {
+		spills = make([]*spill, 0, len(shards))
+		for i, ch := range shards {
+			s, err := newSpill(cfg.SpillDir, i, cfg.SpillMaxBytes/int64(len(shards)), ch)
+			if err != nil {
+				for _, s := range spills {
+					s.close()
+				}
+				sinks.Close()
+				closeReaders()
+				return nil, err
+			}
+			spills = append(spills, s)
+		}
+	}
+
+	depths := make([]func() int, cfg.Shards)
+	var wg sync.WaitGroup
+	for i := range shards {
+		ch := shards[i]
+		depths[i] = func() int { return len(ch) }
+
+		w := &shardWorker{sinks: sinks, idle: cfg.LineIdleFlush}
+		if cfg.LineMode {
+			w.lines = event.NewLineAssembler(cfg.LineMaxBytes, cfg.LineIdleFlush)
+		}
+
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			processEvents(w, ch)
+		}()
+	}
+	output.RegisterShards(depths)
+
+	slog.Info("Processing pipeline started", "ring_buffers", len(readers), "shards", cfg.Shards,
+		"queue_depth", cfg.ShardQueueDepth, "backpressure", cfg.Backpressure.String(), "busy_poll", cfg.BusyPoll,
+		"reorder_window", cfg.ReorderWindow, "line_mode", cfg.LineMode, "sinks", sinks.Len())
+
+	// Shutdown runs in pipeline order: closing the readers makes every
+	// readRingBuffer deliver its pending batches, the reorder stage (if any)
+	// emits what it holds, then spills are replayed and the shard queues
+	// closed, the shards drain them, and only then are the sink queues
+	// drained and the sinks flushed and closed.
+	if !cfg.BusyPoll {
+		go func() {
+			<-ctx.Done()
+			for _, r := range readers {
+				r.rd.Close()
+			}
+		}()
+	}
+
+	// With a reorder window, readers feed a single merge queue (blocking, so
+	// the ring buffers absorb bursts) and the reorder stage dispatches in
+	// timestamp order, under the configured policy, to the single shard the
+	// configuration then allows, so the sinks receive that order.
+	readerDispatch := func() *dispatcher {
+		return newDispatcher(shards, cfg.Backpressure, spills)
+	}
+	var merged chan *event.Batch
+	reorderDone := make(chan struct{})
+	if cfg.ReorderWindow > 0 {
+		merged = make(chan *event.Batch, cfg.ShardQueueDepth)
+		readerDispatch = func() *dispatcher {
+			return newDispatcher([]chan *event.Batch{merged}, queue.Block, nil)
+		}
+		go func() {
+			defer close(reorderDone)
+			reorderEvents(merged, cfg.ReorderWindow, cfg.ReorderMaxEvents, newDispatcher(shards, cfg.Backpressure, spills))
+		}()
+	} else {
+		close(reorderDone)
+	}
+
+	var readersWG sync.WaitGroup
+	for _, r := range readers {
+		readersWG.Add(1)
+		go func(r ringReader) {
+			defer readersWG.Done()
+			if r.affinity != nil {
+				if err := pinToCPUs(r.affinity); err != nil {
+					slog.Warn("Failed to pin ring buffer consumer", "cpus", len(r.affinity), "error", err)
+				}
+			}
 
-	eventChan := make(chan event.WriteEvent, 1024)
+			read := r.rd.ReadInto
+			if cfg.BusyPoll {
+				read = newBusyPoller(ctx, r.rd, cfg.BusyPollSpin).read
+			}
+			readRingBuffer(read, readerDispatch())
+		}(r)
+	}
+
+	done := make(chan struct{})
+	go func() {
+		readersWG.Wait()
+		closeReaders()
+		if merged != nil {
+			close(merged)
+		}
+		<-reorderDone
+		for i := range shards {
+			if spills != nil {
+				spills[i].close()
+			}
+			close(shards[i])
+		}
 
-	go processEvents(ctx, cfg, rd, eventChan)
-	go countTrackedPids(ctx, cfg.TrackingInterval, trackedPidsMap)
-	go readRingBuffer(ctx, rd, eventChan)
+		wg.Wait()
+		sinks.Close()
+		close(done)
+	}()
+	go countTrackedPids(ctx, cfg.TrackingInterval, coll.Maps["tracked_pids"])
 
-	return nil
+	return done, nil
 }
 
-func processEvents(ctx context.Context, cfg config.Config, rd *ringbuf.Reader, eventChan <-chan event.WriteEvent) {
-	defer rd.Close()
+// shardWorker is the worker of one shard. It encodes the records of a batch
+// into a single chunk and publishes it to the sinks, so every sink shares the
+// same encoding and sees one chunk per batch rather than one call per event.
+type shardWorker struct {
+	sinks *output.Fanout
+	lines *event.LineAssembler // nil unless line mode is enabled
+	idle  time.Duration        // partial line idle flush period
 
-	fw := output.NewFileWriter(cfg.FileOutput, cfg.MaxRecordsFileOutput, cfg.MaxBackups)
-	defer fw.Close()
+	chunk *output.Chunk
+}
 
-	var loki *output.LokiClient
-	if cfg.LokiEndpoint != "" {
-		loki = output.NewLokiClient(cfg.LokiEndpoint)
+// processEvents runs the shard worker until batchChan is closed and drained.
+// In line mode, partial lines are flushed when idle and on shutdown.
+func processEvents(w *shardWorker, batchChan <-chan *event.Batch) {
+	w.chunk = output.NewChunk()
+	emit := w.emit
+
+	var idleTick <-chan time.Time
+	if w.lines != nil {
+		ticker := time.NewTicker(max(w.idle/2, time.Millisecond))
+		defer ticker.Stop()
+		idleTick = ticker.C
 	}
 
 	for {
 		select {
-		case <-ctx.Done():
-			return
-		case ev := <-eventChan:
-			line := ev.String()
-			if !cfg.SilenceStdout {
-				fmt.Println(line)
-			}
-			output.IncrementWriteCalls()
-
-			if err := fw.Write(line); err != nil {
-				slog.Warn("File write failed", "error", err)
+		case batch, ok := <-batchChan:
+			if !ok {
+				if w.lines != nil {
+					w.lines.Flush(emit)
+					w.flush()
+				}
+				return
 			}
 
-			if loki != nil {
-				go func(e event.WriteEvent) {
-					if err := loki.Push(e); err != nil {
-						slog.Warn("Loki push failed", "error", err)
-					}
-				}(ev)
+			output.AddWriteCalls(batch.Len())
+			if w.lines != nil {
+				now := time.Now()
+				for i := range batch.Events {
+					w.lines.Add(&batch.Events[i], now, emit)
+				}
+			} else {
+				for i := range batch.Events {
+					rec := batch.Events[i].Record()
+					emit(&rec)
+				}
 			}
+			batch.Release()
+			w.flush()
+		case now := <-idleTick:
+			w.lines.FlushIdle(now, emit)
+			w.flush()
 		}
 	}
 }
 
+// emit adds one record to the current chunk.
+func (w *shardWorker) emit(rec *event.Record) {
+	w.chunk.Add(rec)
+}
+
+// flush publishes the current chunk to the sinks.
+func (w *shardWorker) flush() {
+	if w.chunk.Len() == 0 {
+		return
+	}
+	w.sinks.Publish(w.chunk)
+	w.chunk = output.NewChunk()
+}
+
 func countTrackedPids(ctx context.Context, interval time.Duration, trackedPidsMap *ebpf.Map) {
 	ticker := time.NewTicker(interval)
 	defer ticker.Stop()
@@ -90,29 +372,36 @@ func countTrackedPids(ctx context.Context, interval time.Duration, trackedPidsMa
 	}
 }
 
-func readRingBuffer(ctx context.Context, rd *ringbuf.Reader, eventChan chan<- event.WriteEvent) {
+// readRingBuffer drains the ring buffer through read (ReadInto, or a busy
+// poller) and decodes every sample in place into d's pending batches. Pending
+// batches are sent once full or once the ring buffer has no more data
+// immediately available, so batching adds no latency when the event rate is
+// low. The record is reused, so the steady-state read path does not allocate.
+// Once the reader is closed, pending batches are delivered.
+func readRingBuffer(read func(*ringbuf.Record) error, d *dispatcher) {
+	defer d.close()
+
+	var record ringbuf.Record
+	errLog := queue.NewLogLimiter(5 * time.Second)
 	for {
-		record, err := rd.Read()
-		if err != nil {
+		if err := read(&record); err != nil {
 			if errors.Is(err, ringbuf.ErrClosed) {
 				return
 			}
-			slog.Error("Ring buffer read failed", "error", err)
+			if suppressed, ok := errLog.Allow(); ok {
+				slog.Error("Ring buffer read failed", "error", err, "suppressed_errors", suppressed)
+			}
 			continue
 		}
 
-		var ev event.WriteEvent
-		if err := binary.Read(bytes.NewReader(record.RawSample), binary.LittleEndian, &ev); err != nil {
-			slog.Error("Event parse failed", "error", err)
-			continue
+		if err := d.decode(record.RawSample); err != nil {
+			output.AddDroppedEvents("parse_error", 1)
+			if suppressed, ok := errLog.Allow(); ok {
+				slog.Error("Event parse failed", "error", err, "suppressed_errors", suppressed)
+			}
 		}
-
-		select {
-		case eventChan <- ev:
-		case <-ctx.Done():
-			return
-		default:
-			slog.Warn("Event channel full, dropping event")
+		if record.Remaining == 0 {
+			d.flush()
 		}
 	}
 }
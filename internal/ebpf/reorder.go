@@ -0,0 +1,51 @@
+package ebpf
+
+import (
+	"time"
+
+	"write-tracer/internal/event"
+	"write-tracer/internal/output"
+)
+
+// reorderEvents merges the batches of all ring buffer readers into kernel
+// timestamp order before dispatching them to the shards. Events are held for
+// up to window behind the newest one; see event.Reorder. Pending shard
+// batches are flushed whenever the input queue runs empty, as the readers do
+// when the ring buffer runs empty. It returns once in is closed, after
+// emitting everything still buffered.
+func reorderEvents(in <-chan *event.Batch, window time.Duration, limit int, d *dispatcher) {
+	defer d.close()
+
+	r := event.NewReorder(window, limit)
+	emit := d.add
+
+	ticker := time.NewTicker(max(window/4, time.Millisecond))
+	defer ticker.Stop()
+
+	for {
+		select {
+		case batch, ok := <-in:
+			if !ok {
+				r.Flush(emit)
+				output.SetReorderBuffered(0)
+				return
+			}
+			now := time.Now()
+			for i := range batch.Events {
+				r.Push(&batch.Events[i], now, emit)
+			}
+			batch.Release()
+			r.Advance(now, emit)
+		case now := <-ticker.C:
+			r.Advance(now, emit)
+		}
+
+		if late := r.Late(); late > 0 {
+			output.AddLateEvents(int(late))
+		}
+		output.SetReorderBuffered(r.Len())
+		if len(in) == 0 {
+			d.flush()
+		}
+	}
+}
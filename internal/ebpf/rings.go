@@ -0,0 +1,99 @@
+package ebpf
+
+import (
+	"fmt"
+
+	"write-tracer/internal/config"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/ringbuf"
+)
+
+// ringReader is the consumer side of one ring buffer.
+type ringReader struct {
+	rd       *ringbuf.Reader
+	ring     *ebpf.Map // inner map of event_rings, nil for the shared ring
+	affinity []int     // CPUs the consumer runs on, nil for no pinning
+}
+
+func (r ringReader) close() {
+	r.rd.Close()
+	if r.ring != nil {
+		r.ring.Close()
+	}
+}
+
+// setupRings creates one ring buffer per group of the configured layout,
+// inserts them into event_rings and points every CPU at its ring buffer.
+// It returns the number of ring buffers.
+func setupRings(coll *ebpf.Collection, innerSpec *ebpf.MapSpec, layout string) (int, error) {
+	groups, err := ringGroups(layout)
+	if err != nil {
+		return 0, err
+	}
+	if len(groups) > maxRings {
+		return 0, fmt.Errorf("%d ring buffers exceed the limit of %d", len(groups), maxRings)
+	}
+
+	for i, g := range groups {
+		ring, err := ebpf.NewMap(innerSpec)
+		if err != nil {
+			return 0, fmt.Errorf("create ring buffer %d: %w", i, err)
+		}
+		// event_rings keeps its own reference; the reader reopens it by lookup.
+		err = coll.Maps["event_rings"].Update(uint32(i), ring, ebpf.UpdateAny)
+		ring.Close()
+		if err != nil {
+			return 0, fmt.Errorf("insert ring buffer %d: %w", i, err)
+		}
+
+		for _, cpu := range g.cpus {
+			if cpu >= maxRings {
+				return 0, fmt.Errorf("CPU %d exceeds the limit of %d", cpu, maxRings)
+			}
+			if err := coll.Maps["cpu_ring"].Update(uint32(cpu), uint32(i), ebpf.UpdateAny); err != nil {
+				return 0, fmt.Errorf("update cpu_ring for CPU %d: %w", cpu, err)
+			}
+		}
+	}
+	return len(groups), nil
+}
+
+// openRingReaders opens a reader on every ring buffer of the configured
+// layout: the shared events map, or each inner map of event_rings.
+func openRingReaders(cfg config.Config, coll *ebpf.Collection) ([]ringReader, error) {
+	if cfg.RingLayout == config.RingLayoutShared {
+		rd, err := ringbuf.NewReader(coll.Maps["events"])
+		if err != nil {
+			return nil, fmt.Errorf("create ring buffer reader: %w", err)
+		}
+		return []ringReader{{rd: rd}}, nil
+	}
+
+	groups, err := ringGroups(cfg.RingLayout)
+	if err != nil {
+		return nil, err
+	}
+
+	readers := make([]ringReader, 0, len(groups))
+	closeAll := func() {
+		for _, r := range readers {
+			r.close()
+		}
+	}
+	for i, g := range groups {
+		var ring *ebpf.Map
+		if err := coll.Maps["event_rings"].Lookup(uint32(i), &ring); err != nil {
+			closeAll()
+			return nil, fmt.Errorf("lookup ring buffer %d: %w", i, err)
+		}
+		rd, err := ringbuf.NewReader(ring)
+		if err != nil {
+			ring.Close()
+			closeAll()
+			return nil, fmt.Errorf("create ring buffer reader %d: %w", i, err)
+		}
+		readers = append(readers, ringReader{rd: rd, ring: ring, affinity: g.affinity})
+	}
+	return readers, nil
+}
@@ -0,0 +1,166 @@
+package ebpf
+
+import (
+	"fmt"
+	"log/slog"
+	"os"
+	"sync"
+
+	"write-tracer/internal/event"
+	"write-tracer/internal/output"
+)
+
+// spill is the on-disk overflow of one shard queue under the spill policy.
+// Once a batch does not fit in the queue, that batch and every later batch of
+// the shard are appended to the spill file until a replay goroutine has fed
+// all of it back into the queue, so per-thread order survives the overflow.
+// Events are stored in the ring buffer layout and the file is unlinked on
+// creation, so nothing is left behind after a crash.
+type spill struct {
+	mu       sync.Mutex
+	file     *os.File
+	maxBytes int64
+	wr, rd   int64 // write and replay offsets
+	buf      []byte
+
+	out  chan<- *event.Batch
+	wake chan struct{}
+	stop chan struct{}
+	done chan struct{}
+}
+
+func newSpill(dir string, shard int, maxBytes int64, out chan<- *event.Batch) (*spill, error) {
+	f, err := os.CreateTemp(dir, fmt.Sprintf("write-tracer-spill-%d-*", shard))
+	if err != nil {
+		return nil, fmt.Errorf("create spill file: %w", err)
+	}
+	os.Remove(f.Name())
+
+	s := &spill{
+		file:     f,
+		maxBytes: maxBytes,
+		buf:      make([]byte, 0, event.BatchSize*event.Size),
+		out:      out,
+		wake:     make(chan struct{}, 1),
+		stop:     make(chan struct{}),
+		done:     make(chan struct{}),
+	}
+	go s.replayLoop()
+	return s, nil
+}
+
+// offer queues batch directly while the spill is empty and the queue has
+// room, and appends it to the spill file otherwise. It takes ownership of
+// batch and never blocks on the queue.
+func (s *spill) offer(batch *event.Batch) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	if s.wr == s.rd {
+		select {
+		case s.out <- batch:
+			return
+		default:
+		}
+	}
+	defer batch.Release()
+
+	size := int64(batch.Len() * event.Size)
+	if s.wr-s.rd+size > s.maxBytes {
+		output.AddDroppedEvents("spill_full", batch.Len())
+		return
+	}
+
+	s.buf = s.buf[:0]
+	for i := range batch.Events {
+		s.buf = batch.Events[i].AppendRaw(s.buf)
+	}
+	if _, err := s.file.WriteAt(s.buf, s.wr); err != nil {
+		output.AddDroppedEvents("spill_error", batch.Len())
+		slog.Warn("Spill write failed", "error", err)
+		return
+	}
+	s.wr += size
+	output.AddSpilledEvents(batch.Len())
+	output.AddSpillBytes(size)
+
+	select {
+	case s.wake <- struct{}{}:
+	default:
+	}
+}
+
+// close stops the replay goroutine, synchronously replays whatever is left
+// and releases the file. The queue must still be drained by its consumer.
+func (s *spill) close() {
+	close(s.stop)
+	<-s.done
+
+	buf := make([]byte, event.BatchSize*event.Size)
+	for s.replay(buf, nil) {
+	}
+	s.file.Close()
+}
+
+func (s *spill) replayLoop() {
+	defer close(s.done)
+
+	buf := make([]byte, event.BatchSize*event.Size)
+	for {
+		select {
+		case <-s.stop:
+			return
+		case <-s.wake:
+		}
+		for s.replay(buf, s.stop) {
+		}
+	}
+}
+
+// replay moves up to one batch of spilled events back into the queue,
+// blocking until the queue accepts it or stop is closed. It reports whether
+// it made progress.
+func (s *spill) replay(buf []byte, stop <-chan struct{}) bool {
+	s.mu.Lock()
+	if s.wr == s.rd {
+		// Fully replayed: start over at the beginning of the file.
+		s.file.Truncate(0)
+		s.wr, s.rd = 0, 0
+		s.mu.Unlock()
+		return false
+	}
+	n := min(s.wr-s.rd, int64(len(buf)))
+	off := s.rd
+	s.mu.Unlock()
+
+	// The region [rd, wr) is only ever appended to, so it can be read
+	// without holding the lock.
+	if _, err := s.file.ReadAt(buf[:n], off); err != nil {
+		slog.Error("Spill read failed", "error", err)
+		output.AddDroppedEvents("spill_error", int(n/event.Size))
+		s.advance(n)
+		return true
+	}
+	batch := event.NewBatch()
+	for raw := buf[:n]; len(raw) >= event.Size; raw = raw[event.Size:] {
+		batch.Decode(raw)
+	}
+
+	select {
+	case s.out <- batch:
+	case <-stop:
+		batch.Release()
+		return false
+	}
+
+	s.advance(n)
+	return true
+}
+
+// advance marks n bytes at the replay offset as consumed.
+func (s *spill) advance(n int64) {
+	s.mu.Lock()
+	s.rd += n
+	s.mu.Unlock()
+	output.AddSpillBytes(-n)
+}
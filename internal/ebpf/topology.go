@@ -0,0 +1,139 @@
+package ebpf
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+
+	"golang.org/x/sys/unix"
+)
+
+// ringGroup is one ring buffer of the per-CPU / per-node layouts: the CPUs
+// whose writes are submitted to it, and the CPUs its consumer may run on.
+type ringGroup struct {
+	cpus     []int
+	affinity []int
+}
+
+// ringGroups partitions the possible CPUs into ring buffers for layout
+// ("per-cpu" or "per-node"). Consumers are kept on the NUMA node of the CPUs
+// they drain, but not pinned to a single CPU so they do not compete with the
+// producers on it.
+func ringGroups(layout string) ([]ringGroup, error) {
+	cpus, err := readCPUList("/sys/devices/system/cpu/possible")
+	if err != nil {
+		return nil, err
+	}
+
+	nodes := numaNodes(cpus)
+	nodeOf := make(map[int][]int, len(cpus))
+	for _, nodeCPUs := range nodes {
+		for _, cpu := range nodeCPUs {
+			nodeOf[cpu] = nodeCPUs
+		}
+	}
+
+	var groups []ringGroup
+	switch layout {
+	case "per-cpu":
+		for _, cpu := range cpus {
+			groups = append(groups, ringGroup{cpus: []int{cpu}, affinity: nodeOf[cpu]})
+		}
+	case "per-node":
+		for _, nodeCPUs := range nodes {
+			groups = append(groups, ringGroup{cpus: nodeCPUs, affinity: nodeCPUs})
+		}
+	default:
+		return nil, fmt.Errorf("unknown ring buffer layout %q", layout)
+	}
+	return groups, nil
+}
+
+// numaNodes returns the CPUs of every NUMA node, or a single node holding all
+// cpus on systems without NUMA information.
+func numaNodes(cpus []int) [][]int {
+	paths, _ := filepath.Glob("/sys/devices/system/node/node[0-9]*/cpulist")
+	sort.Slice(paths, func(i, j int) bool {
+		return nodeNumber(paths[i]) < nodeNumber(paths[j])
+	})
+
+	var nodes [][]int
+	seen := make(map[int]bool, len(cpus))
+	for _, path := range paths {
+		nodeCPUs, err := readCPUList(path)
+		if err != nil || len(nodeCPUs) == 0 {
+			continue
+		}
+		for _, cpu := range nodeCPUs {
+			seen[cpu] = true
+		}
+		nodes = append(nodes, nodeCPUs)
+	}
+
+	// Possible but offline CPUs are not listed under any node.
+	var rest []int
+	for _, cpu := range cpus {
+		if !seen[cpu] {
+			rest = append(rest, cpu)
+		}
+	}
+	switch {
+	case len(nodes) == 0:
+		nodes = [][]int{rest}
+	case len(rest) > 0:
+		nodes[0] = append(nodes[0], rest...)
+	}
+	return nodes
+}
+
+func nodeNumber(path string) int {
+	n, _ := strconv.Atoi(strings.TrimPrefix(filepath.Base(filepath.Dir(path)), "node"))
+	return n
+}
+
+// readCPUList parses a kernel CPU list such as "0-3,8,10-11".
+func readCPUList(path string) ([]int, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+
+	var cpus []int
+	for _, part := range strings.Split(strings.TrimSpace(string(data)), ",") {
+		if part == "" {
+			continue
+		}
+		lo, hi, isRange := strings.Cut(part, "-")
+		first, err := strconv.Atoi(lo)
+		if err != nil {
+			return nil, fmt.Errorf("parse %s: %w", path, err)
+		}
+		last := first
+		if isRange {
+			if last, err = strconv.Atoi(hi); err != nil {
+				return nil, fmt.Errorf("parse %s: %w", path, err)
+			}
+		}
+		for cpu := first; cpu <= last; cpu++ {
+			cpus = append(cpus, cpu)
+		}
+	}
+	return cpus, nil
+}
+
+// pinToCPUs locks the calling goroutine to its OS thread and restricts that
+// thread to cpus. The goroutine is expected to run until it exits, at which
+// point the runtime discards the pinned thread.
+func pinToCPUs(cpus []int) error {
+	runtime.LockOSThread()
+
+	var set unix.CPUSet
+	for _, cpu := range cpus {
+		set.Set(cpu)
+	}
+	return unix.SchedSetaffinity(0, &set)
+}
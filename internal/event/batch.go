@@ -0,0 +1,71 @@
+package event
+
+import (
+	"sync"
+	"sync/atomic"
+)
+
+// BatchSize is the number of events carried by one Batch.
+const BatchSize = 256
+
+// Batch is a fixed-capacity slab of events handed between pipeline stages as a
+// unit, so channel synchronization is paid once per batch instead of once per
+// event. Batches are pooled and reference counted: the last consumer to call
+// Release returns the slab to the pool.
+type Batch struct {
+	Events []WriteEvent
+	refs   atomic.Int32
+}
+
+var batchPool = sync.Pool{
+	New: func() any {
+		return &Batch{Events: make([]WriteEvent, 0, BatchSize)}
+	},
+}
+
+// NewBatch returns an empty batch from the pool holding one reference.
+func NewBatch() *Batch {
+	b := batchPool.Get().(*Batch)
+	b.Events = b.Events[:0]
+	b.refs.Store(1)
+	return b
+}
+
+// Decode decodes a raw ring buffer sample directly into the next free slot.
+// The slot is only committed if decoding succeeds.
+func (b *Batch) Decode(raw []byte) error {
+	n := len(b.Events)
+	if err := b.Events[:n+1][n].Decode(raw); err != nil {
+		return err
+	}
+	b.Events = b.Events[:n+1]
+	return nil
+}
+
+// Add appends a copy of ev.
+func (b *Batch) Add(ev *WriteEvent) {
+	b.Events = append(b.Events, *ev)
+}
+
+// Len returns the number of events in the batch.
+func (b *Batch) Len() int {
+	return len(b.Events)
+}
+
+// Full reports whether the batch has reached BatchSize events.
+func (b *Batch) Full() bool {
+	return len(b.Events) >= BatchSize
+}
+
+// Retain adds n references, one per additional consumer.
+func (b *Batch) Retain(n int) {
+	b.refs.Add(int32(n))
+}
+
+// Release drops one reference and recycles the batch once none remain.
+// The batch must not be used after its last Release.
+func (b *Batch) Release() {
+	if b.refs.Add(-1) == 0 {
+		batchPool.Put(b)
+	}
+}
@@ -2,12 +2,32 @@ package event
 
 import (
 	"bytes"
-	"encoding/json"
-	"strings"
+	"encoding/binary"
+	"errors"
+	"unsafe"
 
 	"write-tracer/internal/config"
 )
 
+// Field offsets of struct write_event (see bpf/write_tracer.bpf.c).
+const (
+	offTimestamp = 0
+	offCount     = 8
+	offPID       = 16
+	offTID       = 20
+	offFD        = 24
+	offComm      = 32
+	offData      = offComm + config.MaxExecNameSize
+)
+
+// Size is the size in bytes of struct write_event as emitted by the eBPF
+// program into the ring buffer.
+const Size = offData + config.MaxDataSize
+
+// ErrShortRecord is returned by Decode when a ring buffer sample is smaller
+// than struct write_event.
+var ErrShortRecord = errors.New("event: short ring buffer record")
+
 type WriteEvent struct {
 	Timestamp uint64                       `json:"timestamp"`
 	Count     uint64                       `json:"count"`
@@ -19,32 +39,92 @@ type WriteEvent struct {
 	Data      [config.MaxDataSize]byte     `json:"data"`
 }
 
+// Compile-time checks that WriteEvent mirrors the layout of struct write_event.
+// Any drift between the C and Go definitions fails the build here instead of
+// silently corrupting decoded events.
+var (
+	_ [Size - unsafe.Sizeof(WriteEvent{})]struct{}
+	_ [unsafe.Sizeof(WriteEvent{}) - Size]struct{}
+	_ [offComm - unsafe.Offsetof(WriteEvent{}.Comm)]struct{}
+	_ [unsafe.Offsetof(WriteEvent{}.Comm) - offComm]struct{}
+	_ [offData - unsafe.Offsetof(WriteEvent{}.Data)]struct{}
+	_ [unsafe.Offsetof(WriteEvent{}.Data) - offData]struct{}
+)
+
+// Decode fills e from a raw ring buffer sample using fixed offsets.
+// It does not allocate and only copies the captured part of the payload;
+// bytes of Data past the captured length are left unspecified, which is why
+// consumers should go through DataBytes / DataString.
+func (e *WriteEvent) Decode(raw []byte) error {
+	if len(raw) < Size {
+		return ErrShortRecord
+	}
+
+	le := binary.LittleEndian
+	e.Timestamp = le.Uint64(raw[offTimestamp:])
+	e.Count = le.Uint64(raw[offCount:])
+	e.PID = le.Uint32(raw[offPID:])
+	e.TID = le.Uint32(raw[offTID:])
+	e.FD = le.Uint32(raw[offFD:])
+	copy(e.Comm[:], raw[offComm:offData])
+	copy(e.Data[:e.dataLen()], raw[offData:])
+	return nil
+}
+
+// AppendRaw appends e to dst in the ring buffer layout understood by Decode.
+func (e *WriteEvent) AppendRaw(dst []byte) []byte {
+	n := len(dst)
+	dst = append(dst, make([]byte, Size)...)
+	raw := dst[n:]
+
+	le := binary.LittleEndian
+	le.PutUint64(raw[offTimestamp:], e.Timestamp)
+	le.PutUint64(raw[offCount:], e.Count)
+	le.PutUint32(raw[offPID:], e.PID)
+	le.PutUint32(raw[offTID:], e.TID)
+	le.PutUint32(raw[offFD:], e.FD)
+	copy(raw[offComm:offData], e.Comm[:])
+	copy(raw[offData:], e.DataBytes())
+	return dst
+}
+
+// PeekPID returns the PID of a raw ring buffer sample without decoding it,
+// or 0 if the sample is too short.
+func PeekPID(raw []byte) uint32 {
+	if len(raw) < offPID+4 {
+		return 0
+	}
+	return binary.LittleEndian.Uint32(raw[offPID:])
+}
+
 func (e WriteEvent) String() string {
-	comm := string(bytes.TrimRight(e.Comm[:], "\x00"))
-
-	// Cap data length to actual buffer size
-	dataLen := min(e.Count, config.MaxDataSize)
-	data := strings.TrimRight(string(e.Data[:dataLen]), "\n\r")
-
-	m := map[string]any{
-		"timestamp": e.Timestamp,
-		"pid":       e.PID,
-		"tid":       e.TID,
-		"comm":      comm,
-		"fd":        e.FD,
-		"count":     e.Count,
-		"data":      data,
+	return string(e.AppendJSON(nil))
+}
+
+// CommBytes returns a view of the NUL-trimmed process name. The slice aliases
+// e and is only valid as long as e is not modified.
+func (e *WriteEvent) CommBytes() []byte {
+	if i := bytes.IndexByte(e.Comm[:], 0); i >= 0 {
+		return e.Comm[:i]
 	}
+	return e.Comm[:]
+}
 
-	b, _ := json.Marshal(m)
-	return string(b)
+// DataBytes returns a view of the captured payload, capped to the buffer size.
+// The slice aliases e and is only valid as long as e is not modified.
+func (e *WriteEvent) DataBytes() []byte {
+	return e.Data[:e.dataLen()]
 }
 
 func (e WriteEvent) CommString() string {
-	return string(bytes.TrimRight(e.Comm[:], "\x00"))
+	return string(e.CommBytes())
 }
 
 func (e WriteEvent) DataString() string {
-	dataLen := min(e.Count, config.MaxDataSize)
-	return strings.TrimRight(string(e.Data[:dataLen]), "\n\r")
+	return string(bytes.TrimRight(e.DataBytes(), "\n\r"))
+}
+
+// dataLen is the number of payload bytes actually captured by the eBPF program.
+func (e *WriteEvent) dataLen() int {
+	return int(min(e.Count, config.MaxDataSize))
 }
@@ -0,0 +1,86 @@
+package event
+
+import (
+	"bytes"
+	"encoding/binary"
+	"testing"
+)
+
+// testEvent returns a typical captured write: a short log line.
+func testEvent() *WriteEvent {
+	e := &WriteEvent{Timestamp: 1_000_000, Count: 43, PID: 1234, TID: 1235, FD: 1}
+	copy(e.Comm[:], "mpi_rank")
+	copy(e.Data[:], "step 100 loss=0.0312 lr=0.001 elapsed=1.2s\n")
+	return e
+}
+
+func TestDecode(t *testing.T) {
+	want := testEvent()
+	raw := want.AppendRaw(nil)
+	if len(raw) != Size {
+		t.Fatalf("len(raw) = %d, want %d", len(raw), Size)
+	}
+
+	// The fixed-offset decoder must agree with the reflective one it
+	// replaced.
+	var ref, got WriteEvent
+	if err := binary.Read(bytes.NewReader(raw), binary.LittleEndian, &ref); err != nil {
+		t.Fatal(err)
+	}
+	if err := got.Decode(raw); err != nil {
+		t.Fatal(err)
+	}
+	if got != ref || got != *want {
+		t.Fatalf("Decode = %v, want %v", got, ref)
+	}
+	if PeekPID(raw) != want.PID {
+		t.Errorf("PeekPID = %d, want %d", PeekPID(raw), want.PID)
+	}
+
+	if err := got.Decode(raw[:Size-1]); err != ErrShortRecord {
+		t.Errorf("Decode(short) error = %v, want %v", err, ErrShortRecord)
+	}
+	if n := testing.AllocsPerRun(100, func() { _ = got.Decode(raw) }); n != 0 {
+		t.Errorf("Decode allocates %v times per event", n)
+	}
+}
+
+func BenchmarkDecode(b *testing.B) {
+	raw := testEvent().AppendRaw(nil)
+
+	b.Run("binary.Read", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(Size)
+		var e WriteEvent
+		for i := 0; i < b.N; i++ {
+			if err := binary.Read(bytes.NewReader(raw), binary.LittleEndian, &e); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run("Decode", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(Size)
+		var e WriteEvent
+		for i := 0; i < b.N; i++ {
+			if err := e.Decode(raw); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+	b.Run("Batch", func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(Size)
+		batch := NewBatch()
+		for i := 0; i < b.N; i++ {
+			if batch.Full() {
+				batch.Release()
+				batch = NewBatch()
+			}
+			if err := batch.Decode(raw); err != nil {
+				b.Fatal(err)
+			}
+		}
+		batch.Release()
+	})
+}
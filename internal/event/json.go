@@ -0,0 +1,107 @@
+package event
+
+import (
+	"bytes"
+	"strconv"
+	"unicode/utf8"
+)
+
+const hexDigits = "0123456789abcdef"
+
+// jsonSafe reports, for every ASCII byte, whether it can be copied into a JSON
+// string verbatim. It mirrors encoding/json with HTML escaping enabled so the
+// encoded output is byte-for-byte identical to json.Marshal.
+var jsonSafe = func() (t [utf8.RuneSelf]bool) {
+	for b := 0x20; b < utf8.RuneSelf; b++ {
+		t[b] = true
+	}
+	for _, b := range []byte{'"', '\\', '<', '>', '&'} {
+		t[b] = false
+	}
+	return t
+}()
+
+// AppendJSON appends the JSON object for e to dst and returns the extended
+// buffer. It performs no allocations beyond growing dst.
+func (e *WriteEvent) AppendJSON(dst []byte) []byte {
+	r := e.Record()
+	return r.AppendJSON(dst)
+}
+
+// AppendJSON appends the JSON object for r to dst and returns the extended
+// buffer. Trailing newlines are trimmed from the data. Keys are emitted in
+// the same (sorted) order json.Marshal used for the previous map-based
+// encoding, so existing consumers see identical lines.
+func (r *Record) AppendJSON(dst []byte) []byte {
+	dst = append(dst, `{"comm":`...)
+	dst = appendJSONString(dst, r.Comm)
+	dst = append(dst, `,"count":`...)
+	dst = strconv.AppendUint(dst, r.Count, 10)
+	dst = append(dst, `,"data":`...)
+	dst = appendJSONString(dst, bytes.TrimRight(r.Data, "\n\r"))
+	dst = append(dst, `,"fd":`...)
+	dst = strconv.AppendUint(dst, uint64(r.FD), 10)
+	dst = append(dst, `,"pid":`...)
+	dst = strconv.AppendUint(dst, uint64(r.PID), 10)
+	dst = append(dst, `,"tid":`...)
+	dst = strconv.AppendUint(dst, uint64(r.TID), 10)
+	dst = append(dst, `,"timestamp":`...)
+	dst = strconv.AppendUint(dst, r.Timestamp, 10)
+	return append(dst, '}')
+}
+
+// appendJSONString appends s as a quoted JSON string. Runs of plain ASCII are
+// copied in bulk; control bytes and HTML-sensitive characters are escaped,
+// and invalid UTF-8 is replaced with U+FFFD.
+func appendJSONString(dst, s []byte) []byte {
+	dst = append(dst, '"')
+	start := 0
+	for i := 0; i < len(s); {
+		if b := s[i]; b < utf8.RuneSelf {
+			if jsonSafe[b] {
+				i++
+				continue
+			}
+			dst = append(dst, s[start:i]...)
+			switch b {
+			case '\\', '"':
+				dst = append(dst, '\\', b)
+			case '\b':
+				dst = append(dst, '\\', 'b')
+			case '\f':
+				dst = append(dst, '\\', 'f')
+			case '\n':
+				dst = append(dst, '\\', 'n')
+			case '\r':
+				dst = append(dst, '\\', 'r')
+			case '\t':
+				dst = append(dst, '\\', 't')
+			default:
+				dst = append(dst, '\\', 'u', '0', '0', hexDigits[b>>4], hexDigits[b&0xF])
+			}
+			i++
+			start = i
+			continue
+		}
+
+		r, size := utf8.DecodeRune(s[i:])
+		if r == utf8.RuneError && size == 1 {
+			dst = append(dst, s[start:i]...)
+			dst = append(dst, `\ufffd`...)
+			i += size
+			start = i
+			continue
+		}
+		// U+2028 and U+2029 are valid JSON but break JavaScript parsers.
+		if r == '\u2028' || r == '\u2029' {
+			dst = append(dst, s[start:i]...)
+			dst = append(dst, '\\', 'u', '2', '0', '2', hexDigits[r&0xF])
+			i += size
+			start = i
+			continue
+		}
+		i += size
+	}
+	dst = append(dst, s[start:]...)
+	return append(dst, '"')
+}
@@ -0,0 +1,78 @@
+package event
+
+import (
+	"bytes"
+	"encoding/json"
+	"testing"
+)
+
+// marshalMap is the map-based encoding AppendJSON replaced.
+func marshalMap(e *WriteEvent) []byte {
+	b, _ := json.Marshal(map[string]any{
+		"timestamp": e.Timestamp,
+		"pid":       e.PID,
+		"tid":       e.TID,
+		"comm":      string(e.CommBytes()),
+		"fd":        e.FD,
+		"count":     e.Count,
+		"data":      string(bytes.TrimRight(e.DataBytes(), "\n\r")),
+	})
+	return b
+}
+
+func TestAppendJSON(t *testing.T) {
+	tests := []struct {
+		name string
+		data string
+	}{
+		{"plain", "step 100 loss=0.0312\n"},
+		{"empty", ""},
+		{"trailing newlines", "done\r\n\n"},
+		{"quotes and backslashes", `path="C:\tmp"`},
+		{"html", "<a href=\"x\">&amp;</a>"},
+		{"control bytes", "a\x00b\x01c\x1fd\x7fe\tf\ng\rh"},
+		{"multibyte", "température 25°C — ok"},
+		{"invalid utf-8", "a\xffb\xc3(c\xe2\x82"},
+		{"line separators", "a\u2028b\u2029c"},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			e := testEvent()
+			e.Count = uint64(len(tt.data))
+			copy(e.Data[:], tt.data)
+
+			got := e.AppendJSON(nil)
+			if want := marshalMap(e); !bytes.Equal(got, want) {
+				t.Errorf("AppendJSON =\n%s\nwant\n%s", got, want)
+			}
+			if !json.Valid(got) {
+				t.Errorf("AppendJSON produced invalid JSON: %s", got)
+			}
+		})
+	}
+
+	e := testEvent()
+	buf := make([]byte, 0, 1024)
+	if n := testing.AllocsPerRun(100, func() { buf = e.AppendJSON(buf[:0]) }); n != 0 {
+		t.Errorf("AppendJSON allocates %v times per event", n)
+	}
+}
+
+func BenchmarkAppendJSON(b *testing.B) {
+	e := testEvent()
+
+	b.Run("json.Marshal", func(b *testing.B) {
+		b.ReportAllocs()
+		for i := 0; i < b.N; i++ {
+			_ = marshalMap(e)
+		}
+	})
+	b.Run("AppendJSON", func(b *testing.B) {
+		b.ReportAllocs()
+		buf := make([]byte, 0, 1024)
+		for i := 0; i < b.N; i++ {
+			buf = e.AppendJSON(buf[:0])
+		}
+		b.SetBytes(int64(len(buf)))
+	})
+}
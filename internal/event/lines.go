@@ -0,0 +1,145 @@
+package event
+
+import (
+	"bytes"
+	"time"
+
+	"write-tracer/internal/config"
+)
+
+// LineAssembler reassembles logical lines from the writes of each (tid, fd)
+// pair: a line written over several write calls becomes one record, and a
+// write carrying several lines becomes several records. Each record's
+// timestamp is that of the write where the line started and its Count is the
+// line length.
+//
+// Partial lines are bounded: a line reaching maxLine bytes is emitted as is,
+// and a partial line that sees no write for idle is emitted by FlushIdle.
+// Writes larger than config.MaxDataSize are only partly captured by the eBPF
+// program; their missing tail cannot be recovered, so the next captured bytes
+// simply continue the current line.
+//
+// A LineAssembler is not safe for concurrent use. Sharding by PID gives each
+// shard its own assembler.
+type LineAssembler struct {
+	maxLine int
+	idle    time.Duration
+	partial map[lineKey]*partialLine
+	free    []*partialLine
+}
+
+type lineKey struct {
+	tid uint32
+	fd  uint32
+}
+
+type partialLine struct {
+	rec      Record
+	comm     [config.MaxExecNameSize]byte
+	buf      []byte
+	lastSeen time.Time
+}
+
+// NewLineAssembler creates an assembler with the given bounds.
+func NewLineAssembler(maxLine int, idle time.Duration) *LineAssembler {
+	return &LineAssembler{
+		maxLine: max(maxLine, 1),
+		idle:    idle,
+		partial: make(map[lineKey]*partialLine),
+	}
+}
+
+// Add splits the payload of ev into lines and emits every completed line.
+// Lines contained in a single write are emitted as views into ev without
+// copying. emit must not retain the record after it returns.
+func (a *LineAssembler) Add(ev *WriteEvent, now time.Time, emit func(*Record)) {
+	key := lineKey{tid: ev.TID, fd: ev.FD}
+	data := ev.DataBytes()
+
+	for len(data) > 0 {
+		i := bytes.IndexByte(data, '\n')
+		if i < 0 {
+			a.appendPartial(key, ev, data, now, emit)
+			return
+		}
+
+		line := data[:i]
+		data = data[i+1:]
+		if p := a.partial[key]; p != nil {
+			a.appendPartial(key, ev, line, now, emit)
+			if p = a.partial[key]; p != nil {
+				a.emitPartial(key, p, emit)
+			}
+			continue
+		}
+
+		rec := ev.Record()
+		rec.Count = uint64(len(line))
+		rec.Data = line
+		emit(&rec)
+	}
+}
+
+// FlushIdle emits the partial lines that have not grown for the idle period.
+func (a *LineAssembler) FlushIdle(now time.Time, emit func(*Record)) {
+	for key, p := range a.partial {
+		if now.Sub(p.lastSeen) >= a.idle {
+			a.emitPartial(key, p, emit)
+		}
+	}
+}
+
+// Flush emits every partial line.
+func (a *LineAssembler) Flush(emit func(*Record)) {
+	for key, p := range a.partial {
+		a.emitPartial(key, p, emit)
+	}
+}
+
+// appendPartial appends a fragment to the partial line of key, emitting the
+// line each time it reaches maxLine.
+func (a *LineAssembler) appendPartial(key lineKey, ev *WriteEvent, frag []byte, now time.Time, emit func(*Record)) {
+	for len(frag) > 0 {
+		p := a.partial[key]
+		if p == nil {
+			p = a.newPartial(ev)
+			a.partial[key] = p
+		}
+		n := min(len(frag), a.maxLine-len(p.buf))
+		p.buf = append(p.buf, frag[:n]...)
+		p.lastSeen = now
+		frag = frag[n:]
+		if len(p.buf) >= a.maxLine {
+			a.emitPartial(key, p, emit)
+		}
+	}
+}
+
+func (a *LineAssembler) newPartial(ev *WriteEvent) *partialLine {
+	var p *partialLine
+	if n := len(a.free); n > 0 {
+		p = a.free[n-1]
+		a.free = a.free[:n-1]
+	} else {
+		p = &partialLine{}
+	}
+	p.rec = ev.Record()
+	p.comm = ev.Comm
+	p.buf = p.buf[:0]
+	return p
+}
+
+func (a *LineAssembler) emitPartial(key lineKey, p *partialLine, emit func(*Record)) {
+	delete(a.partial, key)
+
+	rec := p.rec
+	rec.Comm = p.comm[:len(rec.Comm)]
+	rec.Count = uint64(len(p.buf))
+	rec.Data = p.buf
+	emit(&rec)
+
+	// Keep small buffers for reuse; let unusually long ones go.
+	if cap(p.buf) <= 4096 {
+		a.free = append(a.free, p)
+	}
+}
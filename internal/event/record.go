@@ -0,0 +1,36 @@
+package event
+
+// Record is the unit handed to sinks: one captured write or, in line mode,
+// one reassembled logical line. Comm and Data are views owned by the stage
+// that produced the record and are only valid until it moves on; use Clone
+// to keep a record.
+type Record struct {
+	Timestamp uint64
+	Count     uint64
+	PID       uint32
+	TID       uint32
+	FD        uint32
+	Comm      []byte
+	Data      []byte
+}
+
+// Record returns a view of e as a Record. Data is the captured payload.
+func (e *WriteEvent) Record() Record {
+	return Record{
+		Timestamp: e.Timestamp,
+		Count:     e.Count,
+		PID:       e.PID,
+		TID:       e.TID,
+		FD:        e.FD,
+		Comm:      e.CommBytes(),
+		Data:      e.DataBytes(),
+	}
+}
+
+// Clone returns a copy of r that owns its Comm and Data.
+func (r *Record) Clone() Record {
+	c := *r
+	c.Comm = append([]byte(nil), r.Comm...)
+	c.Data = append([]byte(nil), r.Data...)
+	return c
+}
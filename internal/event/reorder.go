@@ -0,0 +1,164 @@
+package event
+
+import "time"
+
+// Reorder is a bounded reorder buffer that releases events in kernel
+// timestamp order. Events are held in a min-heap until they fall behind the
+// watermark, which trails the newest timestamp seen by the configured window.
+// While no new events arrive the watermark keeps moving with wall-clock time,
+// so a quiet pipeline still drains within one window.
+//
+// Held events are copied into a slab of limit events, so the batches they
+// arrived in go back to the pool at once and the buffer never takes more
+// than limit * Size bytes. Events arriving behind an event that was already
+// emitted are late; they are emitted immediately and counted. When limit
+// events are buffered the oldest is emitted early, which bounds memory at
+// the cost of ordering under extreme skew.
+type Reorder struct {
+	window  uint64
+	limit   int
+	slots   []WriteEvent // copies of the held events
+	free    []int32      // unused slots
+	heap    []int32      // held slots, a min-heap by timestamp
+	maxTS   uint64       // newest timestamp seen
+	maxTSAt time.Time    // wall-clock time maxTS was seen
+	lastTS  uint64       // timestamp of the last emitted event
+	late    uint64
+}
+
+// NewReorder creates a reorder buffer holding events for up to window behind
+// the newest one, and at most limit events. The slab is allocated up front;
+// its pages are only touched as events are held.
+func NewReorder(window time.Duration, limit int) *Reorder {
+	limit = max(limit, 1)
+	r := &Reorder{
+		window: uint64(window),
+		limit:  limit,
+		slots:  make([]WriteEvent, limit),
+		free:   make([]int32, limit),
+		heap:   make([]int32, 0, limit),
+	}
+	for i := range r.free {
+		r.free[i] = int32(limit - 1 - i)
+	}
+	return r
+}
+
+// Push adds a copy of ev and emits any event that the memory bound forces
+// out. ev is not retained. emit must not retain the event it is passed after
+// it returns.
+func (r *Reorder) Push(ev *WriteEvent, now time.Time, emit func(*WriteEvent)) {
+	if ev.Timestamp < r.lastTS {
+		r.late++
+		emit(ev)
+		return
+	}
+	if ev.Timestamp > r.maxTS {
+		r.maxTS = ev.Timestamp
+		r.maxTSAt = now
+	}
+
+	if len(r.heap) == r.limit {
+		// Full: the older of ev and the oldest held event goes out early.
+		if ev.Timestamp <= r.slots[r.heap[0]].Timestamp {
+			r.lastTS = ev.Timestamp
+			emit(ev)
+			return
+		}
+		r.pop(emit)
+	}
+
+	slot := r.free[len(r.free)-1]
+	r.free = r.free[:len(r.free)-1]
+	r.slots[slot] = *ev
+	r.heap = append(r.heap, slot)
+	r.up(len(r.heap) - 1)
+}
+
+// Advance emits, in timestamp order, every buffered event that has fallen
+// behind the watermark at wall-clock time now.
+func (r *Reorder) Advance(now time.Time, emit func(*WriteEvent)) {
+	if len(r.heap) == 0 {
+		return
+	}
+
+	// Estimate the current kernel time from the newest event and the
+	// wall-clock time elapsed since it was seen.
+	kernelNow := r.maxTS + uint64(max(now.Sub(r.maxTSAt), 0))
+	if kernelNow < r.window {
+		return
+	}
+	watermark := kernelNow - r.window
+	for len(r.heap) > 0 && r.slots[r.heap[0]].Timestamp <= watermark {
+		r.pop(emit)
+	}
+}
+
+// Flush emits every buffered event in timestamp order.
+func (r *Reorder) Flush(emit func(*WriteEvent)) {
+	for len(r.heap) > 0 {
+		r.pop(emit)
+	}
+}
+
+// Len returns the number of buffered events.
+func (r *Reorder) Len() int {
+	return len(r.heap)
+}
+
+// Late returns the number of late events seen so far and resets the count.
+func (r *Reorder) Late() uint64 {
+	n := r.late
+	r.late = 0
+	return n
+}
+
+func (r *Reorder) pop(emit func(*WriteEvent)) {
+	slot := r.heap[0]
+	last := len(r.heap) - 1
+	r.heap[0] = r.heap[last]
+	r.heap = r.heap[:last]
+	if last > 0 {
+		r.down(0)
+	}
+
+	ev := &r.slots[slot]
+	r.lastTS = ev.Timestamp
+	emit(ev)
+	r.free = append(r.free, slot)
+}
+
+func (r *Reorder) less(i, j int) bool {
+	return r.slots[r.heap[i]].Timestamp < r.slots[r.heap[j]].Timestamp
+}
+
+func (r *Reorder) up(i int) {
+	h := r.heap
+	for i > 0 {
+		parent := (i - 1) / 2
+		if !r.less(i, parent) {
+			break
+		}
+		h[parent], h[i] = h[i], h[parent]
+		i = parent
+	}
+}
+
+func (r *Reorder) down(i int) {
+	h := r.heap
+	n := len(h)
+	for {
+		least := i
+		if l := 2*i + 1; l < n && r.less(l, least) {
+			least = l
+		}
+		if rt := 2*i + 2; rt < n && r.less(rt, least) {
+			least = rt
+		}
+		if least == i {
+			return
+		}
+		h[i], h[least] = h[least], h[i]
+		i = least
+	}
+}
@@ -0,0 +1,94 @@
+package event
+
+import (
+	"math/rand"
+	"sort"
+	"testing"
+	"time"
+)
+
+// pushTestBatch pushes a batch of n events, base plus up to jitter
+// nanoseconds each, and returns their timestamps.
+func pushTestBatch(t *testing.T, r *Reorder, rng *rand.Rand, base uint64, n, jitter int, now time.Time, emit func(*WriteEvent)) []uint64 {
+	t.Helper()
+	b := NewBatch()
+	ts := make([]uint64, n)
+	for i := range ts {
+		ts[i] = base + uint64(rng.Intn(jitter))
+		b.Add(&WriteEvent{Timestamp: ts[i]})
+	}
+	for i := range b.Events {
+		r.Push(&b.Events[i], now, emit)
+	}
+	// Held events are copies: the batch is not retained.
+	if refs := b.refs.Load(); refs != 1 {
+		t.Fatalf("batch has %d references after Push, want 1", refs)
+	}
+	b.Release()
+	return ts
+}
+
+func TestReorder(t *testing.T) {
+	r := NewReorder(time.Millisecond, 1<<16)
+	var out []uint64
+	emit := func(e *WriteEvent) { out = append(out, e.Timestamp) }
+	rng := rand.New(rand.NewSource(1))
+
+	// Batches 100us apart with up to 500us of jitter, within the window.
+	now := time.Unix(100, 0)
+	in := 0
+	for i := 0; i < 200; i++ {
+		in += len(pushTestBatch(t, r, rng, 1e9+uint64(i)*100_000, 100, 500_000, now, emit))
+		r.Advance(now, emit)
+		now = now.Add(100 * time.Microsecond)
+	}
+	if len(out) == 0 {
+		t.Fatal("Advance emitted nothing")
+	}
+	// A quiet pipeline drains within one window.
+	r.Advance(now.Add(2*time.Millisecond), emit)
+	if r.Len() != 0 {
+		t.Fatalf("%d events held after the window", r.Len())
+	}
+	if len(out) != in || !sort.SliceIsSorted(out, func(i, j int) bool { return out[i] < out[j] }) {
+		t.Fatalf("emitted %d of %d events, sorted %v", len(out), in, sort.SliceIsSorted(out, func(i, j int) bool { return out[i] < out[j] }))
+	}
+	if late := r.Late(); late != 0 {
+		t.Errorf("%d late events", late)
+	}
+}
+
+func TestReorderLimit(t *testing.T) {
+	const limit = 64
+	r := NewReorder(time.Hour, limit)
+	var out []uint64
+	emit := func(e *WriteEvent) { out = append(out, e.Timestamp) }
+	rng := rand.New(rand.NewSource(1))
+
+	now := time.Unix(100, 0)
+	in := 0
+	for i := 0; i < 100; i++ {
+		in += len(pushTestBatch(t, r, rng, uint64(i)*1000, BatchSize, 100, now, emit))
+		if r.Len() > limit {
+			t.Fatalf("%d events held, limit %d", r.Len(), limit)
+		}
+	}
+	r.Flush(emit)
+
+	// Events are forced out oldest first; the rest are late.
+	late := r.Late()
+	if uint64(len(out)) != uint64(in) {
+		t.Fatalf("emitted %d of %d events", len(out), in)
+	}
+	last := uint64(0)
+	for _, ts := range out {
+		if ts < last {
+			late--
+		} else {
+			last = ts
+		}
+	}
+	if late != 0 {
+		t.Errorf("late count off by %d", late)
+	}
+}
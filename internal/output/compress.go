@@ -0,0 +1,50 @@
+package output
+
+import (
+	"compress/gzip"
+	"fmt"
+	"io"
+
+	"write-tracer/internal/config"
+
+	"github.com/klauspost/compress/zstd"
+)
+
+// compressWriter is a streaming encoder. Close ends the stream (a gzip member
+// or a zstd frame) without closing the underlying writer, and Reset starts a
+// new stream on another writer.
+type compressWriter interface {
+	io.Writer
+	Flush() error
+	Close() error
+	Reset(io.Writer)
+}
+
+// newCompressWriter creates the encoder for a config.FileCompression value
+// and returns the file extension of its output. level 0 selects the
+// encoder's default level; otherwise it is a gzip (1-9) or zstd (1-22) level.
+func newCompressWriter(compression string, level int) (compressWriter, string, error) {
+	switch compression {
+	case config.FileCompressionGzip:
+		if level == 0 {
+			level = gzip.DefaultCompression
+		}
+		zw, err := gzip.NewWriterLevel(io.Discard, level)
+		if err != nil {
+			return nil, "", fmt.Errorf("invalid gzip level: %w", err)
+		}
+		return zw, ".gz", nil
+	case config.FileCompressionZstd:
+		opts := []zstd.EOption{zstd.WithEncoderConcurrency(1)}
+		if level != 0 {
+			opts = append(opts, zstd.WithEncoderLevel(zstd.EncoderLevelFromZstd(level)))
+		}
+		zw, err := zstd.NewWriter(io.Discard, opts...)
+		if err != nil {
+			return nil, "", fmt.Errorf("failed to create zstd encoder: %w", err)
+		}
+		return zw, ".zst", nil
+	default:
+		return nil, "", fmt.Errorf("unknown file compression %q", compression)
+	}
+}
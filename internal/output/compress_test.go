@@ -0,0 +1,96 @@
+package output
+
+import (
+	"fmt"
+	"math/rand"
+	"testing"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+)
+
+// testLogPayload returns about n bytes of JSON lines as the file sink writes
+// them, from a few processes logging training progress, warnings and stack
+// traces with varying numbers.
+func testLogPayload(n int) []byte {
+	r := rand.New(rand.NewSource(1))
+	comms := []string{"python", "mpi_rank", "torchrun", "nccl-watchdog"}
+	var buf []byte
+	for ts := uint64(1_700_000_000_000_000_000); len(buf) < n; ts += uint64(r.Intn(50_000)) {
+		var data string
+		switch k := r.Intn(10); {
+		case k < 6:
+			data = fmt.Sprintf("epoch %d step %d loss=%.4f lr=%.2e grad_norm=%.3f tokens/s=%d",
+				r.Intn(10), r.Intn(100000), r.Float64(), r.Float64()/1000, r.Float64()*10, r.Intn(500000))
+		case k < 8:
+			data = fmt.Sprintf("[rank%d] allreduce of %d bytes took %d us", r.Intn(64), r.Intn(1<<26), r.Intn(100000))
+		case k < 9:
+			data = fmt.Sprintf("WARNING: dataloader worker %d slow, queue depth %d", r.Intn(16), r.Intn(8))
+		default:
+			data = fmt.Sprintf("  File \"/opt/app/train.py\", line %d, in forward\n    out = self.block%d(x)", r.Intn(2000), r.Intn(48))
+		}
+		pid := uint32(1000 + r.Intn(8))
+		rec := event.Record{
+			Timestamp: ts,
+			Count:     uint64(len(data)),
+			PID:       pid,
+			TID:       pid + uint32(r.Intn(4)),
+			FD:        uint32(1 + r.Intn(2)),
+			Comm:      []byte(comms[pid%uint32(len(comms))]),
+			Data:      []byte(data),
+		}
+		buf = append(rec.AppendJSON(buf), '\n')
+	}
+	return buf
+}
+
+type countWriter int64
+
+func (c *countWriter) Write(p []byte) (int, error) {
+	*c += countWriter(len(p))
+	return len(p), nil
+}
+
+// BenchmarkCompress reports throughput and compression ratio of the file
+// sink encoders on log payloads, written in chunk-sized pieces as the
+// FileWriter does.
+func BenchmarkCompress(b *testing.B) {
+	const chunk = 64 << 10
+	payload := testLogPayload(8 << 20)
+
+	codecs := []struct {
+		compression string
+		levels      []int
+	}{
+		{config.FileCompressionGzip, []int{1, 6, 9}},
+		{config.FileCompressionZstd, []int{1, 3, 7, 11}},
+	}
+	for _, c := range codecs {
+		for _, level := range c.levels {
+			b.Run(fmt.Sprintf("%s-%d", c.compression, level), func(b *testing.B) {
+				zw, _, err := newCompressWriter(c.compression, level)
+				if err != nil {
+					b.Fatal(err)
+				}
+				b.ReportAllocs()
+				b.SetBytes(int64(len(payload)))
+				var out countWriter
+				for i := 0; i < b.N; i++ {
+					out = 0
+					zw.Reset(&out)
+					for p := payload; len(p) > 0; {
+						n := min(len(p), chunk)
+						if _, err := zw.Write(p[:n]); err != nil {
+							b.Fatal(err)
+						}
+						p = p[n:]
+					}
+					if err := zw.Close(); err != nil {
+						b.Fatal(err)
+					}
+				}
+				b.ReportMetric(float64(len(payload))/float64(out), "ratio")
+			})
+		}
+	}
+}
@@ -0,0 +1,426 @@
+package output
+
+import (
+	"bufio"
+	"container/list"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io/fs"
+	"log/slog"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+	"time"
+
+	"write-tracer/internal/event"
+)
+
+// streamBufferSize is the write buffer of each open stream file.
+const streamBufferSize = 64 << 10
+
+// rawIndexExt is the suffix of the binary timestamp index of a raw segment,
+// distinct from the JSON tracefile.IndexExt sidecars of the file output.
+const rawIndexExt = ".tsidx"
+
+// indexEntrySize is the size of one timestamp index entry.
+const indexEntrySize = 16
+
+// streamFiles is a directory of rotating output files, one per stream. Every
+// stream rotates and retains its sequence-numbered segments on its own, on
+// the same policy as FileWriter. Only the most recently written streams keep
+// an open file and write buffer: beyond maxOpen, the least recently written
+// one is flushed and closed, then reopened in append mode on its next
+// record. Thousands of streams thus need neither thousands of file
+// descriptors nor an open per record.
+type streamFiles struct {
+	mu         sync.Mutex
+	sink       string
+	dir        string
+	ext        string
+	base       func(key uint64) string
+	owner      func(pid uint32) uint32
+	rotation   Rotation
+	maxOpen    int
+	indexBytes int64
+
+	streams  map[uint64]*fileStream
+	lru      *list.List               // open streams, most recently written first
+	existing map[string][]fs.DirEntry // segments of previous runs, by stream file
+	released map[string]*segmentSet   // segments of released streams, by stream file
+	free     []*bufio.Writer
+	scratch  []byte
+
+	stop chan struct{}
+	done chan struct{}
+}
+
+// fileStream is the output state of one stream. It outlives its open file,
+// so an evicted stream resumes its current segment.
+type fileStream struct {
+	owner  uint32 // registration the stream was created for
+	segs   *segmentSet
+	seq    uint64 // current segment, 0 when none
+	size   int64
+	count  int
+	opened time.Time
+	file   *os.File
+	buf    *bufio.Writer
+	elem   *list.Element // in lru while file is open
+
+	index   []byte // index entries not written to the sidecar yet
+	indexed int64  // segment offset of the last index entry, -1 if none
+}
+
+// openStreamFiles creates the stream directory of a sink. Stream files are
+// named base(key) + ext, followed by the segment sequence number; every
+// base must start with prefix + "-". owner maps the PID of the first record
+// of a stream to the registration it belongs to, for release; nil uses the
+// PID itself. With indexBytes > 0, each segment gets a timestamp index
+// sidecar with one entry every indexBytes bytes.
+func openStreamFiles(sink, dir, prefix, ext string, base func(key uint64) string, owner func(pid uint32) uint32,
+	maxOpen int, rotation Rotation, indexBytes int64) (*streamFiles, error) {
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		return nil, fmt.Errorf("failed to create %s directory: %w", sink, err)
+	}
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		return nil, fmt.Errorf("failed to scan %s directory: %w", sink, err)
+	}
+
+	// Group the files of previous runs by stream, so that each stream
+	// picks its segments up without scanning the directory again.
+	existing := make(map[string][]fs.DirEntry)
+	for _, entry := range entries {
+		name := entry.Name()
+		if i := strings.Index(name, ext+"."); i > 0 && strings.HasPrefix(name, prefix+"-") {
+			stream := name[:i+len(ext)]
+			existing[stream] = append(existing[stream], entry)
+		}
+	}
+
+	if owner == nil {
+		owner = func(pid uint32) uint32 { return pid }
+	}
+	f := &streamFiles{
+		sink:       sink,
+		dir:        dir,
+		ext:        ext,
+		base:       base,
+		owner:      owner,
+		rotation:   rotation,
+		maxOpen:    max(maxOpen, 1),
+		indexBytes: indexBytes,
+		streams:    make(map[uint64]*fileStream),
+		lru:        list.New(),
+		existing:   existing,
+		released:   make(map[string]*segmentSet),
+		stop:       make(chan struct{}),
+		done:       make(chan struct{}),
+	}
+	go f.run()
+	return f, nil
+}
+
+// writeChunk appends every record of a chunk, as encoded by encode, to the
+// file of its stream, rotating that file when it reaches a rotation limit.
+// The records of a stream whose file cannot be opened are skipped, and the
+// first such error returned once the others are written.
+func (f *streamFiles) writeChunk(c *Chunk, key func(rec *event.Record) uint64,
+	encode func(dst []byte, rec *event.Record) []byte) error {
+	f.mu.Lock()
+	defer f.mu.Unlock()
+	defer f.updateMetrics()
+
+	var openErr error
+	for i := range c.Records {
+		rec := &c.Records[i]
+		s := f.stream(key(rec), rec.PID)
+		if s.file == nil {
+			if err := f.open(s); err != nil {
+				if openErr == nil {
+					openErr = err
+				}
+				continue
+			}
+		} else {
+			f.lru.MoveToFront(s.elem)
+		}
+
+		if f.indexBytes > 0 && (s.indexed < 0 || s.size-s.indexed >= f.indexBytes) {
+			s.index = binary.LittleEndian.AppendUint64(s.index, rec.Timestamp)
+			s.index = binary.LittleEndian.AppendUint64(s.index, uint64(s.size))
+			s.indexed = s.size
+		}
+
+		f.scratch = encode(f.scratch[:0], rec)
+		n, err := s.buf.Write(f.scratch)
+		s.size += int64(n)
+		if err != nil {
+			return fmt.Errorf("failed to write %s file: %w", f.sink, err)
+		}
+
+		s.count++
+		if f.full(s) {
+			if err := f.seal(s); err != nil {
+				return err
+			}
+		}
+	}
+	return openErr
+}
+
+// release seals the current segment of the streams of registration owner
+// and closes their files. Their segment sets are kept, so that records
+// arriving after the release, from descendants still traced or still in
+// flight, continue the numbering and retention of the stream.
+func (f *streamFiles) release(owner uint32) {
+	f.mu.Lock()
+	defer f.mu.Unlock()
+
+	for key, s := range f.streams {
+		if s.owner != owner {
+			continue
+		}
+		if err := f.seal(s); err != nil {
+			slog.Warn("Failed to close stream file", "sink", f.sink, "stream", key, "error", err)
+		}
+		f.released[f.base(key)+f.ext] = s.segs
+		delete(f.streams, key)
+	}
+	f.updateMetrics()
+}
+
+// close seals every stream and closes its file.
+func (f *streamFiles) close() error {
+	close(f.stop)
+	<-f.done
+
+	f.mu.Lock()
+	defer f.mu.Unlock()
+
+	var errs []error
+	for key, s := range f.streams {
+		errs = append(errs, f.seal(s))
+		delete(f.streams, key)
+	}
+	f.updateMetrics()
+	return errors.Join(errs...)
+}
+
+// run periodically flushes the buffered streams, so idle ones do not hold
+// their records back, and rotates streams past the age limit.
+func (f *streamFiles) run() {
+	defer close(f.done)
+
+	ticker := time.NewTicker(time.Second)
+	defer ticker.Stop()
+	for {
+		select {
+		case <-f.stop:
+			return
+		case <-ticker.C:
+			f.tick()
+		}
+	}
+}
+
+func (f *streamFiles) tick() {
+	f.mu.Lock()
+	defer f.mu.Unlock()
+
+	for e := f.lru.Front(); e != nil; e = e.Next() {
+		s := e.Value.(*fileStream)
+		err := s.buf.Flush()
+		if err == nil {
+			err = f.flushIndex(s)
+		}
+		if err != nil {
+			slog.Warn("Failed to flush stream file", "path", s.file.Name(), "error", err)
+		}
+	}
+	if f.rotation.MaxAge <= 0 {
+		return
+	}
+	for key, s := range f.streams {
+		if s.seq != 0 && time.Since(s.opened) >= f.rotation.MaxAge {
+			if err := f.seal(s); err != nil {
+				slog.Warn("Failed to rotate stream file", "sink", f.sink, "stream", key, "error", err)
+			}
+		}
+	}
+	f.updateMetrics()
+}
+
+// stream returns the stream with the given key, creating it on first use
+// for a record of process pid.
+func (f *streamFiles) stream(key uint64, pid uint32) *fileStream {
+	if s, ok := f.streams[key]; ok {
+		return s
+	}
+	base := f.base(key) + f.ext
+	segs, ok := f.released[base]
+	if ok {
+		delete(f.released, base)
+	} else {
+		segs = newSegmentSet(filepath.Join(f.dir, base), "", f.rotation.MaxBackups, f.rotation.MaxTotalBytes, f.existing[base])
+		if f.indexBytes > 0 {
+			segs.sidecar = rawIndexExt
+		}
+		delete(f.existing, base)
+	}
+
+	s := &fileStream{owner: f.owner(pid), segs: segs}
+	f.streams[key] = s
+	return s
+}
+
+// open opens the file of s, starting a new segment if it has none, and
+// closes the least recently written file if maxOpen files are open.
+func (f *streamFiles) open(s *fileStream) error {
+	if f.lru.Len() >= f.maxOpen {
+		if err := f.closeFile(f.lru.Back().Value.(*fileStream)); err != nil {
+			return err
+		}
+		addStreamEvictions(f.sink, 1)
+	}
+
+	if s.seq == 0 {
+		file, seq, err := s.segs.create()
+		if err != nil {
+			return fmt.Errorf("failed to create %s file: %w", f.sink, err)
+		}
+		s.file, s.seq = file, seq
+		s.size, s.count, s.opened, s.indexed = 0, 0, time.Now(), -1
+	} else {
+		file, err := os.OpenFile(s.segs.name(s.seq), os.O_CREATE|os.O_WRONLY|os.O_APPEND, 0644)
+		if err != nil {
+			return fmt.Errorf("failed to reopen %s file: %w", f.sink, err)
+		}
+		s.file = file
+	}
+
+	if n := len(f.free); n > 0 {
+		s.buf = f.free[n-1]
+		f.free = f.free[:n-1]
+		s.buf.Reset(s.file)
+	} else {
+		s.buf = bufio.NewWriterSize(s.file, streamBufferSize)
+	}
+	s.elem = f.lru.PushFront(s)
+	return nil
+}
+
+// flushIndex appends the pending index entries of s to the sidecar of its
+// current segment.
+func (f *streamFiles) flushIndex(s *fileStream) error {
+	if len(s.index) == 0 {
+		return nil
+	}
+	idx, err := os.OpenFile(s.segs.name(s.seq)+rawIndexExt, os.O_CREATE|os.O_WRONLY|os.O_APPEND, 0644)
+	if err != nil {
+		return err
+	}
+	_, err = idx.Write(s.index)
+	if cerr := idx.Close(); err == nil {
+		err = cerr
+	}
+	s.index = s.index[:0]
+	return err
+}
+
+// closeFile flushes and closes the file of s, keeping its segment current.
+func (f *streamFiles) closeFile(s *fileStream) error {
+	if s.file == nil {
+		return nil
+	}
+	err := s.buf.Flush()
+	if cerr := s.file.Close(); err == nil {
+		err = cerr
+	}
+	if ierr := f.flushIndex(s); err == nil {
+		err = ierr
+	}
+	s.buf.Reset(nil)
+	f.free = append(f.free, s.buf)
+	f.lru.Remove(s.elem)
+	s.file, s.buf, s.elem = nil, nil, nil
+	return err
+}
+
+// seal closes the file of s and ends its current segment.
+func (f *streamFiles) seal(s *fileStream) error {
+	err := f.closeFile(s)
+	if s.seq != 0 {
+		s.segs.add(s.seq, s.size)
+		s.seq = 0
+	}
+	return err
+}
+
+func (f *streamFiles) full(s *fileStream) bool {
+	r := f.rotation
+	return (r.MaxRecords > 0 && s.count >= r.MaxRecords) ||
+		(r.MaxBytes > 0 && s.size >= r.MaxBytes) ||
+		(r.MaxAge > 0 && time.Since(s.opened) >= r.MaxAge)
+}
+
+func (f *streamFiles) updateMetrics() {
+	setStreamFiles(f.sink, len(f.streams), f.lru.Len())
+}
+
+// DemuxWriter is a sink writing the records of each stream to a JSON lines
+// file of its own under a directory. A stream is keyed by a function of the
+// record PID, such as the process itself or the registration it belongs to.
+type DemuxWriter struct {
+	files *streamFiles
+	key   func(rec *event.Record) uint64
+}
+
+// NewDemuxWriter creates a demux sink writing to <dir>/<prefix>-<key>.log
+// segments. key maps the PID of a record to its stream, and owner to the
+// registration it belongs to, whose end releases the stream; nil keys
+// streams by PID, or releases them by PID.
+func NewDemuxWriter(dir, prefix string, maxOpen int, rotation Rotation, key, owner func(pid uint32) uint32) (*DemuxWriter, error) {
+	if key == nil {
+		key = func(pid uint32) uint32 { return pid }
+	}
+	base := func(k uint64) string { return fmt.Sprintf("%s-%d", prefix, k) }
+	files, err := openStreamFiles("demux", dir, prefix, ".log", base, owner, maxOpen, rotation, 0)
+	if err != nil {
+		return nil, err
+	}
+	return &DemuxWriter{
+		files: files,
+		key:   func(rec *event.Record) uint64 { return uint64(key(rec.PID)) },
+	}, nil
+}
+
+// Name implements Sink.
+func (w *DemuxWriter) Name() string {
+	return "demux"
+}
+
+// Write appends every record of a chunk to the file of its stream.
+func (w *DemuxWriter) Write(c *Chunk) error {
+	return w.files.writeChunk(c, w.key, appendJSONLine)
+}
+
+// Release seals the current segment of the streams of registration owner,
+// including those of its descendants, and closes their files. Later records
+// of these streams start a new segment. It is called when a registration
+// ends.
+func (w *DemuxWriter) Release(owner uint32) {
+	w.files.release(owner)
+}
+
+// Close seals every stream and closes its file.
+func (w *DemuxWriter) Close() error {
+	return w.files.close()
+}
+
+func appendJSONLine(dst []byte, rec *event.Record) []byte {
+	dst = rec.AppendJSON(dst)
+	return append(dst, '\n')
+}
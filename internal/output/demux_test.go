@@ -0,0 +1,130 @@
+package output
+
+import (
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"testing"
+
+	"write-tracer/internal/event"
+)
+
+// streamSink is a sink whose streams are released by registration.
+type streamSink interface {
+	Sink
+	Release(owner uint32)
+}
+
+// testStreamSinks creates the sinks built on streamFiles, in dir.
+var testStreamSinks = []struct {
+	name    string
+	prefix  string // file name prefix of the stream of pid 1, fd 1
+	newSink func(dir string, rotation Rotation) (streamSink, error)
+}{
+	{"demux", "demux-1.log.", func(dir string, rotation Rotation) (streamSink, error) {
+		return NewDemuxWriter(dir, "demux", 4, rotation, nil, nil)
+	}},
+	{"raw", "pid-1-fd-1.raw.", func(dir string, rotation Rotation) (streamSink, error) {
+		return NewRawWriter(dir, 4, rotation, 1, nil)
+	}},
+}
+
+// testStreamFiles returns the segment files in dir, leaving out sidecars and
+// anything but regular files, and the contents of each.
+func testStreamFiles(t *testing.T, dir string) ([]string, map[string]string) {
+	t.Helper()
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var names []string
+	contents := make(map[string]string)
+	for _, e := range entries {
+		if !e.Type().IsRegular() || strings.HasSuffix(e.Name(), rawIndexExt) {
+			continue
+		}
+		b, err := os.ReadFile(filepath.Join(dir, e.Name()))
+		if err != nil {
+			t.Fatal(err)
+		}
+		names = append(names, e.Name())
+		contents[e.Name()] = string(b)
+	}
+	sort.Strings(names)
+	return names, contents
+}
+
+func testStreamChunk(pids ...uint32) *Chunk {
+	c := NewChunk()
+	for _, pid := range pids {
+		c.Add(&event.Record{PID: pid, TID: pid, FD: 1, Comm: []byte("x"), Data: []byte("line\n")})
+	}
+	return c
+}
+
+func TestStreamWriteAfterRelease(t *testing.T) {
+	for _, sink := range testStreamSinks {
+		t.Run(sink.name, func(t *testing.T) {
+			dir := t.TempDir()
+			w, err := sink.newSink(dir, Rotation{MaxBackups: 1})
+			if err != nil {
+				t.Fatal(err)
+			}
+			// A record in flight, or of a descendant still traced, arrives
+			// after the registration was released.
+			for i := 0; i < 3; i++ {
+				if err := w.Write(testStreamChunk(1)); err != nil {
+					t.Fatalf("write %d: %v", i, err)
+				}
+				w.Release(1)
+			}
+			if err := w.Close(); err != nil {
+				t.Fatal(err)
+			}
+
+			// The stream continues its numbering, and retention still
+			// covers the segments written before the release.
+			names, contents := testStreamFiles(t, dir)
+			want := sink.prefix + "00000003"
+			if len(names) != 1 || names[0] != want {
+				t.Fatalf("segments = %v, want [%s]", names, want)
+			}
+			if contents[want] == "" {
+				t.Errorf("%s is empty", want)
+			}
+		})
+	}
+}
+
+func TestStreamOpenFailure(t *testing.T) {
+	for _, sink := range testStreamSinks {
+		t.Run(sink.name, func(t *testing.T) {
+			dir := t.TempDir()
+			// A directory in the way of the first segment of pid 1.
+			if err := os.Mkdir(filepath.Join(dir, sink.prefix+"00000001"), 0755); err != nil {
+				t.Fatal(err)
+			}
+			w, err := sink.newSink(dir, Rotation{})
+			if err != nil {
+				t.Fatal(err)
+			}
+			if err := w.Write(testStreamChunk(1, 2, 1, 2)); err == nil {
+				t.Error("Write succeeded with a stream that cannot be opened")
+			}
+			if err := w.Close(); err != nil {
+				t.Fatal(err)
+			}
+
+			// The other stream got all its records.
+			names, contents := testStreamFiles(t, dir)
+			other := strings.Replace(sink.prefix, "-1", "-2", 1) + "00000001"
+			if len(names) != 1 || names[0] != other {
+				t.Fatalf("segments = %v, want [%s]", names, other)
+			}
+			if got := strings.Count(contents[other], "line"); got != 2 {
+				t.Errorf("%s holds %d records, want 2", other, got)
+			}
+		})
+	}
+}
@@ -1,134 +1,519 @@
 package output
 
 import (
+	"errors"
 	"fmt"
+	"log/slog"
 	"os"
 	"path/filepath"
-	"sort"
-	"strconv"
 	"strings"
+	"sync"
+	"time"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+	"write-tracer/internal/tracefile"
+
+	"golang.org/x/sys/unix"
+)
+
+const (
+	// fileBufferSize is the group commit buffer of a FileWriter, a multiple
+	// of the page size. A full buffer is written with a single write(2).
+	fileBufferSize = 1 << 20
+	// fileQueueDepth is the number of chunks queued for the writer goroutine.
+	fileQueueDepth = 16
+	// fileFlushInterval bounds how long compressed output may sit in the
+	// encoder once the input goes idle.
+	fileFlushInterval = time.Second
 )
 
+// Rotation is the rotation and retention policy of a file sink.
+type Rotation struct {
+	MaxRecords    int           // rotate after this many records, 0 for no limit
+	MaxBytes      int64         // rotate once a file reaches this size, 0 for no limit
+	MaxAge        time.Duration // rotate files older than this, 0 for no limit
+	MaxBackups    int           // rotated files to keep, 0 for no limit
+	MaxTotalBytes int64         // total size of rotated files to keep, 0 for no limit
+}
+
+// FileOptions configures a FileWriter.
+type FileOptions struct {
+	Rotation
+	Format           string // config.FileFormat value
+	Compression      string // config.FileCompression value
+	CompressionLevel int
+	Sync             string        // config.FileSync value
+	SyncInterval     time.Duration // for config.FileSyncInterval
+	Preallocate      int64         // fallocate(2) step in bytes, 0 to disable
+
+	// Background zstd compression of rotated segments, at CompressionLevel,
+	// for uncompressed output only.
+	CompressRotated bool
+	CompressWorkers int // concurrent segments
+	CompressThreads int // encoder threads per segment
+
+	// Index sidecar written for every segment when it is closed, with a
+	// checkpoint every IndexInterval bytes of uncompressed output.
+	Index         bool
+	IndexInterval int64
+}
+
+// FileWriter is a rotating file sink. Write encodes a chunk and queues a copy
+// of it; a dedicated writer goroutine owns the file and group-commits: it
+// takes every queued chunk, runs it through the optional compressor into a
+// page-aligned buffer, and issues one write(2) per group or per full buffer.
+// Durability follows the sync policy, and file space is reserved ahead of the
+// writes with fallocate(2) to limit fragmentation.
+//
+// Output goes to sequence-numbered segments (see segmentSet), rotated by
+// record count, size or age, and retained by count and total size.
 type FileWriter struct {
-	path       string
-	maxRecords int
-	maxBackups int
-	file       *os.File
-	count      int
+	// Front end, used by Write under mu.
+	mu   sync.Mutex
+	path string
+	enc  *tracefile.Encoder // nil for JSON lines
+	buf  []byte             // encoded block, reused
+
+	ops     chan fileOp
+	free    chan []byte   // recycled chunk copies
+	freeIDs chan []uint32 // recycled fileOp.ids
+	done    chan struct{}
+
+	errMu sync.Mutex
+	err   error // first writer goroutine error not yet returned by Write
+
+	// Back end, owned by the writer goroutine.
+	segs         *segmentSet
+	rotated      *rotatedCompressor      // nil unless rotated segments are compressed
+	index        *tracefile.IndexBuilder // nil unless segments are indexed
+	maxRecords   int
+	maxBytes     int64
+	maxAge       time.Duration
+	file         *os.File
+	seq          uint64         // segment of file
+	opened       time.Time      // when file was created
+	records      int            // records in file
+	zw           compressWriter // nil without compression
+	pending      []byte         // group commit buffer
+	size         int64          // bytes written to the current file
+	logical      int64          // bytes of output in the current file, before compression
+	allocated    int64          // end of the preallocated range
+	preallocate  int64
+	sync         string
+	syncInterval time.Duration
+	unsynced     bool // data written since the last fsync
+	encoded      bool // data in zw since its last flush
 }
 
-func NewFileWriter(path string, maxRecords int, maxBackups int) *FileWriter {
-	return &FileWriter{
-		path:       path,
-		maxRecords: maxRecords,
-		maxBackups: maxBackups,
-	}
+// fileOp is one unit of work for the writer goroutine. The timestamp range
+// and ids, (pid, tid, fd) triplets, are only filled in for the index.
+type fileOp struct {
+	data         []byte
+	records      int
+	minTS, maxTS uint64
+	ids          []uint32
 }
 
-func (w *FileWriter) Write(line string) error {
-	if w.path == "" {
-		return nil
+// NewFileWriter creates a rotating file sink and starts its writer
+// goroutine. Binary files hold tracefile blocks, one per chunk, and are
+// turned back into JSON with "write-tracer decode". Compressed files get the
+// matching extension and each file is a complete stream.
+func NewFileWriter(path string, opts FileOptions) (*FileWriter, error) {
+	w := &FileWriter{
+		path:         path,
+		maxRecords:   opts.MaxRecords,
+		maxBytes:     opts.MaxBytes,
+		maxAge:       opts.MaxAge,
+		ops:          make(chan fileOp, fileQueueDepth),
+		free:         make(chan []byte, fileQueueDepth+1),
+		freeIDs:      make(chan []uint32, fileQueueDepth+1),
+		done:         make(chan struct{}),
+		pending:      make([]byte, 0, fileBufferSize),
+		preallocate:  opts.Preallocate,
+		sync:         opts.Sync,
+		syncInterval: opts.SyncInterval,
+	}
+	if opts.Format == config.FileFormatBinary {
+		host, err := os.Hostname()
+		if err != nil {
+			host = ""
+		}
+		w.enc = tracefile.NewEncoder(host)
+	}
+	// Compressed segments end with the extension of their format, after
+	// the sequence number: <path>.<seq>.zst.
+	var suffix string
+	if opts.Compression != "" && opts.Compression != config.FileCompressionNone {
+		zw, ext, err := newCompressWriter(opts.Compression, opts.CompressionLevel)
+		if err != nil {
+			return nil, err
+		}
+		w.path = strings.TrimSuffix(w.path, ext)
+		w.zw, suffix = zw, ext
 	}
 
-	if w.file == nil {
-		if err := w.open(); err != nil {
-			return err
+	segs, err := openSegmentSet(w.path, suffix, opts.MaxBackups, opts.MaxTotalBytes)
+	if err != nil {
+		return nil, err
+	}
+	segs.sidecar = tracefile.IndexExt
+	w.segs = segs
+	if opts.Index {
+		format := opts.Format
+		if format == "" {
+			format = config.FileFormatJSON
 		}
+		w.index = tracefile.NewIndexBuilder(format, opts.IndexInterval)
 	}
+	if opts.CompressRotated {
+		if w.zw != nil {
+			slog.Warn("Output is already compressed, not compressing rotated segments", "path", w.path)
+		} else {
+			w.rotated = newRotatedCompressor(segs, opts.CompressWorkers, opts.CompressThreads, opts.CompressionLevel)
+		}
+	}
+	go w.run()
+	return w, nil
+}
 
-	if _, err := fmt.Fprintln(w.file, line); err != nil {
-		return err
+// Name implements Sink.
+func (w *FileWriter) Name() string {
+	return "file"
+}
+
+// Write encodes a chunk, its shared JSON lines or one binary block in binary
+// format, and queues it for the writer goroutine, blocking while the queue is
+// full. Write returns the first error the writer goroutine hit since the
+// previous call. Write is safe for concurrent use.
+func (w *FileWriter) Write(c *Chunk) error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+
+	data := c.JSON
+	if w.enc != nil {
+		w.buf = w.enc.AppendBlock(w.buf[:0], c.Records)
+		data = w.buf
 	}
 
-	w.count++
-	if w.count >= w.maxRecords {
-		w.rotate()
+	var buf []byte
+	select {
+	case buf = <-w.free:
+	default:
+	}
+	op := fileOp{data: append(buf[:0], data...), records: c.Len()}
+	if w.index != nil {
+		w.summarize(&op, c.Records)
 	}
+	w.ops <- op
 
-	return nil
+	w.errMu.Lock()
+	defer w.errMu.Unlock()
+	err := w.err
+	w.err = nil
+	return err
 }
 
+// summarize fills in the timestamp range and ids of op for the index. Runs
+// of records from the same thread and fd are listed once.
+func (w *FileWriter) summarize(op *fileOp, recs []event.Record) {
+	select {
+	case op.ids = <-w.freeIDs:
+	default:
+	}
+	ids := op.ids[:0]
+	for i := range recs {
+		r := &recs[i]
+		if i == 0 {
+			op.minTS, op.maxTS = r.Timestamp, r.Timestamp
+		}
+		op.minTS = min(op.minTS, r.Timestamp)
+		op.maxTS = max(op.maxTS, r.Timestamp)
+		if n := len(ids); n >= 3 && ids[n-3] == r.PID && ids[n-2] == r.TID && ids[n-1] == r.FD {
+			continue
+		}
+		ids = append(ids, r.PID, r.TID, r.FD)
+	}
+	op.ids = ids
+}
+
+// Close drains the queue, then flushes, syncs (unless the sync policy is
+// none) and closes the file. Rotated segments still queued for compression
+// are left for the next start.
 func (w *FileWriter) Close() error {
-	if w.file != nil {
-		return w.file.Close()
+	w.mu.Lock()
+	defer w.mu.Unlock()
+
+	close(w.ops)
+	<-w.done
+	if w.rotated != nil {
+		w.rotated.close()
 	}
-	return nil
+
+	w.errMu.Lock()
+	defer w.errMu.Unlock()
+	return w.err
 }
 
-func (w *FileWriter) open() error {
-	// If file exists, rotate it on startup
-	if _, err := os.Stat(w.path); err == nil {
-		w.shiftBackups()
-		os.Rename(w.path, w.path+".1")
+// run is the writer goroutine.
+func (w *FileWriter) run() {
+	defer close(w.done)
+
+	var syncTick <-chan time.Time
+	if w.sync == config.FileSyncInterval {
+		ticker := time.NewTicker(w.syncInterval)
+		defer ticker.Stop()
+		syncTick = ticker.C
+	}
+	var flushTick <-chan time.Time
+	if w.zw != nil || w.maxAge > 0 {
+		ticker := time.NewTicker(fileFlushInterval)
+		defer ticker.Stop()
+		flushTick = ticker.C
 	}
 
-	f, err := os.OpenFile(w.path, os.O_APPEND|os.O_CREATE|os.O_WRONLY, 0644)
-	if err != nil {
-		return err
+	for {
+		select {
+		case op, ok := <-w.ops:
+			// Group commit: apply everything already queued, then write
+			// it with one syscall.
+			for ok {
+				w.apply(op)
+				select {
+				case op, ok = <-w.ops:
+					continue
+				default:
+				}
+				break
+			}
+			w.fail(w.commit())
+			if !ok {
+				w.fail(w.closeFile(w.sync != config.FileSyncNone))
+				return
+			}
+		case now := <-flushTick:
+			if w.file != nil && w.maxAge > 0 && now.Sub(w.opened) >= w.maxAge {
+				w.fail(w.rotate())
+			}
+			if w.encoded {
+				w.fail(w.flushEncoder())
+				w.fail(w.commit())
+			}
+		case <-syncTick:
+			if w.zw != nil && w.encoded {
+				w.fail(w.flushEncoder())
+				w.fail(w.commit())
+			}
+			if w.unsynced && w.file != nil {
+				w.fail(unix.Fdatasync(int(w.file.Fd())))
+				w.unsynced = false
+			}
+		}
 	}
-	w.file = f
-	w.count = 0
-	return nil
 }
 
-func (w *FileWriter) rotate() {
-	if w.file != nil {
-		w.file.Close()
-		w.file = nil
+// apply writes one queued chunk to the group commit buffer and rotates the
+// file once it reaches a rotation limit.
+func (w *FileWriter) apply(op fileOp) {
+	if w.file == nil {
+		if err := w.open(); err != nil {
+			w.fail(err)
+			w.recycle(op)
+			return
+		}
 	}
 
-	// Shift existing backups: .N --> .N+1, remove oldest if it exceeds maxBackups
-	w.shiftBackups()
+	if w.index != nil {
+		w.index.Add(w.logical, op.records, op.minTS, op.maxTS, op.ids)
+	}
+	w.logical += int64(len(op.data))
 
-	// Rename current file to .1
-	os.Rename(w.path, w.path+".1")
+	if w.zw != nil {
+		_, err := w.zw.Write(op.data)
+		w.fail(err)
+		w.encoded = true
+	} else {
+		w.fail(w.buffer(op.data))
+	}
+	w.recycle(op)
+	w.records += op.records
+
+	if w.full() {
+		w.fail(w.rotate())
+	}
+}
 
-	// Open new file
-	w.open()
+// full reports whether the current file reached a rotation limit. The size
+// includes the group commit buffer but not data held by the compressor.
+func (w *FileWriter) full() bool {
+	return (w.maxRecords > 0 && w.records >= w.maxRecords) ||
+		(w.maxBytes > 0 && w.size+int64(len(w.pending)) >= w.maxBytes) ||
+		(w.maxAge > 0 && time.Since(w.opened) >= w.maxAge)
 }
 
-func (w *FileWriter) shiftBackups() {
-	if w.maxBackups <= 0 {
-		// No limit (aka very large limit), persist all the backups
-		w.maxBackups = 1000
+func (w *FileWriter) recycle(op fileOp) {
+	select {
+	case w.free <- op.data:
+	default:
 	}
+	if op.ids != nil {
+		select {
+		case w.freeIDs <- op.ids:
+		default:
+		}
+	}
+}
 
-	// Find all the existing backup files
-	dir := filepath.Dir(w.path)
-	base := filepath.Base(w.path)
+// buffer appends p to the group commit buffer, writing the buffer out each
+// time it fills up. It is also the destination of the compressor.
+func (w *FileWriter) buffer(p []byte) error {
+	for len(p) > 0 {
+		n := copy(w.pending[len(w.pending):cap(w.pending)], p)
+		w.pending = w.pending[:len(w.pending)+n]
+		p = p[n:]
+		if len(w.pending) == cap(w.pending) {
+			if err := w.commit(); err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
 
-	entries, err := os.ReadDir(dir)
-	if err != nil {
+// commit writes the group commit buffer to the file.
+func (w *FileWriter) commit() error {
+	if len(w.pending) == 0 || w.file == nil {
+		return nil
+	}
+
+	w.reserve(int64(len(w.pending)))
+	n, err := w.file.Write(w.pending)
+	w.size += int64(n)
+	w.pending = w.pending[:0]
+	w.unsynced = true
+	return err
+}
+
+// reserve preallocates file space, one preallocate step at a time, so the
+// next n bytes land in an already allocated range. The space is reserved with
+// FALLOC_FL_KEEP_SIZE and released by closeFile, so readers never see it.
+func (w *FileWriter) reserve(n int64) {
+	if w.preallocate <= 0 || w.size+n <= w.allocated {
 		return
 	}
 
-	// Collect backup numbers
-	var backupNums []int
-	prefix := base + "."
-	for _, entry := range entries {
-		name := entry.Name()
-		if strings.HasPrefix(name, prefix) {
-			suffix := strings.TrimPrefix(name, prefix)
-			if num, err := strconv.Atoi(suffix); err == nil && num > 0 {
-				backupNums = append(backupNums, num)
-			}
+	end := max(w.allocated, w.size) + max(w.preallocate, n)
+	err := unix.Fallocate(int(w.file.Fd()), unix.FALLOC_FL_KEEP_SIZE, w.allocated, end-w.allocated)
+	if err != nil {
+		if errors.Is(err, unix.EOPNOTSUPP) || errors.Is(err, unix.ENOSYS) {
+			slog.Warn("File system does not support preallocation, disabling it", "path", w.path)
+			w.preallocate = 0
+			return
 		}
+		w.fail(fmt.Errorf("failed to preallocate %s: %w", w.path, err))
+		return
 	}
+	w.allocated = end
+}
 
-	// Sort in descending order
-	sort.Sort(sort.Reverse(sort.IntSlice(backupNums)))
+// flushEncoder pushes the data buffered in the compressor to the group
+// commit buffer.
+func (w *FileWriter) flushEncoder() error {
+	w.encoded = false
+	return w.zw.Flush()
+}
 
-	for _, num := range backupNums {
-		oldPath := fmt.Sprintf("%s.%d", w.path, num)
-		newNum := num + 1
+// fail records err unless an earlier error is still pending.
+func (w *FileWriter) fail(err error) {
+	if err == nil {
+		return
+	}
+	w.errMu.Lock()
+	if w.err == nil {
+		w.err = err
+	}
+	w.errMu.Unlock()
+}
 
-		if newNum > w.maxBackups {
-			// Remove files that exceed the limit
-			os.Remove(oldPath)
-		} else {
-			// Shift file
-			newPath := fmt.Sprintf("%s.%d", w.path, newNum)
-			os.Rename(oldPath, newPath)
-		}
+// open creates the next segment.
+func (w *FileWriter) open() error {
+	f, seq, err := w.segs.create()
+	if err != nil {
+		return err
+	}
+	w.file, w.seq, w.opened = f, seq, time.Now()
+	w.size, w.allocated, w.records, w.logical = 0, 0, 0, 0
+	if w.zw != nil {
+		w.zw.Reset(groupWriter{w})
+	}
+	return nil
+}
+
+// closeFile ends the compressed stream, writes the pending data, releases
+// the unused preallocated space, optionally fsyncs, and closes the file. The
+// index sidecar, if any, is written last, so an index never describes more
+// than the segment holds.
+func (w *FileWriter) closeFile(sync bool) error {
+	if w.file == nil {
+		return nil
+	}
+
+	var errs []error
+	if w.zw != nil {
+		errs = append(errs, w.zw.Close())
+		w.encoded = false
+	}
+	errs = append(errs, w.commit())
+	if w.allocated > w.size {
+		errs = append(errs, unix.Ftruncate(int(w.file.Fd()), w.size))
+	}
+	if sync {
+		errs = append(errs, w.file.Sync())
+	}
+	errs = append(errs, w.file.Close())
+	if w.index != nil && w.index.Len() > 0 {
+		idx := w.index.Finish(w.logical)
+		errs = append(errs, tracefile.WriteIndex(w.segs.stem(w.seq)+tracefile.IndexExt, idx))
+		w.index.Reset()
+	}
+	w.segs.add(w.seq, w.size)
+	if w.rotated != nil {
+		w.rotated.submit(w.seq)
+	}
+	w.file = nil
+	w.unsynced = false
+	return errors.Join(errs...)
+}
+
+// rotate closes the current segment, syncing it (and the directory) unless
+// the sync policy is none. The next segment is created by the next write.
+func (w *FileWriter) rotate() error {
+	sync := w.sync != config.FileSyncNone
+	err := w.closeFile(sync)
+	if sync {
+		err = errors.Join(err, syncDir(filepath.Dir(w.path)))
+	}
+	return err
+}
+
+// syncDir makes renames in dir durable.
+func syncDir(dir string) error {
+	d, err := os.Open(dir)
+	if err != nil {
+		return err
+	}
+	defer d.Close()
+	return d.Sync()
+}
+
+// groupWriter feeds compressor output into the group commit buffer.
+type groupWriter struct {
+	w *FileWriter
+}
+
+func (g groupWriter) Write(p []byte) (int, error) {
+	if err := g.w.buffer(p); err != nil {
+		return 0, err
 	}
+	return len(p), nil
 }
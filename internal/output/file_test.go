@@ -0,0 +1,80 @@
+package output
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"sort"
+	"testing"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+)
+
+func TestFileCompressedSegmentNames(t *testing.T) {
+	tests := []struct {
+		compression string
+		path        string
+		want        []string
+	}{
+		{config.FileCompressionNone, "t.log", []string{"t.log.00000001", "t.log.00000002"}},
+		{config.FileCompressionGzip, "t.log", []string{"t.log.00000001.gz", "t.log.00000002.gz"}},
+		{config.FileCompressionZstd, "t.log", []string{"t.log.00000001.zst", "t.log.00000002.zst"}},
+		// An extension given with the path is not repeated.
+		{config.FileCompressionZstd, "t.log.zst", []string{"t.log.00000001.zst", "t.log.00000002.zst"}},
+	}
+	for _, tt := range tests {
+		t.Run(tt.compression+"/"+tt.path, func(t *testing.T) {
+			dir := t.TempDir()
+			opts := FileOptions{
+				Rotation:    Rotation{MaxRecords: 10},
+				Format:      config.FileFormatJSON,
+				Compression: tt.compression,
+				Index:       true,
+			}
+			write := func() {
+				w, err := NewFileWriter(filepath.Join(dir, tt.path), opts)
+				if err != nil {
+					t.Fatal(err)
+				}
+				c := NewChunk()
+				for i := 0; i < 10; i++ {
+					c.Add(&event.Record{Timestamp: uint64(i), PID: 1, Comm: []byte("x"), Data: []byte("line")})
+				}
+				if err := w.Write(c); err != nil {
+					t.Fatal(err)
+				}
+				if err := w.Close(); err != nil {
+					t.Fatal(err)
+				}
+			}
+			// The second run picks the segments of the first up and
+			// continues their numbering.
+			write()
+			write()
+
+			var segments []string
+			entries, _ := os.ReadDir(dir)
+			for _, e := range entries {
+				if filepath.Ext(e.Name()) != ".idx" {
+					segments = append(segments, e.Name())
+				}
+			}
+			sort.Strings(segments)
+			if len(segments) != len(tt.want) {
+				t.Fatalf("segments = %v, want %v", segments, tt.want)
+			}
+			for i, name := range segments {
+				if name != tt.want[i] {
+					t.Fatalf("segments = %v, want %v", segments, tt.want)
+				}
+				// Sidecars are named after the segment without its
+				// extension.
+				stem := filepath.Join(dir, fmt.Sprintf("t.log.%08d", i+1))
+				if _, err := os.Stat(stem + ".idx"); err != nil {
+					t.Error(err)
+				}
+			}
+		})
+	}
+}
@@ -3,17 +3,96 @@ package output
 import (
 	"bytes"
 	"encoding/json"
-	"fmt"
 	"io"
 	"net/http"
+	"os"
+	"strconv"
+	"sync"
 	"time"
 
-	"write-tracer/internal/event"
+	"write-tracer/internal/config"
+
+	"github.com/klauspost/compress/s2"
+)
+
+const (
+	// lokiEntryOverhead approximates the bytes an entry adds to a push
+	// request besides its line, for batch sizing.
+	lokiEntryOverhead = 32
+	// maxLokiLabels bounds the label set and registration caches; they are
+	// reset when full.
+	maxLokiLabels = 4096
+
+	// lokiRetries is the number of attempts per batch without a spool.
+	lokiRetries = 3
+
+	lokiJSONContentType     = "application/json"
+	lokiProtobufContentType = "application/x-protobuf"
 )
 
+// LokiOptions configures a LokiClient.
+type LokiOptions struct {
+	BatchBytes int           // flush a batch once its entries reach this size
+	BatchWait  time.Duration // flush a non-empty batch at least this often
+	Workers    int           // concurrent push requests
+	Encoding   string        // config.LokiEncoding value
+
+	// Write-ahead spool for requests Loki could not take, disabled when
+	// SpoolDir is empty.
+	SpoolDir      string
+	SpoolMaxBytes int64
+
+	// Stream labels and per entry metadata. Metadata goes to structured
+	// metadata, or to a logfmt prefix of the line with MetadataInLine.
+	Labels         []config.LabelTemplate
+	Metadata       []config.LabelTemplate
+	MetadataInLine bool
+
+	// Registration lookups for templates referring to {registration} or to
+	// registration labels; either may be nil.
+	Owner              func(pid uint32) (uint32, bool)
+	RegistrationLabels func(owner uint32) map[string]string
+}
+
+// LokiClient is a sink pushing records to Loki. Records are accumulated in
+// a batch, one stream per label set, across chunks; a batch is flushed once
+// it reaches BatchBytes or is BatchWait old. A fixed pool of workers pushes
+// the flushed batches over keep-alive connections, so the number of
+// requests in flight never exceeds Workers. While every worker is busy,
+// Write blocks and the sink queue absorbs the backlog.
+//
+// Stream labels are rendered from templates, so that fields with many
+// values, such as the pid, can go to per entry metadata instead and leave
+// Loki with few streams, e.g. one per job and host.
+//
+// Batches are encoded by the workers, as JSON or as snappy-compressed
+// protobuf, the native format of the Loki push API. Failed pushes are
+// retried with exponential backoff: through the spool when there is one,
+// else a few times before the batch is dropped.
 type LokiClient struct {
 	endpoint string
 	client   *http.Client
+	opts     LokiOptions
+	spool    *lokiSpool // nil without SpoolDir
+
+	host           string
+	labelTemplates []lokiTemplate
+	labelFields    uint // lokiFields of labelTemplates
+	metadata       []lokiTemplate
+	needOwner      bool // templates refer to the registration
+
+	mu            sync.Mutex
+	batch         *lokiBatch
+	labels        map[lokiStreamKey]*lokiLabels
+	registrations map[uint32]map[string]string // registration labels by owner
+	scratch       []byte
+
+	batches chan *lokiBatch
+	stop    chan struct{}
+	wg      sync.WaitGroup
+
+	errMu sync.Mutex
+	err   error // first push error not yet returned by Write
 }
 
 type lokiPushRequest struct {
@@ -22,52 +101,340 @@ type lokiPushRequest struct {
 
 type lokiStream struct {
 	Stream map[string]string `json:"stream"`
-	Values [][]string        `json:"values"`
+	Values [][]any           `json:"values"`
 }
 
-func NewLokiClient(endpoint string) *LokiClient {
-	return &LokiClient{
-		endpoint: endpoint,
-		client:   &http.Client{Timeout: 5 * time.Second},
-	}
+// lokiStreamKey identifies the stream a record belongs to: the fields the
+// label templates refer to, the others zero.
+type lokiStreamKey struct {
+	owner, pid, tid, fd uint32
+	comm                [config.MaxExecNameSize]byte
+}
+
+// lokiLabels is the label set of a stream, serialized for both encodings.
+type lokiLabels struct {
+	text  string            // Prometheus text format, for protobuf
+	pairs map[string]string // for JSON
+}
+
+// lokiBatch is a push request being accumulated. Lines, and metadata
+// values, are stored back to back in one buffer each, and batches are
+// recycled once pushed.
+type lokiBatch struct {
+	streams []lokiBatchStream
+	index   map[lokiStreamKey]int
+	lines   []byte
+	meta    []byte
+	entries int
+	bytes   int
+	created time.Time
 }
 
-func (l *LokiClient) Push(ev event.WriteEvent) error {
+type lokiBatchStream struct {
+	labels  *lokiLabels
+	entries []lokiEntry
+}
 
-	stream := lokiStream{
-		Stream: map[string]string{
-			"app":  "write-tracer",
-			"pid":  fmt.Sprintf("%d", ev.PID),
-			"comm": ev.CommString(),
-			"fd":   fmt.Sprintf("%d", ev.FD),
-		},
-		Values: [][]string{
-			{fmt.Sprintf("%d", time.Now().UnixNano()), ev.DataString()},
-		},
+// lokiEntry is a line of a batch: lines[off:off+n], at ts nanoseconds, with
+// metadata values meta[metaOff:metaOff+metaN].
+type lokiEntry struct {
+	ts             int64
+	off, n         int
+	metaOff, metaN int
+}
+
+var lokiBatchPool = sync.Pool{
+	New: func() any {
+		return &lokiBatch{index: make(map[lokiStreamKey]int)}
+	},
+}
+
+func newLokiBatch() *lokiBatch {
+	b := lokiBatchPool.Get().(*lokiBatch)
+	b.created = time.Now()
+	return b
+}
+
+// release resets b and returns it to the pool.
+func (b *lokiBatch) release() {
+	for i := range b.streams {
+		b.streams[i].entries = b.streams[i].entries[:0]
 	}
+	b.streams = b.streams[:0]
+	clear(b.index)
+	b.lines = b.lines[:0]
+	b.meta = b.meta[:0]
+	b.entries, b.bytes = 0, 0
+	lokiBatchPool.Put(b)
+}
 
-	req := lokiPushRequest{Streams: []lokiStream{stream}}
-	body, err := json.Marshal(req)
+// NewLokiClient creates a Loki sink and starts its push workers, and the
+// replay of the spool if one is configured.
+func NewLokiClient(endpoint string, opts LokiOptions) (*LokiClient, error) {
+	opts.Workers = max(opts.Workers, 1)
+	transport := http.DefaultTransport.(*http.Transport).Clone()
+	transport.MaxIdleConnsPerHost = opts.Workers
+
+	host, err := os.Hostname()
 	if err != nil {
+		host = ""
+	}
+
+	l := &LokiClient{
+		endpoint:       endpoint,
+		client:         &http.Client{Timeout: 5 * time.Second, Transport: transport},
+		opts:           opts,
+		host:           host,
+		labelTemplates: compileLokiTemplates(opts.Labels),
+		metadata:       compileLokiTemplates(opts.Metadata),
+		batch:          newLokiBatch(),
+		labels:         make(map[lokiStreamKey]*lokiLabels),
+		registrations:  make(map[uint32]map[string]string),
+		batches:        make(chan *lokiBatch),
+		stop:           make(chan struct{}),
+	}
+	l.labelFields = lokiFields(l.labelTemplates)
+	registrationFields := uint(1<<lokiRegistration | 1<<lokiRegistrationLabel)
+	l.needOwner = (l.labelFields|lokiFields(l.metadata))&registrationFields != 0
+	if opts.SpoolDir != "" {
+		spool, err := openLokiSpool(opts.SpoolDir, opts.SpoolMaxBytes, l.push)
+		if err != nil {
+			return nil, err
+		}
+		l.spool = spool
+	}
+	for i := 0; i < opts.Workers; i++ {
+		l.wg.Add(1)
+		go l.worker()
+	}
+	go l.flusher()
+	return l, nil
+}
+
+// Name implements Sink.
+func (l *LokiClient) Name() string {
+	return "loki"
+}
+
+// Write adds the records of a chunk to the current batch, one stream per
+// label set, and hands the batch to the workers once it is full. Write
+// returns the first push error since the previous call.
+func (l *LokiClient) Write(c *Chunk) error {
+	// Entries keep the time of their event, so that they keep their order
+	// and Loki does not drop identical lines as duplicates.
+	offset := monotonicOffset(time.Now())
+
+	l.mu.Lock()
+	var lastPID, owner uint32
+	var regLabels map[string]string
+	for i := range c.Records {
+		rec := &c.Records[i]
+		b := l.batch
+		if l.needOwner && (i == 0 || rec.PID != lastPID) {
+			lastPID = rec.PID
+			owner, regLabels = l.registration(rec.PID)
+		}
+		src := lokiSource{rec: rec, owner: owner, labels: regLabels}
+
+		key := l.streamKey(&src)
+		n, ok := b.index[key]
+		if !ok {
+			n = len(b.streams)
+			b.index[key] = n
+			if n < cap(b.streams) {
+				b.streams = b.streams[:n+1]
+			} else {
+				b.streams = append(b.streams, lokiBatchStream{})
+			}
+			b.streams[n].labels = l.streamLabels(key, &src)
+		}
+
+		e := lokiEntry{ts: int64(rec.Timestamp + offset), off: len(b.lines)}
+		if len(l.metadata) > 0 {
+			if l.opts.MetadataInLine {
+				b.lines = l.appendLogfmt(b.lines, &src)
+			} else {
+				e.metaOff = len(b.meta)
+				b.meta = l.appendMetadata(b.meta, &src)
+				e.metaN = len(b.meta) - e.metaOff
+			}
+		}
+		b.lines = append(b.lines, bytes.TrimRight(rec.Data, "\n\r")...)
+		e.n = len(b.lines) - e.off
+
+		s := &b.streams[n]
+		s.entries = append(s.entries, e)
+		b.entries++
+		b.bytes += e.n + e.metaN + lokiEntryOverhead
+
+		if b.bytes >= l.opts.BatchBytes {
+			l.flushLocked()
+		}
+	}
+	l.mu.Unlock()
+
+	l.errMu.Lock()
+	defer l.errMu.Unlock()
+	err := l.err
+	l.err = nil
+	return err
+}
+
+// Close pushes the current batch, waits for the workers and releases idle
+// connections. Pushes are no longer retried, except through the spool on
+// the next start.
+func (l *LokiClient) Close() error {
+	close(l.stop)
+
+	l.mu.Lock()
+	l.flushLocked()
+	close(l.batches)
+	l.mu.Unlock()
+
+	l.wg.Wait()
+	if l.spool != nil {
+		l.spool.close()
+	}
+	l.client.CloseIdleConnections()
+
+	l.errMu.Lock()
+	defer l.errMu.Unlock()
+	return l.err
+}
+
+// flushLocked hands the current batch, if any, to a worker, waiting for one
+// to be free. l.mu must be held.
+func (l *LokiClient) flushLocked() {
+	if l.batch.entries == 0 {
+		return
+	}
+	l.batches <- l.batch
+	l.batch = newLokiBatch()
+}
+
+// flusher flushes batches that reached BatchWait without filling up.
+func (l *LokiClient) flusher() {
+	ticker := time.NewTicker(max(l.opts.BatchWait/4, 10*time.Millisecond))
+	defer ticker.Stop()
+	for {
+		select {
+		case <-l.stop:
+			return
+		case <-ticker.C:
+			l.mu.Lock()
+			if l.batch.entries > 0 && time.Since(l.batch.created) >= l.opts.BatchWait {
+				l.flushLocked()
+			}
+			l.mu.Unlock()
+		}
+	}
+}
+
+func (l *LokiClient) worker() {
+	defer l.wg.Done()
+
+	// Encoding buffers, reused across the batches of this worker.
+	var body, comp []byte
+	for b := range l.batches {
+		var contentType string
+		var err error
+		if l.opts.Encoding == config.LokiEncodingProtobuf {
+			body = appendLokiProto(body[:0], b, l.metadata)
+			comp = s2.EncodeSnappy(comp[:cap(comp)], body)
+			contentType = lokiProtobufContentType
+		} else {
+			comp, err = json.Marshal(b.request(l.metadata))
+			contentType = lokiJSONContentType
+		}
+
+		if err == nil {
+			observeLokiBatch(b.entries, len(comp))
+			err = l.deliver(comp, contentType)
+		}
+		b.release()
+		if err != nil {
+			l.errMu.Lock()
+			if l.err == nil {
+				l.err = err
+			}
+			l.errMu.Unlock()
+		}
+	}
+}
+
+// request returns the JSON push request of b, whose entries carry the
+// given metadata. Structured metadata is the third element of a value.
+func (b *lokiBatch) request(metadata []lokiTemplate) lokiPushRequest {
+	req := lokiPushRequest{Streams: make([]lokiStream, len(b.streams))}
+	for i := range b.streams {
+		s := &b.streams[i]
+		values := make([][]any, len(s.entries))
+		for j, e := range s.entries {
+			values[j] = []any{strconv.FormatInt(e.ts, 10), string(b.lines[e.off : e.off+e.n])}
+			if e.metaN > 0 {
+				meta := make(map[string]string, len(metadata))
+				forEachMetadata(metadata, b.meta[e.metaOff:e.metaOff+e.metaN], func(name string, value []byte) {
+					meta[name] = string(value)
+				})
+				if len(meta) > 0 {
+					values[j] = append(values[j], meta)
+				}
+			}
+		}
+		req.Streams[i] = lokiStream{Stream: s.labels.pairs, Values: values}
+	}
+	return req
+}
+
+// deliver pushes an encoded request, or spools it while the spool is
+// replaying or when the push fails and may succeed later. Without a spool,
+// retryable failures are retried with backoff up to lokiRetries attempts.
+func (l *LokiClient) deliver(body []byte, contentType string) error {
+	if l.spool != nil {
+		if !l.spool.empty() {
+			return l.spool.put(body, contentType)
+		}
+		err := l.push(body, contentType)
+		if err != nil && retryable(err) {
+			return l.spool.put(body, contentType)
+		}
 		return err
 	}
 
-	// DEBUG: Get the loki push request body
-	// slog.Info("Loki push request", "body", string(body))
+	for attempt := 1; ; attempt++ {
+		err := l.push(body, contentType)
+		if err == nil || !retryable(err) || attempt == lokiRetries {
+			return err
+		}
+		select {
+		case <-l.stop:
+			return err
+		case <-time.After(retryDelay(attempt, err)):
+		}
+	}
+}
+
+// push sends one encoded request.
+func (l *LokiClient) push(body []byte, contentType string) error {
+	start := time.Now()
+	err := l.post(body, contentType)
+	observeLokiPush(time.Since(start), err)
+	return err
+}
 
-	resp, err := l.client.Post(l.endpoint, "application/json", bytes.NewBuffer(body))
+func (l *LokiClient) post(body []byte, contentType string) error {
+	resp, err := l.client.Post(l.endpoint, contentType, bytes.NewReader(body))
 	if err != nil {
 		return err
 	}
 	defer resp.Body.Close()
 
 	if resp.StatusCode < 200 || resp.StatusCode >= 300 {
-		// DEBUG: Read response body to see what Loki is complaining about
-		respBody, _ := io.ReadAll(resp.Body)
-
-		return fmt.Errorf("loki returned status %d: %s", resp.StatusCode, string(respBody))
-		// return fmt.Errorf("loki returned status %d", resp.StatusCode)
+		respBody, _ := io.ReadAll(io.LimitReader(resp.Body, 4096))
+		return newStatusError("loki", resp, respBody)
 	}
 
+	// Drain the body so the connection goes back to the idle pool.
+	io.Copy(io.Discard, resp.Body)
 	return nil
 }
@@ -0,0 +1,355 @@
+package output
+
+import (
+	"encoding/json"
+	"fmt"
+	"io"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+
+	"github.com/klauspost/compress/s2"
+)
+
+// testLoki is a stand-in Loki push endpoint. It keeps the requests it
+// receives for the test to decode, or only counts their bytes.
+type testLoki struct {
+	srv  *httptest.Server
+	keep bool
+	down atomic.Bool // answer 503 Service Unavailable
+
+	mu       sync.Mutex
+	requests []testLokiRequest
+	calls    int
+	bytes    int64
+}
+
+type testLokiRequest struct {
+	contentType string
+	body        []byte
+}
+
+// testLokiEntry is a decoded entry, of the stream with the given labels.
+type testLokiEntry struct {
+	labels string
+	ts     int64
+	line   string
+	meta   map[string]string
+}
+
+func newTestLoki(tb testing.TB, keep bool) *testLoki {
+	s := &testLoki{keep: keep}
+	s.srv = httptest.NewServer(http.HandlerFunc(s.serve))
+	tb.Cleanup(s.srv.Close)
+	return s
+}
+
+func (s *testLoki) serve(w http.ResponseWriter, r *http.Request) {
+	body, err := io.ReadAll(r.Body)
+	if err != nil {
+		w.WriteHeader(http.StatusBadRequest)
+		return
+	}
+	s.mu.Lock()
+	s.calls++
+	if s.down.Load() {
+		s.mu.Unlock()
+		w.WriteHeader(http.StatusServiceUnavailable)
+		return
+	}
+	s.bytes += int64(len(body))
+	if s.keep {
+		s.requests = append(s.requests, testLokiRequest{r.Header.Get("Content-Type"), body})
+	}
+	s.mu.Unlock()
+	w.WriteHeader(http.StatusNoContent)
+}
+
+// entries decodes every request received so far.
+func (s *testLoki) entries(t *testing.T) []testLokiEntry {
+	t.Helper()
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	var entries []testLokiEntry
+	for _, req := range s.requests {
+		switch req.contentType {
+		case lokiJSONContentType:
+			entries = append(entries, decodeTestLokiJSON(t, req.body)...)
+		case lokiProtobufContentType:
+			body, err := s2.Decode(nil, req.body)
+			if err != nil {
+				t.Fatalf("request body is not snappy: %v", err)
+			}
+			entries = append(entries, decodeTestLokiProto(t, body)...)
+		default:
+			t.Fatalf("unexpected content type %q", req.contentType)
+		}
+	}
+	return entries
+}
+
+func decodeTestLokiJSON(t *testing.T, body []byte) []testLokiEntry {
+	var req struct {
+		Streams []struct {
+			Stream map[string]string   `json:"stream"`
+			Values [][]json.RawMessage `json:"values"`
+		} `json:"streams"`
+	}
+	if err := json.Unmarshal(body, &req); err != nil {
+		t.Fatal(err)
+	}
+	var entries []testLokiEntry
+	for _, s := range req.Streams {
+		// Render the labels as the protobuf encoding does.
+		names := make([]string, 0, len(s.Stream))
+		for name := range s.Stream {
+			names = append(names, name)
+		}
+		sort.Strings(names)
+		pairs := make([]string, len(names))
+		for i, name := range names {
+			pairs[i] = name + "=" + strconv.Quote(s.Stream[name])
+		}
+		labels := "{" + strings.Join(pairs, ", ") + "}"
+
+		for _, v := range s.Values {
+			var ts string
+			e := testLokiEntry{labels: labels}
+			if err := json.Unmarshal(v[0], &ts); err != nil {
+				t.Fatal(err)
+			}
+			e.ts, _ = strconv.ParseInt(ts, 10, 64)
+			if err := json.Unmarshal(v[1], &e.line); err != nil {
+				t.Fatal(err)
+			}
+			if len(v) > 2 {
+				if err := json.Unmarshal(v[2], &e.meta); err != nil {
+					t.Fatal(err)
+				}
+			}
+			entries = append(entries, e)
+		}
+	}
+	return entries
+}
+
+// decodeTestLokiProto decodes a logproto.PushRequest.
+func decodeTestLokiProto(t *testing.T, body []byte) []testLokiEntry {
+	var entries []testLokiEntry
+	testWalk(t, body, func(_, _ int, _ uint64, stream []byte) {
+		var labels string
+		testWalk(t, stream, func(field, _ int, _ uint64, data []byte) {
+			if field == 1 {
+				labels = string(data)
+				return
+			}
+			e := testLokiEntry{labels: labels}
+			testWalk(t, data, func(field, _ int, _ uint64, data []byte) {
+				switch field {
+				case 1:
+					testWalk(t, data, func(field, _ int, v uint64, _ []byte) {
+						if field == 1 {
+							e.ts += int64(v) * int64(time.Second)
+						} else {
+							e.ts += int64(v)
+						}
+					})
+				case 2:
+					e.line = string(data)
+				case 3:
+					var kv []string
+					testWalk(t, data, func(_, _ int, _ uint64, data []byte) {
+						kv = append(kv, string(data))
+					})
+					if e.meta == nil {
+						e.meta = make(map[string]string)
+					}
+					e.meta[kv[0]] = kv[1]
+				}
+			})
+			entries = append(entries, e)
+		})
+	})
+	return entries
+}
+
+func newTestLokiClient(tb testing.TB, endpoint string, opts LokiOptions) *LokiClient {
+	tb.Helper()
+	var err error
+	if opts.Labels, err = config.ParseLabelTemplates(config.DefaultLokiLabels); err != nil {
+		tb.Fatal(err)
+	}
+	if opts.Metadata, err = config.ParseLabelTemplates(config.DefaultLokiMetadata); err != nil {
+		tb.Fatal(err)
+	}
+	// Process 1000 belongs to job 678, the others to no registration.
+	opts.Owner = func(pid uint32) (uint32, bool) {
+		if pid == 1000 {
+			return 1000, true
+		}
+		return 0, false
+	}
+	opts.RegistrationLabels = func(owner uint32) map[string]string {
+		return map[string]string{"job": "678"}
+	}
+	l, err := NewLokiClient(endpoint, opts)
+	if err != nil {
+		tb.Fatal(err)
+	}
+	return l
+}
+
+// testLokiChunk returns n records of processes 1000 to 1003, with
+// increasing timestamps from ts.
+func testLokiChunk(ts uint64, n int) *Chunk {
+	c := NewChunk()
+	for i := 0; i < n; i++ {
+		pid := uint32(1000 + i%4)
+		c.Add(&event.Record{
+			Timestamp: ts + uint64(i),
+			PID:       pid,
+			TID:       pid,
+			FD:        1,
+			Comm:      []byte("mpi_rank"),
+			Data:      []byte(fmt.Sprintf("step %d loss=0.0312 lr=0.001 elapsed=1.2s\n", i)),
+		})
+	}
+	return c
+}
+
+func TestLokiPush(t *testing.T) {
+	host, _ := os.Hostname()
+	for _, encoding := range []string{config.LokiEncodingJSON, config.LokiEncodingProtobuf} {
+		t.Run(encoding, func(t *testing.T) {
+			s := newTestLoki(t, true)
+			l := newTestLokiClient(t, s.srv.URL, LokiOptions{
+				BatchBytes: 1 << 20,
+				BatchWait:  time.Hour,
+				Encoding:   encoding,
+			})
+			ts := monotonicNow()
+			if err := l.Write(testLokiChunk(ts, 8)); err != nil {
+				t.Fatal(err)
+			}
+			if err := l.Close(); err != nil {
+				t.Fatal(err)
+			}
+
+			entries := s.entries(t)
+			if len(entries) != 8 {
+				t.Fatalf("got %d entries, want 8", len(entries))
+			}
+			job := fmt.Sprintf(`{app="write-tracer", host=%q, job="678"}`, host)
+			other := fmt.Sprintf(`{app="write-tracer", host=%q}`, host)
+			sort.Slice(entries, func(i, j int) bool { return entries[i].ts < entries[j].ts })
+			for i, e := range entries {
+				pid := 1000 + i%4
+				want := job
+				if pid != 1000 {
+					want = other
+				}
+				if e.labels != want {
+					t.Errorf("entry %d: labels %s, want %s", i, e.labels, want)
+				}
+				if line := fmt.Sprintf("step %d loss=0.0312 lr=0.001 elapsed=1.2s", i); e.line != line {
+					t.Errorf("entry %d: line %q, want %q", i, e.line, line)
+				}
+				if e.meta["pid"] != strconv.Itoa(pid) || e.meta["comm"] != "mpi_rank" || e.meta["fd"] != "1" {
+					t.Errorf("entry %d: metadata %v", i, e.meta)
+				}
+				// Entries carry the time of their event, one nanosecond apart.
+				if i > 0 && e.ts-entries[i-1].ts != 1 {
+					t.Errorf("entry %d: %d ns after the previous one, want 1", i, e.ts-entries[i-1].ts)
+				}
+			}
+			if d := time.Since(time.Unix(0, entries[0].ts)); d < 0 || d > time.Minute {
+				t.Errorf("entry time %v off by %v", time.Unix(0, entries[0].ts), d)
+			}
+		})
+	}
+}
+
+// testLokiBatch returns a batch of n records as Write accumulates them.
+func testLokiBatch(b *testing.B, l *LokiClient, n int) *lokiBatch {
+	if err := l.Write(testLokiChunk(monotonicNow(), n)); err != nil {
+		b.Fatal(err)
+	}
+	return l.batch
+}
+
+// BenchmarkLokiEncode compares encoding a push request of the default labels
+// and metadata as JSON with protobuf and snappy, per line and in wire bytes.
+func BenchmarkLokiEncode(b *testing.B) {
+	const lines = 10000
+	s := newTestLoki(b, false)
+	l := newTestLokiClient(b, s.srv.URL, LokiOptions{BatchBytes: 1 << 30, BatchWait: time.Hour})
+	batch := testLokiBatch(b, l, lines)
+
+	b.Run(config.LokiEncodingJSON, func(b *testing.B) {
+		b.ReportAllocs()
+		var body []byte
+		for i := 0; i < b.N; i++ {
+			var err error
+			if body, err = json.Marshal(batch.request(l.metadata)); err != nil {
+				b.Fatal(err)
+			}
+		}
+		b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*lines), "ns/line")
+		b.ReportMetric(float64(len(body))/lines, "wire-B/line")
+	})
+	b.Run(config.LokiEncodingProtobuf, func(b *testing.B) {
+		b.ReportAllocs()
+		var body, comp []byte
+		for i := 0; i < b.N; i++ {
+			body = appendLokiProto(body[:0], batch, l.metadata)
+			comp = s2.EncodeSnappy(comp[:cap(comp)], body)
+		}
+		b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*lines), "ns/line")
+		b.ReportMetric(float64(len(comp))/lines, "wire-B/line")
+	})
+}
+
+// BenchmarkLokiPush measures the sink end to end, from Write to a local
+// stand-in for Loki, per encoding.
+func BenchmarkLokiPush(b *testing.B) {
+	const lines = event.BatchSize
+	for _, encoding := range []string{config.LokiEncodingJSON, config.LokiEncodingProtobuf} {
+		b.Run(encoding, func(b *testing.B) {
+			s := newTestLoki(b, false)
+			l := newTestLokiClient(b, s.srv.URL, LokiOptions{
+				BatchBytes: 1 << 20,
+				BatchWait:  time.Second,
+				Workers:    4,
+				Encoding:   encoding,
+			})
+			c := testLokiChunk(monotonicNow(), lines)
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				if err := l.Write(c); err != nil {
+					b.Fatal(err)
+				}
+			}
+			if err := l.Close(); err != nil {
+				b.Fatal(err)
+			}
+			b.StopTimer()
+
+			s.mu.Lock()
+			defer s.mu.Unlock()
+			b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*lines), "ns/line")
+			b.ReportMetric(float64(s.bytes)/float64(b.N*lines), "wire-B/line")
+			b.ReportMetric(float64(s.calls)/float64(b.N), "requests/op")
+		})
+	}
+}
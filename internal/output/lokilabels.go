@@ -0,0 +1,273 @@
+package output
+
+import (
+	"bytes"
+	"encoding/binary"
+	"sort"
+	"strconv"
+	"strings"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+)
+
+// lokiField is what a part of a label template renders.
+type lokiField uint8
+
+const (
+	lokiText lokiField = iota
+	lokiHost
+	lokiComm
+	lokiPID
+	lokiTID
+	lokiFD
+	lokiRegistration      // PID of the registration a record belongs to
+	lokiRegistrationLabel // label given at registration
+)
+
+type lokiPart struct {
+	field lokiField
+	text  string // literal text, or registration label name
+}
+
+// lokiTemplate is a compiled config.LabelTemplate.
+type lokiTemplate struct {
+	name  string
+	parts []lokiPart
+}
+
+// compileLokiTemplates compiles templates validated by
+// config.ParseLabelTemplates, sorted by name as Loki expects label sets.
+func compileLokiTemplates(templates []config.LabelTemplate) []lokiTemplate {
+	compiled := make([]lokiTemplate, len(templates))
+	for i, t := range templates {
+		c := &compiled[i]
+		c.name = t.Name
+		for rest := t.Value; rest != ""; {
+			open := strings.IndexByte(rest, '{')
+			end := strings.IndexByte(rest, '}')
+			if open < 0 || end < open {
+				c.parts = append(c.parts, lokiPart{text: rest})
+				break
+			}
+			if open > 0 {
+				c.parts = append(c.parts, lokiPart{text: rest[:open]})
+			}
+			c.parts = append(c.parts, lokiFieldPart(rest[open+1:end]))
+			rest = rest[end+1:]
+		}
+	}
+	sort.Slice(compiled, func(i, j int) bool { return compiled[i].name < compiled[j].name })
+	return compiled
+}
+
+func lokiFieldPart(name string) lokiPart {
+	switch name {
+	case "host":
+		return lokiPart{field: lokiHost}
+	case "comm":
+		return lokiPart{field: lokiComm}
+	case "pid":
+		return lokiPart{field: lokiPID}
+	case "tid":
+		return lokiPart{field: lokiTID}
+	case "fd":
+		return lokiPart{field: lokiFD}
+	case "registration":
+		return lokiPart{field: lokiRegistration}
+	}
+	return lokiPart{field: lokiRegistrationLabel, text: name}
+}
+
+// lokiFields returns the set of fields templates refer to, one bit per
+// lokiField.
+func lokiFields(templates []lokiTemplate) uint {
+	var fields uint
+	for _, t := range templates {
+		for _, p := range t.parts {
+			fields |= 1 << p.field
+		}
+	}
+	return fields
+}
+
+// lokiSource is what templates are rendered from: a record and the
+// registration it belongs to, if any.
+type lokiSource struct {
+	rec    *event.Record
+	owner  uint32
+	labels map[string]string // of the registration
+}
+
+// appendTemplate appends the value of t for src to dst.
+func (l *LokiClient) appendTemplate(dst []byte, t *lokiTemplate, src *lokiSource) []byte {
+	for _, p := range t.parts {
+		switch p.field {
+		case lokiText:
+			dst = append(dst, p.text...)
+		case lokiHost:
+			dst = append(dst, l.host...)
+		case lokiComm:
+			dst = append(dst, src.rec.Comm...)
+		case lokiPID:
+			dst = strconv.AppendUint(dst, uint64(src.rec.PID), 10)
+		case lokiTID:
+			dst = strconv.AppendUint(dst, uint64(src.rec.TID), 10)
+		case lokiFD:
+			dst = strconv.AppendUint(dst, uint64(src.rec.FD), 10)
+		case lokiRegistration:
+			if src.owner != 0 {
+				dst = strconv.AppendUint(dst, uint64(src.owner), 10)
+			}
+		case lokiRegistrationLabel:
+			dst = append(dst, src.labels[p.text]...)
+		}
+	}
+	return dst
+}
+
+// streamKey returns the key of the stream of src: the record fields the
+// label templates refer to, the others left zero.
+func (l *LokiClient) streamKey(src *lokiSource) lokiStreamKey {
+	var key lokiStreamKey
+	if l.labelFields&(1<<lokiRegistration|1<<lokiRegistrationLabel) != 0 {
+		key.owner = src.owner
+	}
+	if l.labelFields&(1<<lokiPID) != 0 {
+		key.pid = src.rec.PID
+	}
+	if l.labelFields&(1<<lokiTID) != 0 {
+		key.tid = src.rec.TID
+	}
+	if l.labelFields&(1<<lokiFD) != 0 {
+		key.fd = src.rec.FD
+	}
+	if l.labelFields&(1<<lokiComm) != 0 {
+		copy(key.comm[:], src.rec.Comm)
+	}
+	return key
+}
+
+// lokiFallbackLabel is the label of streams whose templates all render
+// empty, as Loki rejects empty label sets.
+const lokiFallbackLabel, lokiFallbackValue = "app", "write-tracer"
+
+// streamLabels returns the label set of the stream of src, rendered once
+// per stream key and cached until its registration ends. Labels with an
+// empty value are left out. l.mu must be held.
+func (l *LokiClient) streamLabels(key lokiStreamKey, src *lokiSource) *lokiLabels {
+	if ls, ok := l.labels[key]; ok {
+		return ls
+	}
+	if len(l.labels) >= maxLokiLabels {
+		clear(l.labels)
+	}
+
+	ls := &lokiLabels{pairs: make(map[string]string, len(l.labelTemplates))}
+	buf := make([]byte, 0, 64)
+	buf = append(buf, '{')
+	for i := range l.labelTemplates {
+		t := &l.labelTemplates[i]
+		l.scratch = l.appendTemplate(l.scratch[:0], t, src)
+		if len(l.scratch) == 0 {
+			continue
+		}
+		if len(buf) > 1 {
+			buf = append(buf, ", "...)
+		}
+		buf = append(buf, t.name...)
+		buf = append(buf, '=')
+		value := string(l.scratch)
+		buf = strconv.AppendQuote(buf, value)
+		ls.pairs[t.name] = value
+	}
+	if len(ls.pairs) == 0 {
+		buf = append(buf, lokiFallbackLabel+"="...)
+		buf = strconv.AppendQuote(buf, lokiFallbackValue)
+		ls.pairs[lokiFallbackLabel] = lokiFallbackValue
+	}
+	buf = append(buf, '}')
+	ls.text = string(buf)
+
+	l.labels[key] = ls
+	return ls
+}
+
+// appendMetadata appends the metadata values of src to dst, each prefixed
+// with its length, in template order. l.mu must be held.
+func (l *LokiClient) appendMetadata(dst []byte, src *lokiSource) []byte {
+	for i := range l.metadata {
+		l.scratch = l.appendTemplate(l.scratch[:0], &l.metadata[i], src)
+		dst = binary.AppendUvarint(dst, uint64(len(l.scratch)))
+		dst = append(dst, l.scratch...)
+	}
+	return dst
+}
+
+// appendLogfmt appends the non-empty metadata values of src to dst as
+// logfmt fields, each followed by a space, to prefix a line with. l.mu must
+// be held.
+func (l *LokiClient) appendLogfmt(dst []byte, src *lokiSource) []byte {
+	for i := range l.metadata {
+		l.scratch = l.appendTemplate(l.scratch[:0], &l.metadata[i], src)
+		if len(l.scratch) == 0 {
+			continue
+		}
+		dst = append(dst, l.metadata[i].name...)
+		dst = append(dst, '=')
+		if bytes.ContainsFunc(l.scratch, func(r rune) bool { return r <= ' ' || r == '=' || r == '"' }) {
+			dst = strconv.AppendQuote(dst, string(l.scratch))
+		} else {
+			dst = append(dst, l.scratch...)
+		}
+		dst = append(dst, ' ')
+	}
+	return dst
+}
+
+// forEachMetadata calls fn with the non-empty metadata values encoded by
+// appendMetadata, and their names.
+func forEachMetadata(names []lokiTemplate, meta []byte, fn func(name string, value []byte)) {
+	for i := 0; i < len(names) && len(meta) > 0; i++ {
+		n, k := binary.Uvarint(meta)
+		value := meta[k : k+int(n)]
+		meta = meta[k+int(n):]
+		if len(value) > 0 {
+			fn(names[i].name, value)
+		}
+	}
+}
+
+// registration returns the owner of pid and its labels, from a cache
+// dropped by Release. l.mu must be held.
+func (l *LokiClient) registration(pid uint32) (uint32, map[string]string) {
+	if l.opts.Owner == nil {
+		return 0, nil
+	}
+	owner, ok := l.opts.Owner(pid)
+	if !ok {
+		return 0, nil
+	}
+	labels, cached := l.registrations[owner]
+	if !cached && l.opts.RegistrationLabels != nil {
+		if len(l.registrations) >= maxLokiLabels {
+			clear(l.registrations)
+		}
+		labels = l.opts.RegistrationLabels(owner)
+		l.registrations[owner] = labels
+	}
+	return owner, labels
+}
+
+// Release drops the label sets cached for registration owner, once it
+// ended.
+func (l *LokiClient) Release(owner uint32) {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	delete(l.registrations, owner)
+	for key := range l.labels {
+		if key.owner == owner {
+			delete(l.labels, key)
+		}
+	}
+}
@@ -0,0 +1,113 @@
+package output
+
+import (
+	"reflect"
+	"testing"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+)
+
+func newLabelClient(t *testing.T, labels string) *LokiClient {
+	t.Helper()
+	templates, err := config.ParseLabelTemplates(labels)
+	if err != nil {
+		t.Fatal(err)
+	}
+	l := &LokiClient{
+		host:           "node1",
+		labelTemplates: compileLokiTemplates(templates),
+		labels:         make(map[lokiStreamKey]*lokiLabels),
+	}
+	l.labelFields = lokiFields(l.labelTemplates)
+	return l
+}
+
+func TestLokiStreamLabels(t *testing.T) {
+	rec := &event.Record{PID: 1234, TID: 1235, FD: 1, Comm: []byte(`mpi"rank`)}
+	job := map[string]string{"job": "678", "rank": "3"}
+
+	tests := []struct {
+		name   string
+		labels string
+		owner  uint32
+		reg    map[string]string
+		text   string
+		pairs  map[string]string
+	}{
+		{
+			name:   "default",
+			labels: config.DefaultLokiLabels,
+			owner:  1000,
+			reg:    job,
+			text:   `{app="write-tracer", host="node1", job="678"}`,
+			pairs:  map[string]string{"app": "write-tracer", "host": "node1", "job": "678"},
+		},
+		{
+			name:   "default without registration",
+			labels: config.DefaultLokiLabels,
+			text:   `{app="write-tracer", host="node1"}`,
+			pairs:  map[string]string{"app": "write-tracer", "host": "node1"},
+		},
+		{
+			name:   "per process",
+			labels: "app=write-tracer,comm={comm},fd={fd},pid={pid}",
+			text:   `{app="write-tracer", comm="mpi\"rank", fd="1", pid="1234"}`,
+			pairs:  map[string]string{"app": "write-tracer", "comm": `mpi"rank`, "fd": "1", "pid": "1234"},
+		},
+		{
+			name:   "mixed text and fields",
+			labels: "stream={host}/{registration}:{tid},rank=r{rank}",
+			owner:  1000,
+			reg:    job,
+			text:   `{rank="r3", stream="node1/1000:1235"}`,
+			pairs:  map[string]string{"rank": "r3", "stream": "node1/1000:1235"},
+		},
+		{
+			name:   "all empty",
+			labels: "job={job},rank={rank}",
+			text:   `{app="write-tracer"}`,
+			pairs:  map[string]string{"app": "write-tracer"},
+		},
+		{
+			name:   "no templates",
+			labels: "",
+			text:   `{app="write-tracer"}`,
+			pairs:  map[string]string{"app": "write-tracer"},
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			l := newLabelClient(t, tt.labels)
+			src := lokiSource{rec: rec, owner: tt.owner, labels: tt.reg}
+			ls := l.streamLabels(l.streamKey(&src), &src)
+			if ls.text != tt.text {
+				t.Errorf("text = %s, want %s", ls.text, tt.text)
+			}
+			if !reflect.DeepEqual(ls.pairs, tt.pairs) {
+				t.Errorf("pairs = %v, want %v", ls.pairs, tt.pairs)
+			}
+		})
+	}
+}
+
+func TestLokiStreamKey(t *testing.T) {
+	l := newLabelClient(t, config.DefaultLokiLabels)
+	a := lokiSource{rec: &event.Record{PID: 1, TID: 1, FD: 1}, owner: 1000}
+	b := lokiSource{rec: &event.Record{PID: 2, TID: 3, FD: 2}, owner: 1000}
+	c := lokiSource{rec: &event.Record{PID: 1, TID: 1, FD: 1}, owner: 2000}
+
+	// Processes of one registration share a stream; fields the labels do
+	// not refer to do not split it.
+	if l.streamKey(&a) != l.streamKey(&b) {
+		t.Error("records of one registration got different streams")
+	}
+	if l.streamKey(&a) == l.streamKey(&c) {
+		t.Error("records of different registrations got the same stream")
+	}
+
+	l = newLabelClient(t, "pid={pid}")
+	if l.streamKey(&a) == l.streamKey(&b) {
+		t.Error("records of different processes got the same stream")
+	}
+}
@@ -0,0 +1,94 @@
+package output
+
+import "encoding/binary"
+
+// Hand-rolled encoder for the Loki push API protobuf (logproto.PushRequest),
+// to avoid pulling in the Loki and gogo/protobuf modules for three messages:
+//
+//	message PushRequest   { repeated StreamAdapter streams = 1; }
+//	message StreamAdapter { string labels = 1; repeated EntryAdapter entries = 2; }
+//	message EntryAdapter  { google.protobuf.Timestamp timestamp = 1; string line = 2;
+//	                        repeated LabelPairAdapter structuredMetadata = 3; }
+//	message LabelPairAdapter { string name = 1; string value = 2; }
+//	message Timestamp     { int64 seconds = 1; int32 nanos = 2; }
+//
+// Message lengths are computed before the messages are written, so a batch
+// is encoded in one pass over a reused buffer.
+
+func pbTimestampLen(ns int64) int {
+	n := 0
+	if sec := ns / 1e9; sec != 0 {
+		n += 1 + pbVarintLen(uint64(sec))
+	}
+	if nanos := ns % 1e9; nanos != 0 {
+		n += 1 + pbVarintLen(uint64(nanos))
+	}
+	return n
+}
+
+// pbMetadataLen is the encoded size of the structured metadata of an entry.
+func pbMetadataLen(metadata []lokiTemplate, meta []byte) int {
+	n := 0
+	forEachMetadata(metadata, meta, func(name string, value []byte) {
+		n += pbFieldLen(pbFieldLen(len(name)) + pbFieldLen(len(value)))
+	})
+	return n
+}
+
+func pbEntryLen(ns int64, line, metadata int) int {
+	return pbFieldLen(pbTimestampLen(ns)) + pbFieldLen(line) + metadata
+}
+
+// appendLokiProto appends the PushRequest of batch b, whose entries carry
+// the given metadata, to dst.
+func appendLokiProto(dst []byte, b *lokiBatch, metadata []lokiTemplate) []byte {
+	for i := range b.streams {
+		s := &b.streams[i]
+		labels := s.labels.text
+
+		size := pbFieldLen(len(labels))
+		for _, e := range s.entries {
+			size += pbFieldLen(pbEntryLen(e.ts, e.n, pbMetadataLen(metadata, b.meta[e.metaOff:e.metaOff+e.metaN])))
+		}
+
+		dst = append(dst, pbTag(1, pbBytes))
+		dst = binary.AppendUvarint(dst, uint64(size))
+		dst = append(dst, pbTag(1, pbBytes))
+		dst = binary.AppendUvarint(dst, uint64(len(labels)))
+		dst = append(dst, labels...)
+
+		for _, e := range s.entries {
+			line := b.lines[e.off : e.off+e.n]
+			meta := b.meta[e.metaOff : e.metaOff+e.metaN]
+			dst = append(dst, pbTag(2, pbBytes))
+			dst = binary.AppendUvarint(dst, uint64(pbEntryLen(e.ts, len(line), pbMetadataLen(metadata, meta))))
+
+			dst = append(dst, pbTag(1, pbBytes))
+			dst = binary.AppendUvarint(dst, uint64(pbTimestampLen(e.ts)))
+			if sec := e.ts / 1e9; sec != 0 {
+				dst = append(dst, pbTag(1, pbVarint))
+				dst = binary.AppendUvarint(dst, uint64(sec))
+			}
+			if nanos := e.ts % 1e9; nanos != 0 {
+				dst = append(dst, pbTag(2, pbVarint))
+				dst = binary.AppendUvarint(dst, uint64(nanos))
+			}
+
+			dst = append(dst, pbTag(2, pbBytes))
+			dst = binary.AppendUvarint(dst, uint64(len(line)))
+			dst = append(dst, line...)
+
+			forEachMetadata(metadata, meta, func(name string, value []byte) {
+				dst = append(dst, pbTag(3, pbBytes))
+				dst = binary.AppendUvarint(dst, uint64(pbFieldLen(len(name))+pbFieldLen(len(value))))
+				dst = append(dst, pbTag(1, pbBytes))
+				dst = binary.AppendUvarint(dst, uint64(len(name)))
+				dst = append(dst, name...)
+				dst = append(dst, pbTag(2, pbBytes))
+				dst = binary.AppendUvarint(dst, uint64(len(value)))
+				dst = append(dst, value...)
+			})
+		}
+	}
+	return dst
+}
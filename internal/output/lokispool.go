@@ -0,0 +1,269 @@
+package output
+
+import (
+	"errors"
+	"fmt"
+	"io/fs"
+	"log/slog"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+)
+
+const lokiSpoolPrefix = "loki."
+
+// Spooled request encodings, the first byte of a spool file.
+const (
+	spoolJSON     = 'j'
+	spoolProtobuf = 'p'
+)
+
+// lokiSpool is the on-disk write-ahead spool of a LokiClient. Encoded push
+// requests that could not be delivered are written to it, one file per
+// request, and a replay goroutine pushes them in order, backing off while
+// Loki stays unavailable. While the spool is not empty, new requests are
+// appended to it rather than pushed, so Loki receives batches in order and
+// a recovering server is not flooded. Files survive restarts and are
+// replayed on the next start. Beyond maxBytes, the oldest requests are
+// dropped.
+type lokiSpool struct {
+	mu       sync.Mutex
+	dir      string
+	maxBytes int64
+	next     uint64
+	files    []spoolFile // oldest first
+	total    int64
+
+	push func(body []byte, contentType string) error
+	wake chan struct{}
+	stop chan struct{}
+	done chan struct{}
+}
+
+type spoolFile struct {
+	seq     uint64
+	size    int64
+	created time.Time
+}
+
+func openLokiSpool(dir string, maxBytes int64, push func(body []byte, contentType string) error) (*lokiSpool, error) {
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		return nil, fmt.Errorf("failed to create Loki spool directory: %w", err)
+	}
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		return nil, fmt.Errorf("failed to scan Loki spool directory: %w", err)
+	}
+
+	s := &lokiSpool{
+		dir:      dir,
+		maxBytes: maxBytes,
+		next:     1,
+		push:     push,
+		wake:     make(chan struct{}, 1),
+		stop:     make(chan struct{}),
+		done:     make(chan struct{}),
+	}
+	for _, entry := range entries {
+		name := entry.Name()
+		if !entry.Type().IsRegular() || !strings.HasPrefix(name, lokiSpoolPrefix) {
+			continue
+		}
+		if strings.HasSuffix(name, tmpExt) {
+			os.Remove(filepath.Join(dir, name))
+			continue
+		}
+		seq, ok := segmentSeq(name, lokiSpoolPrefix)
+		info, err := entry.Info()
+		if !ok || err != nil {
+			continue
+		}
+		s.files = append(s.files, spoolFile{seq: seq, size: info.Size(), created: info.ModTime()})
+		s.total += info.Size()
+		s.next = max(s.next, seq+1)
+	}
+	sort.Slice(s.files, func(i, j int) bool { return s.files[i].seq < s.files[j].seq })
+	if len(s.files) > 0 {
+		slog.Info("Replaying Loki spool", "dir", dir, "requests", len(s.files), "bytes", s.total)
+	}
+	s.updateMetrics()
+
+	registerLokiSpoolAge(s.oldestAge)
+	go s.replay()
+	return s, nil
+}
+
+func (s *lokiSpool) name(seq uint64) string {
+	return filepath.Join(s.dir, lokiSpoolPrefix+fmt.Sprintf("%0*d", segmentDigits, seq))
+}
+
+// empty reports whether the spool holds no request.
+func (s *lokiSpool) empty() bool {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	return len(s.files) == 0
+}
+
+// put appends an encoded push request to the spool. The file is synced and
+// renamed into place, so a crash never leaves a partial request behind.
+func (s *lokiSpool) put(body []byte, contentType string) error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	seq := s.next
+	s.next++
+	name := s.name(seq)
+	kind := byte(spoolJSON)
+	if contentType == lokiProtobufContentType {
+		kind = spoolProtobuf
+	}
+
+	f, err := os.OpenFile(name+tmpExt, os.O_CREATE|os.O_EXCL|os.O_WRONLY, 0644)
+	if err != nil {
+		return fmt.Errorf("failed to spool Loki request: %w", err)
+	}
+	_, err = f.Write([]byte{kind})
+	if err == nil {
+		_, err = f.Write(body)
+	}
+	if err == nil {
+		err = f.Sync()
+	}
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(name+tmpExt, name)
+	}
+	if err != nil {
+		os.Remove(name + tmpExt)
+		return fmt.Errorf("failed to spool Loki request: %w", err)
+	}
+
+	if len(s.files) == 0 {
+		slog.Warn("Loki unavailable, spooling push requests", "dir", s.dir)
+	}
+	size := int64(len(body) + 1)
+	s.files = append(s.files, spoolFile{seq: seq, size: size, created: time.Now()})
+	s.total += size
+	for s.total > s.maxBytes && len(s.files) > 1 {
+		s.remove()
+		addLokiSpoolDropped(1)
+	}
+	s.updateMetrics()
+
+	select {
+	case s.wake <- struct{}{}:
+	default:
+	}
+	return nil
+}
+
+// remove deletes the oldest request. s.mu must be held.
+func (s *lokiSpool) remove() {
+	f := s.files[0]
+	if err := os.Remove(s.name(f.seq)); err != nil && !errors.Is(err, fs.ErrNotExist) {
+		slog.Warn("Failed to remove Loki spool file", "path", s.name(f.seq), "error", err)
+	}
+	s.files = s.files[1:]
+	s.total -= f.size
+}
+
+// replay pushes the spooled requests, oldest first, until stopped.
+func (s *lokiSpool) replay() {
+	defer close(s.done)
+
+	attempt := 0
+	for {
+		s.mu.Lock()
+		var head spoolFile
+		pending := len(s.files) > 0
+		if pending {
+			head = s.files[0]
+		}
+		s.mu.Unlock()
+
+		if !pending {
+			select {
+			case <-s.stop:
+				return
+			case <-s.wake:
+				continue
+			}
+		}
+
+		body, contentType, err := s.read(head.seq)
+		switch {
+		case errors.Is(err, fs.ErrNotExist):
+			// Dropped by put to make room since head was taken, and
+			// counted there.
+		case err != nil:
+			slog.Warn("Failed to read Loki spool file, dropping it", "error", err)
+			addLokiSpoolDropped(1)
+		default:
+			if err = s.push(body, contentType); err != nil && retryable(err) {
+				attempt++
+				select {
+				case <-s.stop:
+					return
+				case <-time.After(retryDelay(attempt, err)):
+				}
+				continue
+			}
+			if err != nil {
+				slog.Warn("Loki rejected spooled request, dropping it", "error", err)
+				addLokiSpoolDropped(1)
+			}
+		}
+		attempt = 0
+
+		s.mu.Lock()
+		if len(s.files) > 0 && s.files[0].seq == head.seq {
+			s.remove()
+		}
+		if len(s.files) == 0 {
+			slog.Info("Loki spool replayed")
+		}
+		s.updateMetrics()
+		s.mu.Unlock()
+	}
+}
+
+// read returns spooled request seq and its content type.
+func (s *lokiSpool) read(seq uint64) ([]byte, string, error) {
+	data, err := os.ReadFile(s.name(seq))
+	if err != nil {
+		return nil, "", err
+	}
+	if len(data) == 0 {
+		return nil, "", fmt.Errorf("empty spool file %s", s.name(seq))
+	}
+	contentType := lokiJSONContentType
+	if data[0] == spoolProtobuf {
+		contentType = lokiProtobufContentType
+	}
+	return data[1:], contentType, nil
+}
+
+// close stops the replay; requests still spooled are replayed on the next
+// start.
+func (s *lokiSpool) close() {
+	close(s.stop)
+	<-s.done
+}
+
+func (s *lokiSpool) oldestAge() float64 {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if len(s.files) == 0 {
+		return 0
+	}
+	return time.Since(s.files[0].created).Seconds()
+}
+
+func (s *lokiSpool) updateMetrics() {
+	setLokiSpool(len(s.files), s.total)
+}
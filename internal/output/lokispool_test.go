@@ -0,0 +1,181 @@
+package output
+
+import (
+	"fmt"
+	"os"
+	"testing"
+
+	"github.com/prometheus/client_golang/prometheus/testutil"
+)
+
+// testSpoolPush returns a push function to s, the one a LokiClient gives
+// its spool.
+func testSpoolPush(s *testLoki) func(body []byte, contentType string) error {
+	l := &LokiClient{endpoint: s.srv.URL, client: s.srv.Client()}
+	return l.push
+}
+
+func (s *testLoki) callCount() int {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	return s.calls
+}
+
+// bodies returns the bodies of the requests received so far.
+func (s *testLoki) bodies() []string {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	bodies := make([]string, len(s.requests))
+	for i, req := range s.requests {
+		bodies[i] = string(req.body)
+	}
+	return bodies
+}
+
+func testSpoolBody(i int) []byte {
+	return []byte(fmt.Sprintf("request %02d", i))
+}
+
+// testSpoolBytes is the size of a spooled testSpoolBody, with its kind byte.
+var testSpoolBytes = int64(len(testSpoolBody(0)) + 1)
+
+func openTestSpool(t *testing.T, dir string, maxBytes int64, push func(body []byte, contentType string) error) *lokiSpool {
+	t.Helper()
+	s, err := openLokiSpool(dir, maxBytes, push)
+	if err != nil {
+		t.Fatal(err)
+	}
+	t.Cleanup(func() {
+		select {
+		case <-s.stop:
+		default:
+			s.close()
+		}
+	})
+	return s
+}
+
+// spoolFiles returns the number of requests held by s.
+func spoolFiles(s *lokiSpool) int {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	return len(s.files)
+}
+
+func TestLokiSpoolReplay(t *testing.T) {
+	loki := newTestLoki(t, true)
+	loki.down.Store(true)
+	dir := t.TempDir()
+	s := openTestSpool(t, dir, 1<<20, testSpoolPush(loki))
+	for i := 0; i < 5; i++ {
+		if err := s.put(testSpoolBody(i), lokiJSONContentType); err != nil {
+			t.Fatal(err)
+		}
+	}
+	// Replay backs off while Loki answers 503, keeping every request.
+	waitFor(t, func() bool { return loki.callCount() > 0 })
+	s.close()
+	if n := spoolFiles(s); n != 5 {
+		t.Fatalf("%d requests spooled, want 5", n)
+	}
+
+	// A partial request left by a crash is removed on restart, and the
+	// numbering continues after the spooled requests.
+	if err := os.WriteFile(s.name(6)+tmpExt, []byte("jpartial"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	loki.down.Store(false)
+	s = openTestSpool(t, dir, 1<<20, testSpoolPush(loki))
+	if s.next != 6 {
+		t.Errorf("next = %d after restart, want 6", s.next)
+	}
+	for i := 5; i < 8; i++ {
+		if err := s.put(testSpoolBody(i), lokiJSONContentType); err != nil {
+			t.Fatal(err)
+		}
+	}
+	waitFor(t, s.empty)
+	s.close()
+
+	bodies := loki.bodies()
+	if len(bodies) != 8 {
+		t.Fatalf("Loki received %d requests, want 8: %q", len(bodies), bodies)
+	}
+	for i, body := range bodies {
+		if body != string(testSpoolBody(i)) {
+			t.Errorf("request %d = %q, want %q", i, body, testSpoolBody(i))
+		}
+	}
+	if entries, err := os.ReadDir(dir); err != nil || len(entries) != 0 {
+		t.Errorf("spool directory holds %d files after replay, error %v", len(entries), err)
+	}
+}
+
+func TestLokiSpoolEviction(t *testing.T) {
+	loki := newTestLoki(t, true)
+	loki.down.Store(true)
+	dropped := testutil.ToFloat64(lokiSpoolDropped)
+	s := openTestSpool(t, t.TempDir(), 3*testSpoolBytes, testSpoolPush(loki))
+	for i := 0; i < 10; i++ {
+		if err := s.put(testSpoolBody(i), lokiJSONContentType); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if n := spoolFiles(s); n != 3 {
+		t.Fatalf("%d requests spooled, want 3", n)
+	}
+
+	// The newest requests are replayed once Loki recovers.
+	loki.down.Store(false)
+	waitFor(t, s.empty)
+	s.close()
+	bodies := loki.bodies()
+	want := []string{string(testSpoolBody(7)), string(testSpoolBody(8)), string(testSpoolBody(9))}
+	if fmt.Sprint(bodies) != fmt.Sprint(want) {
+		t.Errorf("Loki received %q, want %q", bodies, want)
+	}
+	if n := testutil.ToFloat64(lokiSpoolDropped) - dropped; n != 7 {
+		t.Errorf("%v requests counted as dropped, want 7", n)
+	}
+}
+
+func TestLokiSpoolHeadEvicted(t *testing.T) {
+	loki := newTestLoki(t, true)
+	push := testSpoolPush(loki)
+	pushing := make(chan struct{})
+	resume := make(chan struct{})
+	first := true
+	s := openTestSpool(t, t.TempDir(), 1<<20, func(body []byte, contentType string) error {
+		if first {
+			first = false
+			close(pushing)
+			<-resume
+		}
+		return push(body, contentType)
+	})
+	dropped := testutil.ToFloat64(lokiSpoolDropped)
+	for i := 0; i < 3; i++ {
+		if err := s.put(testSpoolBody(i), lokiJSONContentType); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	// The next head is evicted after replay takes it: its file is gone
+	// when replay reads it. The eviction counted it already.
+	<-pushing
+	if err := os.Remove(s.name(2)); err != nil {
+		t.Fatal(err)
+	}
+	close(resume)
+	waitFor(t, s.empty)
+	s.close()
+
+	bodies := loki.bodies()
+	want := []string{string(testSpoolBody(0)), string(testSpoolBody(2))}
+	if fmt.Sprint(bodies) != fmt.Sprint(want) {
+		t.Errorf("Loki received %q, want %q", bodies, want)
+	}
+	if n := testutil.ToFloat64(lokiSpoolDropped) - dropped; n != 0 {
+		t.Errorf("%v requests counted as dropped, want 0", n)
+	}
+}
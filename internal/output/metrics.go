@@ -4,6 +4,8 @@ import (
 	"fmt"
 	"log/slog"
 	"net/http"
+	"strconv"
+	"time"
 
 	"github.com/prometheus/client_golang/prometheus"
 	"github.com/prometheus/client_golang/prometheus/promhttp"
@@ -19,9 +21,184 @@ var writeCalls = prometheus.NewCounter(prometheus.CounterOpts{
 	Help: "Total number of write calls captured",
 })
 
+var shardCount = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_shards",
+	Help: "Number of event processing shards",
+})
+
+var droppedEvents = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Name: "write_tracer_dropped_events_total",
+	Help: "Total number of captured events dropped by the tracer, by reason",
+}, []string{"reason"})
+
+var spilledEvents = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_spilled_events_total",
+	Help: "Total number of events spilled to disk under backpressure",
+})
+
+var spillBytes = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_spill_bytes",
+	Help: "Bytes of spilled events waiting to be replayed",
+})
+
+var lateEvents = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_late_events_total",
+	Help: "Total number of events that arrived after the reorder watermark had passed them",
+})
+
+var reorderBuffered = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_reorder_buffered_events",
+	Help: "Number of events held in the reorder buffer",
+})
+
+var sinkDropped = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Name: "write_tracer_sink_dropped_records_total",
+	Help: "Total number of records dropped because a sink queue was full, by sink",
+}, []string{"sink"})
+
+var sinkErrors = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Name: "write_tracer_sink_write_errors_total",
+	Help: "Total number of failed sink writes, by sink",
+}, []string{"sink"})
+
+var sinkWriteSeconds = prometheus.NewHistogramVec(prometheus.HistogramOpts{
+	Name:    "write_tracer_sink_write_seconds",
+	Help:    "Time taken by a sink to write one chunk of records",
+	Buckets: prometheus.ExponentialBuckets(0.00001, 4, 10),
+}, []string{"sink"})
+
+var compressedSegments = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_compressed_segments_total",
+	Help: "Total number of rotated segments compressed in the background",
+})
+
+var streamFilesStreams = prometheus.NewGaugeVec(prometheus.GaugeOpts{
+	Name: "write_tracer_stream_files",
+	Help: "Number of per-stream output files of a sink, open or not",
+}, []string{"sink"})
+
+var streamFilesOpen = prometheus.NewGaugeVec(prometheus.GaugeOpts{
+	Name: "write_tracer_stream_files_open",
+	Help: "Number of per-stream output files of a sink currently open",
+}, []string{"sink"})
+
+var streamFilesEvictions = prometheus.NewCounterVec(prometheus.CounterOpts{
+	Name: "write_tracer_stream_file_evictions_total",
+	Help: "Total number of per-stream output files closed to stay within the open file limit of a sink",
+}, []string{"sink"})
+
+var lokiBatchEntries = prometheus.NewHistogram(prometheus.HistogramOpts{
+	Name:    "write_tracer_loki_batch_entries",
+	Help:    "Number of log entries per Loki push request",
+	Buckets: prometheus.ExponentialBuckets(1, 4, 10),
+})
+
+var lokiBatchBytes = prometheus.NewHistogram(prometheus.HistogramOpts{
+	Name:    "write_tracer_loki_batch_bytes",
+	Help:    "Size of the encoded body of a Loki push request",
+	Buckets: prometheus.ExponentialBuckets(256, 4, 10),
+})
+
+var lokiPushSeconds = prometheus.NewHistogram(prometheus.HistogramOpts{
+	Name:    "write_tracer_loki_push_seconds",
+	Help:    "Time taken by a Loki push request",
+	Buckets: prometheus.ExponentialBuckets(0.001, 2, 14),
+})
+
+var lokiPushErrors = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_loki_push_errors_total",
+	Help: "Total number of failed Loki push requests",
+})
+
+var lokiSpoolRequests = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_loki_spool_requests",
+	Help: "Number of Loki push requests waiting in the spool",
+})
+
+var lokiSpoolBytes = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_loki_spool_bytes",
+	Help: "Bytes of Loki push requests waiting in the spool",
+})
+
+var lokiSpoolDropped = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_loki_spool_dropped_total",
+	Help: "Total number of spooled Loki push requests dropped, because the spool was full or Loki rejected them",
+})
+
+var otlpBatchRecords = prometheus.NewHistogram(prometheus.HistogramOpts{
+	Name:    "write_tracer_otlp_batch_records",
+	Help:    "Number of log records per OTLP export request",
+	Buckets: prometheus.ExponentialBuckets(1, 4, 10),
+})
+
+var otlpBatchBytes = prometheus.NewHistogram(prometheus.HistogramOpts{
+	Name:    "write_tracer_otlp_batch_bytes",
+	Help:    "Size of the encoded body of an OTLP export request",
+	Buckets: prometheus.ExponentialBuckets(256, 4, 10),
+})
+
+var otlpExportSeconds = prometheus.NewHistogram(prometheus.HistogramOpts{
+	Name:    "write_tracer_otlp_export_seconds",
+	Help:    "Time taken by an OTLP export request",
+	Buckets: prometheus.ExponentialBuckets(0.001, 2, 14),
+})
+
+var otlpExportErrors = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_otlp_export_errors_total",
+	Help: "Total number of failed OTLP export requests",
+})
+
+var otlpRejected = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_otlp_rejected_records_total",
+	Help: "Total number of log records rejected by the OTLP collector in accepted requests",
+})
+
+var otlpRetryRequests = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_otlp_retry_requests",
+	Help: "Number of OTLP export requests waiting to be retried",
+})
+
+var otlpRetryBytes = prometheus.NewGauge(prometheus.GaugeOpts{
+	Name: "write_tracer_otlp_retry_bytes",
+	Help: "Bytes of OTLP export requests waiting to be retried",
+})
+
+var otlpDropped = prometheus.NewCounter(prometheus.CounterOpts{
+	Name: "write_tracer_otlp_dropped_total",
+	Help: "Total number of OTLP export requests dropped, because the retry queue was full or the collector rejected them",
+})
+
 func init() {
 	prometheus.MustRegister(trackedThreads)
 	prometheus.MustRegister(writeCalls)
+	prometheus.MustRegister(shardCount)
+	prometheus.MustRegister(droppedEvents)
+	prometheus.MustRegister(spilledEvents)
+	prometheus.MustRegister(spillBytes)
+	prometheus.MustRegister(lateEvents)
+	prometheus.MustRegister(reorderBuffered)
+	prometheus.MustRegister(sinkDropped)
+	prometheus.MustRegister(sinkErrors)
+	prometheus.MustRegister(sinkWriteSeconds)
+	prometheus.MustRegister(compressedSegments)
+	prometheus.MustRegister(streamFilesStreams)
+	prometheus.MustRegister(streamFilesOpen)
+	prometheus.MustRegister(streamFilesEvictions)
+	prometheus.MustRegister(lokiBatchEntries)
+	prometheus.MustRegister(lokiBatchBytes)
+	prometheus.MustRegister(lokiPushSeconds)
+	prometheus.MustRegister(lokiPushErrors)
+	prometheus.MustRegister(lokiSpoolRequests)
+	prometheus.MustRegister(lokiSpoolBytes)
+	prometheus.MustRegister(lokiSpoolDropped)
+	prometheus.MustRegister(otlpBatchRecords)
+	prometheus.MustRegister(otlpBatchBytes)
+	prometheus.MustRegister(otlpExportSeconds)
+	prometheus.MustRegister(otlpExportErrors)
+	prometheus.MustRegister(otlpRejected)
+	prometheus.MustRegister(otlpRetryRequests)
+	prometheus.MustRegister(otlpRetryBytes)
+	prometheus.MustRegister(otlpDropped)
 }
 
 func UpdateTrackedThreads(count int) {
@@ -32,6 +209,140 @@ func IncrementWriteCalls() {
 	writeCalls.Inc()
 }
 
+func AddWriteCalls(n int) {
+	writeCalls.Add(float64(n))
+}
+
+// AddDroppedEvents counts n events dropped for the given reason.
+func AddDroppedEvents(reason string, n int) {
+	droppedEvents.WithLabelValues(reason).Add(float64(n))
+}
+
+// AddSpilledEvents counts n events written to the spill.
+func AddSpilledEvents(n int) {
+	spilledEvents.Add(float64(n))
+}
+
+// AddSpillBytes adjusts the spill size gauge by delta bytes; delta is
+// negative when spilled data is replayed.
+func AddSpillBytes(delta int64) {
+	spillBytes.Add(float64(delta))
+}
+
+// AddLateEvents counts n events emitted out of timestamp order by the
+// reorder stage.
+func AddLateEvents(n int) {
+	lateEvents.Add(float64(n))
+}
+
+// SetReorderBuffered records the number of events held by the reorder stage.
+func SetReorderBuffered(n int) {
+	reorderBuffered.Set(float64(n))
+}
+
+// RegisterShards exposes the shard count and one queue depth gauge per shard.
+// Depths are sampled at scrape time so the hot path pays nothing for them.
+func RegisterShards(depths []func() int) {
+	shardCount.Set(float64(len(depths)))
+	for i, depth := range depths {
+		depth := depth
+		prometheus.MustRegister(prometheus.NewGaugeFunc(prometheus.GaugeOpts{
+			Name:        "write_tracer_shard_queue_depth",
+			Help:        "Number of event batches waiting in a shard queue",
+			ConstLabels: prometheus.Labels{"shard": strconv.Itoa(i)},
+		}, func() float64 { return float64(depth()) }))
+	}
+}
+
+// registerSinkQueue exposes the queue depth of a sink, sampled at scrape time.
+func registerSinkQueue(name string, depth func() int) {
+	prometheus.MustRegister(prometheus.NewGaugeFunc(prometheus.GaugeOpts{
+		Name:        "write_tracer_sink_queue_depth",
+		Help:        "Number of chunks waiting in a sink queue",
+		ConstLabels: prometheus.Labels{"sink": name},
+	}, func() float64 { return float64(depth()) }))
+}
+
+func addSinkDropped(name string, n int) {
+	sinkDropped.WithLabelValues(name).Add(float64(n))
+}
+
+func observeSinkWrite(name string, d time.Duration, err error) {
+	sinkWriteSeconds.WithLabelValues(name).Observe(d.Seconds())
+	if err != nil {
+		sinkErrors.WithLabelValues(name).Inc()
+	}
+}
+
+// AddCompressedSegments counts rotated segments compressed in the background.
+func AddCompressedSegments(n int) {
+	compressedSegments.Add(float64(n))
+}
+
+func setStreamFiles(sink string, streams, open int) {
+	streamFilesStreams.WithLabelValues(sink).Set(float64(streams))
+	streamFilesOpen.WithLabelValues(sink).Set(float64(open))
+}
+
+func addStreamEvictions(sink string, n int) {
+	streamFilesEvictions.WithLabelValues(sink).Add(float64(n))
+}
+
+func observeLokiBatch(entries, bytes int) {
+	lokiBatchEntries.Observe(float64(entries))
+	lokiBatchBytes.Observe(float64(bytes))
+}
+
+func observeLokiPush(d time.Duration, err error) {
+	lokiPushSeconds.Observe(d.Seconds())
+	if err != nil {
+		lokiPushErrors.Inc()
+	}
+}
+
+func setLokiSpool(requests int, bytes int64) {
+	lokiSpoolRequests.Set(float64(requests))
+	lokiSpoolBytes.Set(float64(bytes))
+}
+
+func addLokiSpoolDropped(n int) {
+	lokiSpoolDropped.Add(float64(n))
+}
+
+func observeOTLPBatch(records, bytes int) {
+	otlpBatchRecords.Observe(float64(records))
+	otlpBatchBytes.Observe(float64(bytes))
+}
+
+func observeOTLPExport(d time.Duration, err error) {
+	otlpExportSeconds.Observe(d.Seconds())
+	if err != nil {
+		otlpExportErrors.Inc()
+	}
+}
+
+func addOTLPRejected(n int) {
+	otlpRejected.Add(float64(n))
+}
+
+func setOTLPRetry(requests int, bytes int64) {
+	otlpRetryRequests.Set(float64(requests))
+	otlpRetryBytes.Set(float64(bytes))
+}
+
+func addOTLPDropped(n int) {
+	otlpDropped.Add(float64(n))
+}
+
+// registerLokiSpoolAge exposes the age of the oldest spooled request,
+// sampled at scrape time.
+func registerLokiSpoolAge(age func() float64) {
+	prometheus.MustRegister(prometheus.NewGaugeFunc(prometheus.GaugeOpts{
+		Name: "write_tracer_loki_spool_oldest_seconds",
+		Help: "Age of the oldest Loki push request waiting in the spool",
+	}, age))
+}
+
 func StartMetricsServer(port int) error {
 	if port <= 0 {
 		return nil
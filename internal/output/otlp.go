@@ -0,0 +1,428 @@
+package output
+
+import (
+	"bytes"
+	"compress/gzip"
+	"errors"
+	"fmt"
+	"io"
+	"log/slog"
+	"net/http"
+	"net/url"
+	"os"
+	"sync"
+	"time"
+	"unicode/utf8"
+
+	"write-tracer/internal/config"
+
+	"golang.org/x/sys/unix"
+)
+
+const (
+	// otlpRecordOverhead approximates the bytes a log record adds to an
+	// export request besides its comm and line, for batch sizing.
+	otlpRecordOverhead = 96
+	// maxOTLPResources bounds the resource cache; it is reset when full.
+	maxOTLPResources = 4096
+
+	otlpContentType = "application/x-protobuf"
+)
+
+// OTLPOptions configures an OTLPExporter.
+type OTLPOptions struct {
+	BatchBytes    int           // export a batch once its records reach this size
+	BatchWait     time.Duration // export a non-empty batch at least this often
+	Workers       int           // concurrent export requests
+	Compression   string        // config.OTLPCompression value
+	RetryMaxBytes int64         // memory held by requests waiting to be retried
+
+	// Registration lookups: records are grouped into one resource per
+	// registration, whose labels become resource attributes. Either may
+	// be nil.
+	Owner              func(pid uint32) (uint32, bool)
+	RegistrationLabels func(owner uint32) map[string]string
+}
+
+// OTLPExporter is a sink exporting records as OpenTelemetry log records to
+// an OTLP/HTTP logs endpoint, in the binary protobuf encoding. The record
+// fields become log record attributes (process.pid, thread.id,
+// process.executable.name, write_tracer.fd and write_tracer.count), and
+// the host and the registration a process belongs to, with the labels it
+// was registered with such as a job id, become resource attributes.
+//
+// Records are batched across chunks, one resource per registration, and a
+// batch is exported once it reaches BatchBytes or is BatchWait old, by a
+// fixed pool of workers, gzip compressed. Requests failing with a transport
+// error or a retryable status (429, 502, 503, 504) are kept in memory, up
+// to RetryMaxBytes, and retried with backoff; others are dropped.
+type OTLPExporter struct {
+	endpoint string
+	client   *http.Client
+	opts     OTLPOptions
+	host     string
+	retry    *otlpRetryQueue
+
+	mu        sync.Mutex
+	batch     *otlpBatch
+	resources map[uint32][]byte // encoded Resource by registration, 0 for none
+
+	batches chan *otlpBatch
+	stop    chan struct{}
+	wg      sync.WaitGroup
+
+	errMu sync.Mutex
+	err   error // first export error not yet returned by Write
+}
+
+// otlpBatch is an export request being accumulated. The comm and line of
+// each record are stored back to back in one buffer, and batches are
+// recycled once exported.
+type otlpBatch struct {
+	resources []otlpResourceLogs
+	index     map[uint32]int // registration -> resources index
+	data      []byte
+	records   int
+	bytes     int
+	created   time.Time
+}
+
+type otlpResourceLogs struct {
+	resource []byte // encoded Resource message
+	records  []otlpRecord
+}
+
+// otlpRecord is a log record of a batch. Its comm is data[off:off+commN],
+// followed by its line, lineN bytes.
+type otlpRecord struct {
+	ts, observed uint64 // Unix nanoseconds
+	count        uint64
+	pid, tid, fd uint32
+	off          int
+	commN, lineN int
+}
+
+var otlpBatchPool = sync.Pool{
+	New: func() any {
+		return &otlpBatch{index: make(map[uint32]int)}
+	},
+}
+
+func newOTLPBatch() *otlpBatch {
+	b := otlpBatchPool.Get().(*otlpBatch)
+	b.created = time.Now()
+	return b
+}
+
+// release resets b and returns it to the pool.
+func (b *otlpBatch) release() {
+	for i := range b.resources {
+		b.resources[i].records = b.resources[i].records[:0]
+	}
+	b.resources = b.resources[:0]
+	clear(b.index)
+	b.data = b.data[:0]
+	b.records, b.bytes = 0, 0
+	otlpBatchPool.Put(b)
+}
+
+// NewOTLPExporter creates an OTLP sink and starts its export workers.
+func NewOTLPExporter(endpoint string, opts OTLPOptions) (*OTLPExporter, error) {
+	if _, err := url.ParseRequestURI(endpoint); err != nil {
+		return nil, fmt.Errorf("invalid OTLP endpoint: %w", err)
+	}
+	opts.Workers = max(opts.Workers, 1)
+	transport := http.DefaultTransport.(*http.Transport).Clone()
+	transport.MaxIdleConnsPerHost = opts.Workers
+
+	host, err := os.Hostname()
+	if err != nil {
+		host = ""
+	}
+
+	o := &OTLPExporter{
+		endpoint:  endpoint,
+		client:    &http.Client{Timeout: 10 * time.Second, Transport: transport},
+		opts:      opts,
+		host:      host,
+		batch:     newOTLPBatch(),
+		resources: make(map[uint32][]byte),
+		batches:   make(chan *otlpBatch),
+		stop:      make(chan struct{}),
+	}
+	o.retry = newOTLPRetryQueue(opts.RetryMaxBytes, o.export)
+	for i := 0; i < opts.Workers; i++ {
+		o.wg.Add(1)
+		go o.worker()
+	}
+	go o.flusher()
+	return o, nil
+}
+
+// Name implements Sink.
+func (o *OTLPExporter) Name() string {
+	return "otlp"
+}
+
+// Write adds the records of a chunk to the current batch, grouped by
+// registration, and hands the batch to the workers once it is full. Write
+// returns the first export error since the previous call.
+func (o *OTLPExporter) Write(c *Chunk) error {
+	now := time.Now()
+	observed := uint64(now.UnixNano())
+	offset := monotonicOffset(now)
+
+	o.mu.Lock()
+	var lastPID, owner uint32
+	for i := range c.Records {
+		rec := &c.Records[i]
+		b := o.batch
+		if o.opts.Owner != nil && (i == 0 || rec.PID != lastPID) {
+			lastPID = rec.PID
+			owner, _ = o.opts.Owner(rec.PID)
+		}
+		n, ok := b.index[owner]
+		if !ok {
+			n = len(b.resources)
+			b.index[owner] = n
+			if n < cap(b.resources) {
+				b.resources = b.resources[:n+1]
+			} else {
+				b.resources = append(b.resources, otlpResourceLogs{})
+			}
+			b.resources[n].resource = o.resource(owner)
+		}
+
+		line := bytes.TrimRight(rec.Data, "\n\r")
+		r := otlpRecord{
+			ts:       rec.Timestamp + offset,
+			observed: observed,
+			count:    rec.Count,
+			pid:      rec.PID,
+			tid:      rec.TID,
+			fd:       rec.FD,
+			off:      len(b.data),
+			commN:    len(rec.Comm),
+			lineN:    len(line),
+		}
+		b.data = append(b.data, rec.Comm...)
+		if comm := b.data[r.off:]; !utf8.Valid(comm) {
+			// Attribute strings must be valid UTF-8.
+			for j, c := range comm {
+				if c >= utf8.RuneSelf {
+					comm[j] = '?'
+				}
+			}
+		}
+		b.data = append(b.data, line...)
+		res := &b.resources[n]
+		res.records = append(res.records, r)
+		b.records++
+		b.bytes += r.commN + r.lineN + otlpRecordOverhead
+
+		if b.bytes >= o.opts.BatchBytes {
+			o.flushLocked()
+		}
+	}
+	o.mu.Unlock()
+
+	o.errMu.Lock()
+	defer o.errMu.Unlock()
+	err := o.err
+	o.err = nil
+	return err
+}
+
+// monotonicOffset returns the offset from CLOCK_MONOTONIC, the clock of
+// the event timestamps, to Unix time. It is sampled per chunk, so that it
+// follows adjustments of the wall clock.
+func monotonicOffset(now time.Time) uint64 {
+	var ts unix.Timespec
+	if err := unix.ClockGettime(unix.CLOCK_MONOTONIC, &ts); err != nil {
+		return 0
+	}
+	return uint64(now.UnixNano() - ts.Nano())
+}
+
+// resource returns the encoded Resource of registration owner, built once
+// and cached until Release. o.mu must be held.
+func (o *OTLPExporter) resource(owner uint32) []byte {
+	if r, ok := o.resources[owner]; ok {
+		return r
+	}
+	if len(o.resources) >= maxOTLPResources {
+		clear(o.resources)
+	}
+
+	var labels map[string]string
+	if owner != 0 && o.opts.RegistrationLabels != nil {
+		labels = o.opts.RegistrationLabels(owner)
+	}
+	r := appendOTLPResource(nil, o.host, owner, labels)
+	o.resources[owner] = r
+	return r
+}
+
+// Release drops the resource cached for registration owner, once it ended.
+func (o *OTLPExporter) Release(owner uint32) {
+	o.mu.Lock()
+	defer o.mu.Unlock()
+	delete(o.resources, owner)
+}
+
+// Close exports the current batch, waits for the workers, sends the
+// requests waiting to be retried once more and releases idle connections.
+func (o *OTLPExporter) Close() error {
+	close(o.stop)
+
+	o.mu.Lock()
+	o.flushLocked()
+	close(o.batches)
+	o.mu.Unlock()
+
+	o.wg.Wait()
+	o.retry.close()
+	o.client.CloseIdleConnections()
+
+	o.errMu.Lock()
+	defer o.errMu.Unlock()
+	return o.err
+}
+
+// flushLocked hands the current batch, if any, to a worker, waiting for one
+// to be free. o.mu must be held.
+func (o *OTLPExporter) flushLocked() {
+	if o.batch.records == 0 {
+		return
+	}
+	o.batches <- o.batch
+	o.batch = newOTLPBatch()
+}
+
+// flusher flushes batches that reached BatchWait without filling up.
+func (o *OTLPExporter) flusher() {
+	ticker := time.NewTicker(max(o.opts.BatchWait/4, 10*time.Millisecond))
+	defer ticker.Stop()
+	for {
+		select {
+		case <-o.stop:
+			return
+		case <-ticker.C:
+			o.mu.Lock()
+			if o.batch.records > 0 && time.Since(o.batch.created) >= o.opts.BatchWait {
+				o.flushLocked()
+			}
+			o.mu.Unlock()
+		}
+	}
+}
+
+func (o *OTLPExporter) worker() {
+	defer o.wg.Done()
+
+	// Encoding buffers, reused across the batches of this worker.
+	var body []byte
+	var comp bytes.Buffer
+	var zw *gzip.Writer
+	if o.opts.Compression == config.OTLPCompressionGzip {
+		// Fastest level: a batch is mostly repetitive attribute keys,
+		// which compress well at any level.
+		zw, _ = gzip.NewWriterLevel(&comp, gzip.BestSpeed)
+	}
+	for b := range o.batches {
+		body = appendOTLPLogs(body[:0], b)
+		records := b.records
+		b.release()
+
+		req := body
+		if zw != nil {
+			comp.Reset()
+			zw.Reset(&comp)
+			zw.Write(body)
+			zw.Close()
+			req = comp.Bytes()
+		}
+		observeOTLPBatch(records, len(req))
+
+		if err := o.deliver(req); err != nil {
+			addOTLPDropped(1)
+			o.errMu.Lock()
+			if o.err == nil {
+				o.err = err
+			}
+			o.errMu.Unlock()
+		}
+	}
+}
+
+// deliver exports an encoded request, or queues it for retry while other
+// requests wait to be retried or when the export fails and may succeed
+// later. The request is copied when queued.
+func (o *OTLPExporter) deliver(body []byte) error {
+	if !o.retry.empty() {
+		o.retry.put(body)
+		return nil
+	}
+	err := o.export(body)
+	if err != nil && otlpRetryable(err) {
+		o.retry.put(body)
+		return nil
+	}
+	return err
+}
+
+// export sends one encoded request.
+func (o *OTLPExporter) export(body []byte) error {
+	start := time.Now()
+	err := o.post(body)
+	observeOTLPExport(time.Since(start), err)
+	return err
+}
+
+func (o *OTLPExporter) post(body []byte) error {
+	req, err := http.NewRequest(http.MethodPost, o.endpoint, bytes.NewReader(body))
+	if err != nil {
+		return err
+	}
+	req.Header.Set("Content-Type", otlpContentType)
+	if o.opts.Compression == config.OTLPCompressionGzip {
+		req.Header.Set("Content-Encoding", "gzip")
+	}
+	resp, err := o.client.Do(req)
+	if err != nil {
+		return err
+	}
+	defer resp.Body.Close()
+
+	respBody, _ := io.ReadAll(io.LimitReader(resp.Body, 64*1024))
+	if resp.StatusCode < 200 || resp.StatusCode >= 300 {
+		// Error details are a protobuf Status; only text is worth logging.
+		if resp.Header.Get("Content-Type") == otlpContentType {
+			respBody = nil
+		}
+		return newStatusError("otlp collector", resp, respBody)
+	}
+
+	// A collector may accept a request but reject some of its records.
+	if rejected, msg := parseOTLPPartialSuccess(respBody); rejected > 0 {
+		addOTLPRejected(rejected)
+		slog.Warn("OTLP collector rejected log records", "records", rejected, "message", msg)
+	}
+	io.Copy(io.Discard, resp.Body)
+	return nil
+}
+
+// otlpRetryable reports whether a failed export may succeed later, as
+// specified by OTLP/HTTP: transport errors and the 429, 502, 503 and 504
+// statuses are retryable, other rejections are not.
+func otlpRetryable(err error) bool {
+	var status *statusError
+	if !errors.As(err, &status) {
+		return true
+	}
+	switch status.code {
+	case http.StatusTooManyRequests, http.StatusBadGateway, http.StatusServiceUnavailable, http.StatusGatewayTimeout:
+		return true
+	}
+	return false
+}
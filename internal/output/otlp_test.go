@@ -0,0 +1,451 @@
+package output
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"io"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"sync"
+	"testing"
+	"time"
+
+	"write-tracer/internal/config"
+	"write-tracer/internal/event"
+
+	"golang.org/x/sys/unix"
+)
+
+// testCollector is a stand-in OTLP/HTTP logs endpoint. Each request gets
+// the next status of script, 200 once it is exhausted. Accepted requests are
+// decoded and sent on got, and answered with partial.
+type testCollector struct {
+	t       *testing.T
+	srv     *httptest.Server
+	got     chan []testResourceLogs
+	partial []byte
+
+	mu     sync.Mutex
+	script []int
+	calls  int
+}
+
+type testResourceLogs struct {
+	attrs   map[string]any
+	scope   string
+	records []testLogRecord
+}
+
+type testLogRecord struct {
+	ts, observed uint64
+	body         any // string, or []byte for bytes_value
+	attrs        map[string]any
+}
+
+func newTestCollector(t *testing.T, script ...int) *testCollector {
+	c := &testCollector{t: t, got: make(chan []testResourceLogs, 16), script: script}
+	c.srv = httptest.NewServer(http.HandlerFunc(c.serve))
+	t.Cleanup(c.srv.Close)
+	return c
+}
+
+func (c *testCollector) serve(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodPost || r.Header.Get("Content-Type") != otlpContentType ||
+		r.Header.Get("Content-Encoding") != "gzip" {
+		c.t.Errorf("unexpected request %s, headers %v", r.Method, r.Header)
+	}
+	zr, err := gzip.NewReader(r.Body)
+	if err != nil {
+		c.t.Errorf("request body is not gzip: %v", err)
+		return
+	}
+	body, err := io.ReadAll(zr)
+	if err != nil {
+		c.t.Errorf("bad gzip body: %v", err)
+		return
+	}
+
+	c.mu.Lock()
+	c.calls++
+	status := http.StatusOK
+	if len(c.script) > 0 {
+		status, c.script = c.script[0], c.script[1:]
+	}
+	c.mu.Unlock()
+
+	if status != http.StatusOK {
+		w.WriteHeader(status)
+		return
+	}
+	w.Header().Set("Content-Type", otlpContentType)
+	w.Write(c.partial)
+	c.got <- decodeTestLogs(c.t, body)
+}
+
+func (c *testCollector) callCount() int {
+	c.mu.Lock()
+	defer c.mu.Unlock()
+	return c.calls
+}
+
+// next returns the next accepted request.
+func (c *testCollector) next() []testResourceLogs {
+	select {
+	case res := <-c.got:
+		return res
+	case <-time.After(5 * time.Second):
+		c.t.Fatal("no export request received")
+		return nil
+	}
+}
+
+// testWalk calls fn with every field of a protobuf message, fixed64 fields
+// included, which pbWalk does not support.
+func testWalk(t *testing.T, msg []byte, fn func(field, wireType int, v uint64, data []byte)) {
+	t.Helper()
+	for len(msg) > 0 {
+		tag, n := binary.Uvarint(msg)
+		if n <= 0 {
+			t.Fatal("malformed tag")
+		}
+		msg = msg[n:]
+		field, wireType := int(tag>>3), int(tag&7)
+		switch wireType {
+		case pbVarint:
+			v, n := binary.Uvarint(msg)
+			if n <= 0 {
+				t.Fatal("malformed varint")
+			}
+			msg = msg[n:]
+			fn(field, wireType, v, nil)
+		case pbFixed64:
+			if len(msg) < 8 {
+				t.Fatal("malformed fixed64")
+			}
+			fn(field, wireType, binary.LittleEndian.Uint64(msg), nil)
+			msg = msg[8:]
+		case pbBytes:
+			l, n := binary.Uvarint(msg)
+			if n <= 0 || uint64(len(msg)-n) < l {
+				t.Fatal("malformed length")
+			}
+			fn(field, wireType, 0, msg[n:n+int(l)])
+			msg = msg[n+int(l):]
+		default:
+			t.Fatalf("unexpected wire type %d", wireType)
+		}
+	}
+}
+
+func decodeTestAnyValue(t *testing.T, msg []byte) any {
+	var value any
+	testWalk(t, msg, func(field, _ int, v uint64, data []byte) {
+		switch field {
+		case 1:
+			value = string(data)
+		case 3:
+			value = int64(v)
+		case 7:
+			value = append([]byte(nil), data...)
+		default:
+			t.Fatalf("unexpected AnyValue field %d", field)
+		}
+	})
+	return value
+}
+
+func decodeTestKeyValue(t *testing.T, msg []byte, attrs map[string]any) {
+	var key string
+	var value any
+	testWalk(t, msg, func(field, _ int, _ uint64, data []byte) {
+		switch field {
+		case 1:
+			key = string(data)
+		case 2:
+			value = decodeTestAnyValue(t, data)
+		}
+	})
+	attrs[key] = value
+}
+
+func decodeTestLogs(t *testing.T, msg []byte) []testResourceLogs {
+	var out []testResourceLogs
+	testWalk(t, msg, func(field, _ int, _ uint64, data []byte) {
+		if field != 1 {
+			t.Fatalf("unexpected ExportLogsServiceRequest field %d", field)
+		}
+		res := testResourceLogs{attrs: make(map[string]any)}
+		testWalk(t, data, func(field, _ int, _ uint64, data []byte) {
+			switch field {
+			case 1: // Resource
+				testWalk(t, data, func(_, _ int, _ uint64, kv []byte) {
+					decodeTestKeyValue(t, kv, res.attrs)
+				})
+			case 2: // ScopeLogs
+				testWalk(t, data, func(field, _ int, _ uint64, data []byte) {
+					switch field {
+					case 1:
+						testWalk(t, data, func(_, _ int, _ uint64, name []byte) { res.scope = string(name) })
+					case 2:
+						res.records = append(res.records, decodeTestLogRecord(t, data))
+					}
+				})
+			}
+		})
+		out = append(out, res)
+	})
+	return out
+}
+
+func decodeTestLogRecord(t *testing.T, msg []byte) testLogRecord {
+	rec := testLogRecord{attrs: make(map[string]any)}
+	testWalk(t, msg, func(field, wireType int, v uint64, data []byte) {
+		switch {
+		case field == 1 && wireType == pbFixed64:
+			rec.ts = v
+		case field == 11 && wireType == pbFixed64:
+			rec.observed = v
+		case field == 5:
+			rec.body = decodeTestAnyValue(t, data)
+		case field == 6:
+			decodeTestKeyValue(t, data, rec.attrs)
+		default:
+			t.Fatalf("unexpected LogRecord field %d", field)
+		}
+	})
+	return rec
+}
+
+func newTestExporter(t *testing.T, c *testCollector, opts OTLPOptions) *OTLPExporter {
+	opts.Compression = config.OTLPCompressionGzip
+	opts.Workers = 1
+	if opts.BatchBytes == 0 {
+		opts.BatchBytes = 1 << 20
+	}
+	if opts.BatchWait == 0 {
+		opts.BatchWait = 10 * time.Millisecond
+	}
+	o, err := NewOTLPExporter(c.srv.URL+"/v1/logs", opts)
+	if err != nil {
+		t.Fatal(err)
+	}
+	return o
+}
+
+func monotonicNow() uint64 {
+	var ts unix.Timespec
+	unix.ClockGettime(unix.CLOCK_MONOTONIC, &ts)
+	return uint64(ts.Nano())
+}
+
+func TestOTLPExport(t *testing.T) {
+	c := newTestCollector(t)
+	o := newTestExporter(t, c, OTLPOptions{
+		Owner: func(pid uint32) (uint32, bool) {
+			if pid == 7 {
+				return 0, false
+			}
+			return 100, true
+		},
+		RegistrationLabels: func(owner uint32) map[string]string {
+			return map[string]string{"job": "42", "rank": "3"}
+		},
+	})
+	defer o.Close()
+
+	now := monotonicNow()
+	chunk := NewChunk()
+	chunk.Add(&event.Record{Timestamp: now, Count: 6, PID: 1, TID: 2, FD: 1, Comm: []byte("mpi"), Data: []byte("hello\n")})
+	chunk.Add(&event.Record{Timestamp: now + 1000, Count: 5, PID: 3, TID: 3, FD: 2, Comm: []byte("mpi"), Data: []byte("world")})
+	chunk.Add(&event.Record{Timestamp: now + 2000, Count: 2, PID: 7, TID: 8, FD: 1, Comm: []byte("x\xff"), Data: []byte("\xff\xfe")})
+	if err := o.Write(chunk); err != nil {
+		t.Fatal(err)
+	}
+	resources := c.next()
+
+	host, _ := os.Hostname()
+	if len(resources) != 2 {
+		t.Fatalf("got %d resources, want 2", len(resources))
+	}
+	job, other := resources[0], resources[1]
+	if job.attrs["write_tracer.registration"] != int64(100) || job.attrs["job"] != "42" || job.attrs["rank"] != "3" ||
+		job.attrs["service.name"] != "write-tracer" || job.attrs["host.name"] != host {
+		t.Errorf("registration resource attributes = %v", job.attrs)
+	}
+	if _, ok := other.attrs["write_tracer.registration"]; ok || other.attrs["host.name"] != host || len(other.attrs) != 2 {
+		t.Errorf("unregistered resource attributes = %v", other.attrs)
+	}
+	if job.scope != "write-tracer" || other.scope != "write-tracer" {
+		t.Errorf("scopes = %q, %q", job.scope, other.scope)
+	}
+	if len(job.records) != 2 || len(other.records) != 1 {
+		t.Fatalf("got %d and %d records, want 2 and 1", len(job.records), len(other.records))
+	}
+
+	r0, r1, r2 := job.records[0], job.records[1], other.records[0]
+	if r0.body != "hello" || r1.body != "world" || !bytes.Equal(r2.body.([]byte), []byte("\xff\xfe")) {
+		t.Errorf("bodies = %q, %q, %q", r0.body, r1.body, r2.body)
+	}
+	want := map[string]any{
+		otlpAttrPID: int64(1), otlpAttrTID: int64(2), otlpAttrComm: "mpi", otlpAttrFD: int64(1), otlpAttrCount: int64(6),
+	}
+	for k, v := range want {
+		if r0.attrs[k] != v {
+			t.Errorf("attribute %s = %v, want %v", k, r0.attrs[k], v)
+		}
+	}
+	if r2.attrs[otlpAttrComm] != "x?" {
+		t.Errorf("invalid UTF-8 comm = %q", r2.attrs[otlpAttrComm])
+	}
+
+	// Timestamps keep the spacing of the events, converted to wall-clock
+	// time, close to when they were observed.
+	if r1.ts-r0.ts != 1000 || r2.ts-r0.ts != 2000 {
+		t.Errorf("timestamps %d, %d, %d do not keep the event spacing", r0.ts, r1.ts, r2.ts)
+	}
+	if d := time.Duration(r0.observed - r0.ts); d < 0 || d > time.Second {
+		t.Errorf("timestamp %v before its observation, want under 1s", d)
+	}
+}
+
+func TestParseOTLPPartialSuccess(t *testing.T) {
+	partial := appendPbVarint(nil, 1, 2)
+	partial = appendPbString(partial, 2, "bad records")
+
+	tests := []struct {
+		name     string
+		resp     []byte
+		rejected int
+		msg      string
+	}{
+		{"empty", nil, 0, ""},
+		{"no partial success", appendPbBytes(nil, 1, nil), 0, ""},
+		{"rejected", appendPbBytes(nil, 1, partial), 2, "bad records"},
+		{"message only", appendPbBytes(nil, 1, appendPbString(nil, 2, "warning")), 0, "warning"},
+	}
+	for _, tt := range tests {
+		rejected, msg := parseOTLPPartialSuccess(tt.resp)
+		if rejected != tt.rejected || msg != tt.msg {
+			t.Errorf("%s: got %d %q, want %d %q", tt.name, rejected, msg, tt.rejected, tt.msg)
+		}
+	}
+}
+
+func TestOTLPPartialSuccess(t *testing.T) {
+	c := newTestCollector(t)
+	c.partial = appendPbBytes(nil, 1, appendPbVarint(appendPbString(nil, 2, "bad records"), 1, 1))
+	o := newTestExporter(t, c, OTLPOptions{RetryMaxBytes: 1 << 20})
+
+	chunk := NewChunk()
+	chunk.Add(&event.Record{PID: 1, Data: []byte("a")})
+	chunk.Add(&event.Record{PID: 1, Data: []byte("b")})
+	o.Write(chunk)
+	c.next()
+
+	// The request was accepted: the rejected records are counted, not
+	// retried, and not an error.
+	if err := o.Close(); err != nil {
+		t.Fatal(err)
+	}
+	if n := c.callCount(); n != 1 {
+		t.Errorf("got %d requests, want 1", n)
+	}
+}
+
+func TestOTLPRetry(t *testing.T) {
+	c := newTestCollector(t, http.StatusServiceUnavailable, http.StatusTooManyRequests)
+	o := newTestExporter(t, c, OTLPOptions{BatchBytes: 1, RetryMaxBytes: 1 << 20})
+	defer o.Close()
+
+	write := func(line string) {
+		chunk := NewChunk()
+		chunk.Add(&event.Record{PID: 1, Data: []byte(line)})
+		if err := o.Write(chunk); err != nil {
+			t.Fatal(err)
+		}
+	}
+	write("a")
+	waitFor(t, func() bool { return !o.retry.empty() })
+	// Queued behind the request being retried, to keep the order.
+	write("b")
+
+	for _, want := range []string{"a", "b"} {
+		res := c.next()
+		if got := res[0].records[0].body; got != want {
+			t.Fatalf("got %q, want %q", got, want)
+		}
+	}
+	waitFor(t, o.retry.empty)
+	if n := c.callCount(); n != 4 {
+		t.Errorf("got %d requests, want 4", n)
+	}
+}
+
+func TestOTLPRetryBounded(t *testing.T) {
+	script := make([]int, 100)
+	for i := range script {
+		script[i] = http.StatusServiceUnavailable
+	}
+	c := newTestCollector(t, script...)
+	const maxBytes = 512
+	o := newTestExporter(t, c, OTLPOptions{BatchBytes: 1, RetryMaxBytes: maxBytes})
+	defer o.Close()
+
+	for i := 0; i < 20; i++ {
+		chunk := NewChunk()
+		chunk.Add(&event.Record{PID: 1, Data: bytes.Repeat([]byte{'a' + byte(i)}, 100)})
+		o.Write(chunk)
+	}
+	waitFor(t, func() bool { return c.callCount() >= 2 })
+
+	// The oldest requests were dropped to stay within the limit; the
+	// newest is still waiting.
+	o.retry.mu.Lock()
+	defer o.retry.mu.Unlock()
+	if o.retry.total > maxBytes || len(o.retry.reqs) == 0 || len(o.retry.reqs) >= 20 {
+		t.Errorf("retry queue holds %d requests, %d bytes", len(o.retry.reqs), o.retry.total)
+	}
+	if last := o.retry.reqs[len(o.retry.reqs)-1]; last.seq != o.retry.next-1 {
+		t.Errorf("newest request %d was dropped", o.retry.next-1)
+	}
+}
+
+func TestOTLPNotRetryable(t *testing.T) {
+	c := newTestCollector(t, http.StatusBadRequest, http.StatusInternalServerError)
+	o := newTestExporter(t, c, OTLPOptions{BatchBytes: 1, RetryMaxBytes: 1 << 20})
+	defer o.Close()
+
+	for _, line := range []string{"a", "b"} {
+		chunk := NewChunk()
+		chunk.Add(&event.Record{PID: 1, Data: []byte(line)})
+		o.Write(chunk)
+		waitFor(t, func() bool { return o.errorPending() })
+		if err := o.Write(NewChunk()); err == nil {
+			t.Errorf("status error not returned for %q", line)
+		}
+	}
+	// Statuses other than 429, 502, 503 and 504 are never retried.
+	if !o.retry.empty() || c.callCount() != 2 {
+		t.Errorf("got %d requests, retry queue empty %v", c.callCount(), o.retry.empty())
+	}
+}
+
+// errorPending reports whether an export error waits to be returned.
+func (o *OTLPExporter) errorPending() bool {
+	o.errMu.Lock()
+	defer o.errMu.Unlock()
+	return o.err != nil
+}
+
+func waitFor(t *testing.T, cond func() bool) {
+	t.Helper()
+	deadline := time.Now().Add(5 * time.Second)
+	for !cond() {
+		if time.Now().After(deadline) {
+			t.Fatal("timed out")
+		}
+		time.Sleep(5 * time.Millisecond)
+	}
+}
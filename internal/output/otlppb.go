@@ -0,0 +1,159 @@
+package output
+
+import (
+	"sort"
+	"unicode/utf8"
+)
+
+// Hand-rolled encoder for the OTLP logs protobuf (ExportLogsServiceRequest),
+// to avoid pulling in the OpenTelemetry proto modules for the few messages
+// the exporter writes:
+//
+//	message ExportLogsServiceRequest { repeated ResourceLogs resource_logs = 1; }
+//	message ResourceLogs { Resource resource = 1; repeated ScopeLogs scope_logs = 2; }
+//	message Resource     { repeated KeyValue attributes = 1; }
+//	message ScopeLogs    { InstrumentationScope scope = 1; repeated LogRecord log_records = 2; }
+//	message InstrumentationScope { string name = 1; }
+//	message LogRecord    { fixed64 time_unix_nano = 1; AnyValue body = 5;
+//	                       repeated KeyValue attributes = 6; fixed64 observed_time_unix_nano = 11; }
+//	message KeyValue     { string key = 1; AnyValue value = 2; }
+//	message AnyValue     { oneof value { string string_value = 1; int64 int_value = 3; bytes bytes_value = 7; } }
+//
+// As for Loki, message lengths are computed before the messages are
+// written, so a batch is encoded in one pass over a reused buffer.
+
+// otlpScope is the encoded InstrumentationScope of the exporter.
+var otlpScope = appendPbString(nil, 1, "write-tracer")
+
+// Log record attribute keys, from the OpenTelemetry semantic conventions
+// where there is one.
+const (
+	otlpAttrPID   = "process.pid"
+	otlpAttrTID   = "thread.id"
+	otlpAttrComm  = "process.executable.name"
+	otlpAttrFD    = "write_tracer.fd"
+	otlpAttrCount = "write_tracer.count"
+)
+
+// otlpIntAttrLen is the encoded size of an int KeyValue.
+func otlpIntAttrLen(key string, v uint64) int {
+	return pbFieldLen(len(key)) + pbFieldLen(1+pbVarintLen(v))
+}
+
+// otlpStringAttrLen is the encoded size of a string KeyValue.
+func otlpStringAttrLen(key string, n int) int {
+	return pbFieldLen(len(key)) + pbFieldLen(pbFieldLen(n))
+}
+
+func appendOTLPIntAttr(dst []byte, field int, key string, v uint64) []byte {
+	dst = appendPbLen(dst, field, otlpIntAttrLen(key, v))
+	dst = appendPbString(dst, 1, key)
+	dst = appendPbLen(dst, 2, 1+pbVarintLen(v))
+	return appendPbVarint(dst, 3, v)
+}
+
+func appendOTLPStringAttr(dst []byte, field int, key string, value []byte) []byte {
+	dst = appendPbLen(dst, field, otlpStringAttrLen(key, len(value)))
+	dst = appendPbString(dst, 1, key)
+	dst = appendPbLen(dst, 2, pbFieldLen(len(value)))
+	return appendPbBytes(dst, 1, value)
+}
+
+// appendOTLPResource appends the fields of the Resource of a registration:
+// service.name, host.name, write_tracer.registration and the registration
+// labels, sorted by key. owner is 0 for records of no registration.
+func appendOTLPResource(dst []byte, host string, owner uint32, labels map[string]string) []byte {
+	dst = appendOTLPStringAttr(dst, 1, "service.name", []byte("write-tracer"))
+	if host != "" {
+		dst = appendOTLPStringAttr(dst, 1, "host.name", []byte(host))
+	}
+	if owner != 0 {
+		dst = appendOTLPIntAttr(dst, 1, "write_tracer.registration", uint64(owner))
+	}
+	keys := make([]string, 0, len(labels))
+	for k := range labels {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+	for _, k := range keys {
+		dst = appendOTLPStringAttr(dst, 1, k, []byte(labels[k]))
+	}
+	return dst
+}
+
+// otlpRecordLen is the encoded size of a LogRecord.
+func otlpRecordLen(r *otlpRecord) int {
+	n := 2 * (1 + 8) // timestamps
+	n += pbFieldLen(pbFieldLen(r.lineN))
+	n += pbFieldLen(otlpIntAttrLen(otlpAttrPID, uint64(r.pid)))
+	n += pbFieldLen(otlpIntAttrLen(otlpAttrTID, uint64(r.tid)))
+	if r.commN > 0 {
+		n += pbFieldLen(otlpStringAttrLen(otlpAttrComm, r.commN))
+	}
+	n += pbFieldLen(otlpIntAttrLen(otlpAttrFD, uint64(r.fd)))
+	n += pbFieldLen(otlpIntAttrLen(otlpAttrCount, r.count))
+	return n
+}
+
+// appendOTLPLogs appends the ExportLogsServiceRequest of batch b to dst.
+func appendOTLPLogs(dst []byte, b *otlpBatch) []byte {
+	for i := range b.resources {
+		res := &b.resources[i]
+
+		scopeLogs := pbFieldLen(len(otlpScope))
+		for j := range res.records {
+			scopeLogs += pbFieldLen(otlpRecordLen(&res.records[j]))
+		}
+		dst = appendPbLen(dst, 1, pbFieldLen(len(res.resource))+pbFieldLen(scopeLogs))
+		dst = appendPbBytes(dst, 1, res.resource)
+		dst = appendPbLen(dst, 2, scopeLogs)
+		dst = appendPbBytes(dst, 1, otlpScope)
+
+		for j := range res.records {
+			r := &res.records[j]
+			comm := b.data[r.off : r.off+r.commN]
+			line := b.data[r.off+r.commN : r.off+r.commN+r.lineN]
+
+			dst = appendPbLen(dst, 2, otlpRecordLen(r))
+			dst = appendPbFixed64(dst, 1, r.ts)
+			// Strings must be valid UTF-8; other payloads go as bytes.
+			dst = appendPbLen(dst, 5, pbFieldLen(len(line)))
+			if utf8.Valid(line) {
+				dst = appendPbBytes(dst, 1, line)
+			} else {
+				dst = appendPbBytes(dst, 7, line)
+			}
+			dst = appendOTLPIntAttr(dst, 6, otlpAttrPID, uint64(r.pid))
+			dst = appendOTLPIntAttr(dst, 6, otlpAttrTID, uint64(r.tid))
+			if len(comm) > 0 {
+				dst = appendOTLPStringAttr(dst, 6, otlpAttrComm, comm)
+			}
+			dst = appendOTLPIntAttr(dst, 6, otlpAttrFD, uint64(r.fd))
+			dst = appendOTLPIntAttr(dst, 6, otlpAttrCount, r.count)
+			dst = appendPbFixed64(dst, 11, r.observed)
+		}
+	}
+	return dst
+}
+
+// parseOTLPPartialSuccess returns the number of log records rejected by a
+// collector, and its message, from an ExportLogsServiceResponse:
+//
+//	message ExportLogsServiceResponse { ExportLogsPartialSuccess partial_success = 1; }
+//	message ExportLogsPartialSuccess  { int64 rejected_log_records = 1; string error_message = 2; }
+func parseOTLPPartialSuccess(resp []byte) (rejected int, msg string) {
+	pbWalk(resp, func(field int, _ uint64, partial []byte) {
+		if field != 1 || partial == nil {
+			return
+		}
+		pbWalk(partial, func(field int, v uint64, data []byte) {
+			switch field {
+			case 1:
+				rejected = int(v)
+			case 2:
+				msg = string(data)
+			}
+		})
+	})
+	return rejected, msg
+}
@@ -0,0 +1,157 @@
+package output
+
+import (
+	"log/slog"
+	"sync"
+	"time"
+)
+
+// otlpRetryQueue holds, in memory, the OTLP export requests that failed
+// with a retryable error, and a goroutine resends them oldest first,
+// backing off while the collector stays unavailable. While the queue is not
+// empty, new requests are queued behind the pending ones, so a recovering
+// collector is not flooded. Beyond maxBytes, the oldest requests are
+// dropped; with maxBytes 0, failed requests are dropped at once.
+type otlpRetryQueue struct {
+	mu       sync.Mutex
+	reqs     []otlpRetryRequest // oldest first
+	next     uint64
+	total    int64
+	maxBytes int64
+
+	send func(body []byte) error
+	wake chan struct{}
+	stop chan struct{}
+	done chan struct{}
+}
+
+type otlpRetryRequest struct {
+	seq  uint64
+	body []byte
+}
+
+func newOTLPRetryQueue(maxBytes int64, send func(body []byte) error) *otlpRetryQueue {
+	q := &otlpRetryQueue{
+		maxBytes: maxBytes,
+		send:     send,
+		wake:     make(chan struct{}, 1),
+		stop:     make(chan struct{}),
+		done:     make(chan struct{}),
+	}
+	go q.run()
+	return q
+}
+
+// empty reports whether no request waits to be retried.
+func (q *otlpRetryQueue) empty() bool {
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	return len(q.reqs) == 0
+}
+
+// put queues a copy of a request for retry.
+func (q *otlpRetryQueue) put(body []byte) {
+	if int64(len(body)) > q.maxBytes {
+		addOTLPDropped(1)
+		return
+	}
+	req := append([]byte(nil), body...)
+
+	q.mu.Lock()
+	if len(q.reqs) == 0 {
+		slog.Warn("OTLP collector unavailable, retrying export requests")
+	}
+	q.reqs = append(q.reqs, otlpRetryRequest{seq: q.next, body: req})
+	q.next++
+	q.total += int64(len(req))
+	for q.total > q.maxBytes {
+		q.remove()
+		addOTLPDropped(1)
+	}
+	setOTLPRetry(len(q.reqs), q.total)
+	q.mu.Unlock()
+
+	select {
+	case q.wake <- struct{}{}:
+	default:
+	}
+}
+
+// remove drops the oldest request. q.mu must be held.
+func (q *otlpRetryQueue) remove() {
+	q.total -= int64(len(q.reqs[0].body))
+	q.reqs[0].body = nil
+	q.reqs = q.reqs[1:]
+}
+
+// run resends the queued requests, oldest first, until stopped.
+func (q *otlpRetryQueue) run() {
+	defer close(q.done)
+
+	attempt := 0
+	for {
+		q.mu.Lock()
+		var head otlpRetryRequest
+		pending := len(q.reqs) > 0
+		if pending {
+			head = q.reqs[0]
+		}
+		q.mu.Unlock()
+
+		if !pending {
+			select {
+			case <-q.stop:
+				return
+			case <-q.wake:
+				continue
+			}
+		}
+
+		err := q.send(head.body)
+		if err != nil && otlpRetryable(err) {
+			attempt++
+			select {
+			case <-q.stop:
+				return
+			case <-time.After(retryDelay(attempt, err)):
+			}
+			continue
+		}
+		if err != nil {
+			slog.Warn("OTLP collector rejected retried request, dropping it", "error", err)
+			addOTLPDropped(1)
+		}
+		attempt = 0
+
+		q.mu.Lock()
+		// The head may have been dropped meanwhile to make room.
+		if len(q.reqs) > 0 && q.reqs[0].seq == head.seq {
+			q.remove()
+		}
+		if len(q.reqs) == 0 {
+			slog.Info("OTLP export requests retried")
+		}
+		setOTLPRetry(len(q.reqs), q.total)
+		q.mu.Unlock()
+	}
+}
+
+// close stops the retries and sends the pending requests once more, until
+// one fails; the rest are dropped.
+func (q *otlpRetryQueue) close() {
+	close(q.stop)
+	<-q.done
+
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	for len(q.reqs) > 0 {
+		if err := q.send(q.reqs[0].body); err != nil {
+			addOTLPDropped(len(q.reqs))
+			slog.Warn("Dropping OTLP export requests at shutdown", "requests", len(q.reqs), "error", err)
+			q.reqs, q.total = nil, 0
+			break
+		}
+		q.remove()
+	}
+	setOTLPRetry(0, 0)
+}
@@ -0,0 +1,134 @@
+package output
+
+import (
+	"bufio"
+	"fmt"
+	"os"
+	"sync"
+	"time"
+
+	"write-tracer/internal/parquet"
+)
+
+// ParquetWriter is a sink writing records to Parquet files. It rotates and
+// retains files on the same policy as FileWriter, in sequence-numbered
+// segments; size and age limits are checked as records are written. A file
+// only becomes readable once its footer is written, on rotation or Close.
+type ParquetWriter struct {
+	mu           sync.Mutex
+	codecs       parquet.Codecs
+	rowGroupRows int
+	rotation     Rotation
+	segs         *segmentSet
+	file         *os.File
+	seq          uint64
+	opened       time.Time
+	buf          *bufio.Writer
+	pw           *parquet.Writer
+	count        int
+}
+
+// NewParquetWriter creates a Parquet sink. compression is parsed with
+// parquet.ParseCodecs.
+func NewParquetWriter(path, compression string, rowGroupRows int, rotation Rotation) (*ParquetWriter, error) {
+	codecs, err := parquet.ParseCodecs(compression)
+	if err != nil {
+		return nil, err
+	}
+	segs, err := openSegmentSet(path, "", rotation.MaxBackups, rotation.MaxTotalBytes)
+	if err != nil {
+		return nil, err
+	}
+	return &ParquetWriter{
+		codecs:       codecs,
+		rowGroupRows: rowGroupRows,
+		rotation:     rotation,
+		segs:         segs,
+	}, nil
+}
+
+// Name implements Sink.
+func (w *ParquetWriter) Name() string {
+	return "parquet"
+}
+
+// Write adds the records of a chunk to the current row group, rotating the
+// file when it reaches a rotation limit.
+func (w *ParquetWriter) Write(c *Chunk) error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+
+	for i := range c.Records {
+		if w.pw == nil {
+			if err := w.open(); err != nil {
+				return err
+			}
+		}
+		if err := w.pw.Write(&c.Records[i]); err != nil {
+			return err
+		}
+
+		w.count++
+		if w.full() {
+			if err := w.finish(); err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
+
+// Close writes the pending row group and the footer.
+func (w *ParquetWriter) Close() error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	return w.finish()
+}
+
+func (w *ParquetWriter) full() bool {
+	r := &w.rotation
+	return (r.MaxRecords > 0 && w.count >= r.MaxRecords) ||
+		(r.MaxBytes > 0 && w.pw.Size() >= r.MaxBytes) ||
+		(r.MaxAge > 0 && time.Since(w.opened) >= r.MaxAge)
+}
+
+func (w *ParquetWriter) open() error {
+	f, seq, err := w.segs.create()
+	if err != nil {
+		return err
+	}
+	if w.buf == nil {
+		w.buf = bufio.NewWriterSize(f, 1<<20)
+	} else {
+		w.buf.Reset(f)
+	}
+	pw, err := parquet.NewWriter(w.buf, w.codecs, w.rowGroupRows)
+	if err != nil {
+		f.Close()
+		return err
+	}
+	w.file, w.seq, w.opened, w.pw, w.count = f, seq, time.Now(), pw, 0
+	return nil
+}
+
+// finish completes the current file; the next write starts a new segment.
+func (w *ParquetWriter) finish() error {
+	if w.pw == nil {
+		return nil
+	}
+
+	err := w.pw.Close()
+	if err == nil {
+		err = w.buf.Flush()
+	}
+	size := w.pw.Size()
+	if cerr := w.file.Close(); err == nil {
+		err = cerr
+	}
+	w.segs.add(w.seq, size)
+	w.file, w.pw = nil, nil
+	if err != nil {
+		return fmt.Errorf("failed to finish parquet file %s: %w", w.segs.name(w.seq), err)
+	}
+	return nil
+}
@@ -0,0 +1,94 @@
+package output
+
+import (
+	"encoding/binary"
+	"math/bits"
+)
+
+// Protobuf wire format helpers shared by the hand-rolled encoders of the
+// Loki and OTLP sinks. Field numbers are below 16, so tags fit in a byte.
+
+const (
+	pbVarint  = 0
+	pbFixed64 = 1
+	pbBytes   = 2
+)
+
+func pbTag(field, wireType int) byte {
+	return byte(field<<3 | wireType)
+}
+
+func pbVarintLen(v uint64) int {
+	return (bits.Len64(v|1) + 6) / 7
+}
+
+// pbFieldLen is the encoded size of a length-delimited field of n bytes
+// with a one byte tag.
+func pbFieldLen(n int) int {
+	return 1 + pbVarintLen(uint64(n)) + n
+}
+
+// appendPbBytes appends a length-delimited field.
+func appendPbBytes(dst []byte, field int, data []byte) []byte {
+	dst = append(dst, pbTag(field, pbBytes))
+	dst = binary.AppendUvarint(dst, uint64(len(data)))
+	return append(dst, data...)
+}
+
+// appendPbString appends a string field.
+func appendPbString(dst []byte, field int, s string) []byte {
+	dst = append(dst, pbTag(field, pbBytes))
+	dst = binary.AppendUvarint(dst, uint64(len(s)))
+	return append(dst, s...)
+}
+
+// appendPbLen appends the tag and length of an embedded message of n bytes,
+// to be followed by its fields.
+func appendPbLen(dst []byte, field, n int) []byte {
+	dst = append(dst, pbTag(field, pbBytes))
+	return binary.AppendUvarint(dst, uint64(n))
+}
+
+// appendPbVarint appends a varint field.
+func appendPbVarint(dst []byte, field int, v uint64) []byte {
+	dst = append(dst, pbTag(field, pbVarint))
+	return binary.AppendUvarint(dst, v)
+}
+
+// appendPbFixed64 appends a fixed64 field.
+func appendPbFixed64(dst []byte, field int, v uint64) []byte {
+	dst = append(dst, pbTag(field, pbFixed64))
+	return binary.LittleEndian.AppendUint64(dst, v)
+}
+
+// pbWalk calls fn with each varint field of msg and its value, and each
+// length-delimited field and its data (never nil). It stops at the first
+// malformed field or other wire type and reports whether msg was walked
+// to the end.
+func pbWalk(msg []byte, fn func(field int, v uint64, data []byte)) bool {
+	for len(msg) > 0 {
+		tag, n := binary.Uvarint(msg)
+		if n <= 0 {
+			return false
+		}
+		msg = msg[n:]
+		v, n := binary.Uvarint(msg)
+		if n <= 0 {
+			return false
+		}
+		msg = msg[n:]
+		switch tag & 7 {
+		case pbVarint:
+			fn(int(tag>>3), v, nil)
+		case pbBytes:
+			if uint64(len(msg)) < v {
+				return false
+			}
+			fn(int(tag>>3), 0, msg[:v:v])
+			msg = msg[v:]
+		default:
+			return false
+		}
+	}
+	return true
+}
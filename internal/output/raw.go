@@ -0,0 +1,63 @@
+package output
+
+import (
+	"fmt"
+
+	"write-tracer/internal/event"
+)
+
+// RawWriter is a sink writing the captured payload of every record, as is,
+// to one file per process and file descriptor: a tee of what the traced
+// processes wrote, without any encoding. Payloads longer than the capture
+// size are truncated, as in every other output.
+//
+// With an index, each segment has a sidecar of little-endian (timestamp,
+// offset) uint64 pairs, one every indexBytes bytes of payload, so readers
+// can seek a segment by time.
+type RawWriter struct {
+	files *streamFiles
+}
+
+// NewRawWriter creates a raw sink writing to <dir>/pid-<pid>-fd-<fd>.raw
+// segments. owner maps a PID to the registration it belongs to, whose end
+// releases its streams; nil releases them by PID. indexBytes > 0 enables the
+// timestamp index.
+func NewRawWriter(dir string, maxOpen int, rotation Rotation, indexBytes int64, owner func(pid uint32) uint32) (*RawWriter, error) {
+	base := func(k uint64) string { return fmt.Sprintf("pid-%d-fd-%d", k>>32, uint32(k)) }
+	files, err := openStreamFiles("raw", dir, "pid", ".raw", base, owner, maxOpen, rotation, indexBytes)
+	if err != nil {
+		return nil, err
+	}
+	return &RawWriter{files: files}, nil
+}
+
+// Name implements Sink.
+func (w *RawWriter) Name() string {
+	return "raw"
+}
+
+// Write appends the payload of every record of a chunk to the file of its
+// process and file descriptor.
+func (w *RawWriter) Write(c *Chunk) error {
+	return w.files.writeChunk(c, rawKey, appendRaw)
+}
+
+// Release closes the files of the processes of registration owner, itself
+// and its descendants. Later records of these processes start a new
+// segment. It is called when a registration ends.
+func (w *RawWriter) Release(owner uint32) {
+	w.files.release(owner)
+}
+
+// Close seals every stream and closes its file.
+func (w *RawWriter) Close() error {
+	return w.files.close()
+}
+
+func rawKey(rec *event.Record) uint64 {
+	return uint64(rec.PID)<<32 | uint64(rec.FD)
+}
+
+func appendRaw(dst []byte, rec *event.Record) []byte {
+	return append(dst, rec.Data...)
+}
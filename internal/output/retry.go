@@ -0,0 +1,69 @@
+package output
+
+import (
+	"errors"
+	"fmt"
+	"math/rand"
+	"net/http"
+	"strconv"
+	"time"
+)
+
+// retryBackoffMin and retryBackoffMax bound the delay between two attempts
+// to send the same request to Loki or an OTLP collector.
+const (
+	retryBackoffMin = 500 * time.Millisecond
+	retryBackoffMax = 30 * time.Second
+)
+
+// statusError is a request rejected by a server with a non-2xx status.
+type statusError struct {
+	server     string
+	code       int
+	body       string
+	retryAfter time.Duration // from the Retry-After header, 0 if absent
+}
+
+func (e *statusError) Error() string {
+	return fmt.Sprintf("%s returned status %d: %s", e.server, e.code, e.body)
+}
+
+// newStatusError returns the error of a response with a non-2xx status.
+func newStatusError(server string, resp *http.Response, body []byte) *statusError {
+	e := &statusError{server: server, code: resp.StatusCode, body: string(body)}
+	if secs, err := strconv.Atoi(resp.Header.Get("Retry-After")); err == nil && secs > 0 {
+		e.retryAfter = min(time.Duration(secs)*time.Second, retryBackoffMax)
+	}
+	return e
+}
+
+// retryable reports whether a failed push may succeed later: transport
+// errors, rate limiting and server errors are, other rejections are not.
+func retryable(err error) bool {
+	var status *statusError
+	if errors.As(err, &status) {
+		return status.code == http.StatusTooManyRequests || status.code >= 500
+	}
+	return true
+}
+
+// backoff returns the delay before attempt n (from 1) of a request,
+// doubling from retryBackoffMin up to retryBackoffMax, with jitter.
+func backoff(n int) time.Duration {
+	d := retryBackoffMax
+	if n < 16 {
+		d = min(retryBackoffMin<<(n-1), retryBackoffMax)
+	}
+	return d/2 + time.Duration(rand.Int63n(int64(d/2)))
+}
+
+// retryDelay returns the delay before attempt n after err: the backoff, or
+// longer if the server asked for it.
+func retryDelay(n int, err error) time.Duration {
+	d := backoff(n)
+	var status *statusError
+	if errors.As(err, &status) {
+		d = max(d, status.retryAfter)
+	}
+	return d
+}
@@ -0,0 +1,174 @@
+package output
+
+import (
+	"errors"
+	"fmt"
+	"io"
+	"io/fs"
+	"log/slog"
+	"os"
+	"runtime"
+	"sync"
+	"time"
+
+	"write-tracer/internal/queue"
+
+	"github.com/klauspost/compress/zstd"
+	"golang.org/x/sys/unix"
+)
+
+const (
+	// rotatedQueueDepth bounds the rotated segments waiting for compression.
+	// Segments that do not fit stay uncompressed until the next start.
+	rotatedQueueDepth = 64
+
+	// ioprio_set(2) arguments for the idle I/O scheduling class.
+	ioprioWhoProcess = 1
+	ioprioClassIdle  = 3
+	ioprioClassShift = 13
+)
+
+// rotatedCompressor compresses rotated segments on a bounded pool of workers,
+// away from the write path. Each worker runs on its own OS thread in the idle
+// I/O scheduling class and uses a multithreaded zstd encoder. A compressed
+// segment atomically replaces the original in the segment set, which keeps
+// the retention index in step.
+type rotatedCompressor struct {
+	segs    *segmentSet
+	level   int
+	threads int
+	jobs    chan uint64
+	stop    chan struct{}
+	wg      sync.WaitGroup
+	log     *queue.LogLimiter
+}
+
+// newRotatedCompressor starts workers compressing the segments of segs at the
+// given zstd level (0 for the default) with threads encoder goroutines each.
+// Segments left uncompressed by a previous run are queued right away.
+func newRotatedCompressor(segs *segmentSet, workers, threads, level int) *rotatedCompressor {
+	c := &rotatedCompressor{
+		segs:    segs,
+		level:   level,
+		threads: max(threads, 1),
+		jobs:    make(chan uint64, rotatedQueueDepth),
+		stop:    make(chan struct{}),
+		log:     queue.NewLogLimiter(5 * time.Second),
+	}
+	for i := 0; i < max(workers, 1); i++ {
+		c.wg.Add(1)
+		go c.worker()
+	}
+	for _, seq := range segs.uncompressed() {
+		c.submit(seq)
+	}
+	return c
+}
+
+// submit queues a rotated segment without blocking.
+func (c *rotatedCompressor) submit(seq uint64) {
+	select {
+	case c.jobs <- seq:
+	default:
+		if suppressed, ok := c.log.Allow(); ok {
+			slog.Warn("Rotated segment compression queue full, leaving segment uncompressed",
+				"path", c.segs.name(seq), "suppressed_warnings", suppressed)
+		}
+	}
+}
+
+// close waits for the segments being compressed and abandons the queued
+// ones, which are picked up again on the next start.
+func (c *rotatedCompressor) close() {
+	close(c.stop)
+	c.wg.Wait()
+}
+
+func (c *rotatedCompressor) worker() {
+	defer c.wg.Done()
+
+	// The thread keeps its idle I/O priority until it exits, which it does
+	// when the goroutine returns while still locked.
+	runtime.LockOSThread()
+	if err := setIdleIOPriority(); err != nil {
+		slog.Warn("Failed to lower I/O priority of segment compression", "error", err)
+	}
+
+	opts := []zstd.EOption{zstd.WithEncoderConcurrency(c.threads)}
+	if c.level != 0 {
+		opts = append(opts, zstd.WithEncoderLevel(zstd.EncoderLevelFromZstd(c.level)))
+	}
+	enc, err := zstd.NewWriter(nil, opts...)
+	if err != nil {
+		slog.Error("Failed to create zstd encoder for rotated segments", "error", err)
+		return
+	}
+	defer enc.Close()
+
+	for {
+		select {
+		case <-c.stop:
+			return
+		case seq := <-c.jobs:
+			if err := c.compress(enc, seq); err != nil {
+				if errors.Is(err, fs.ErrNotExist) {
+					continue // removed by retention meanwhile
+				}
+				slog.Warn("Failed to compress rotated segment", "path", c.segs.name(seq), "error", err)
+				continue
+			}
+			AddCompressedSegments(1)
+		}
+	}
+}
+
+// compress writes segment seq to a temporary .zst file, syncs it and hands
+// it to the segment set to replace the original.
+func (c *rotatedCompressor) compress(enc *zstd.Encoder, seq uint64) error {
+	name := c.segs.name(seq)
+	in, err := os.Open(name)
+	if err != nil {
+		return err
+	}
+	defer in.Close()
+
+	tmp := name + compressedExt + tmpExt
+	out, err := os.OpenFile(tmp, os.O_CREATE|os.O_EXCL|os.O_WRONLY, 0644)
+	if err != nil {
+		return err
+	}
+
+	enc.Reset(out)
+	_, err = io.Copy(enc, in)
+	if cerr := enc.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = out.Sync()
+	}
+	var size int64
+	if err == nil {
+		var info os.FileInfo
+		if info, err = out.Stat(); err == nil {
+			size = info.Size()
+		}
+	}
+	if cerr := out.Close(); err == nil {
+		err = cerr
+	}
+	if err != nil {
+		os.Remove(tmp)
+		return fmt.Errorf("failed to write %s: %w", tmp, err)
+	}
+	return c.segs.replaceCompressed(seq, tmp, size)
+}
+
+// setIdleIOPriority moves the calling thread to the idle I/O scheduling
+// class, so its disk reads only proceed when the disk is otherwise idle.
+func setIdleIOPriority() error {
+	_, _, errno := unix.Syscall(unix.SYS_IOPRIO_SET, ioprioWhoProcess, 0, ioprioClassIdle<<ioprioClassShift)
+	if errno != 0 {
+		return errno
+	}
+	return nil
+}
@@ -0,0 +1,174 @@
+package output
+
+import (
+	"bytes"
+	"fmt"
+	"os"
+	"path/filepath"
+	"strings"
+	"testing"
+
+	"github.com/klauspost/compress/zstd"
+)
+
+// writeTestSegment writes and closes the next segment of s.
+func writeTestSegment(t *testing.T, s *segmentSet, data []byte) uint64 {
+	t.Helper()
+	f, seq, err := s.create()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if _, err := f.Write(data); err != nil {
+		t.Fatal(err)
+	}
+	if err := f.Close(); err != nil {
+		t.Fatal(err)
+	}
+	s.add(seq, int64(len(data)))
+	return seq
+}
+
+func testSegmentData(seq uint64) []byte {
+	return bytes.Repeat([]byte(fmt.Sprintf("segment %d\n", seq)), 1000)
+}
+
+// checkCompressedSegment checks that segment seq of s is compressed and
+// holds testSegmentData.
+func checkCompressedSegment(t *testing.T, s *segmentSet, seq uint64) {
+	t.Helper()
+	b, err := os.ReadFile(s.name(seq) + compressedExt)
+	if err != nil {
+		t.Fatal(err)
+	}
+	dec, err := zstd.NewReader(nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer dec.Close()
+	data, err := dec.DecodeAll(b, nil)
+	if err != nil {
+		t.Fatalf("segment %d: %v", seq, err)
+	}
+	if !bytes.Equal(data, testSegmentData(seq)) {
+		t.Errorf("segment %d decompresses to %d bytes, want %d", seq, len(data), len(testSegmentData(seq)))
+	}
+}
+
+func TestRotatedCompressor(t *testing.T) {
+	dir := t.TempDir()
+	path := filepath.Join(dir, "t.log")
+
+	// An earlier run left segments 1 and 3 uncompressed, and was
+	// interrupted compressing segment 3.
+	enc, err := zstd.NewWriter(nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	files := map[string][]byte{
+		path + ".00000001":                          testSegmentData(1),
+		path + ".00000002" + compressedExt:          enc.EncodeAll(testSegmentData(2), nil),
+		path + ".00000003":                          testSegmentData(3),
+		path + ".00000003" + compressedExt + tmpExt: []byte("partial"),
+	}
+	enc.Close()
+	for name, data := range files {
+		if err := os.WriteFile(name, data, 0644); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	s, err := openSegmentSet(path, "", 0, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	c := newRotatedCompressor(s, 2, 1, 0)
+	c.submit(writeTestSegment(t, s, testSegmentData(4)))
+	waitFor(t, func() bool { return len(s.uncompressed()) == 0 })
+	c.close()
+
+	want := []string{"t.log.00000001.zst", "t.log.00000002.zst", "t.log.00000003.zst", "t.log.00000004.zst"}
+	if names := dirNames(t, dir); fmt.Sprint(names) != fmt.Sprint(want) {
+		t.Errorf("files = %v, want %v", names, want)
+	}
+	for seq := uint64(1); seq <= 4; seq++ {
+		checkCompressedSegment(t, s, seq)
+	}
+	checkSegmentIndex(t, s)
+}
+
+func TestRotatedCompressorRetention(t *testing.T) {
+	t.Run("removed while compressed", func(t *testing.T) {
+		dir := t.TempDir()
+		s, err := openSegmentSet(filepath.Join(dir, "t.log"), "", 1, 0)
+		if err != nil {
+			t.Fatal(err)
+		}
+		seq := writeTestSegment(t, s, testSegmentData(1))
+		// The compressed copy is written, then retention removes the
+		// segment before it replaces the original.
+		tmp := s.name(seq) + compressedExt + tmpExt
+		if err := os.WriteFile(tmp, []byte("compressed"), 0644); err != nil {
+			t.Fatal(err)
+		}
+		writeTestSegment(t, s, testSegmentData(2))
+		if err := s.replaceCompressed(seq, tmp, 10); err != nil {
+			t.Fatal(err)
+		}
+		want := []string{"t.log.00000002"}
+		if names := dirNames(t, dir); fmt.Sprint(names) != fmt.Sprint(want) {
+			t.Errorf("files = %v, want %v", names, want)
+		}
+		checkSegmentIndex(t, s)
+	})
+
+	t.Run("removed before compressed", func(t *testing.T) {
+		dir := t.TempDir()
+		s, err := openSegmentSet(filepath.Join(dir, "t.log"), "", 1, 0)
+		if err != nil {
+			t.Fatal(err)
+		}
+		c := newRotatedCompressor(s, 1, 1, 0)
+		first := writeTestSegment(t, s, testSegmentData(1))
+		second := writeTestSegment(t, s, testSegmentData(2))
+		c.submit(first)
+		c.submit(second)
+		waitFor(t, func() bool { return len(s.uncompressed()) == 0 })
+		c.close()
+		want := []string{"t.log.00000002.zst"}
+		if names := dirNames(t, dir); fmt.Sprint(names) != fmt.Sprint(want) {
+			t.Errorf("files = %v, want %v", names, want)
+		}
+		checkCompressedSegment(t, s, second)
+		checkSegmentIndex(t, s)
+	})
+
+	t.Run("concurrent", func(t *testing.T) {
+		// Segments rotate while older ones are compressed and removed.
+		const maxFiles, segments = 2, 40
+		dir := t.TempDir()
+		s, err := openSegmentSet(filepath.Join(dir, "t.log"), "", maxFiles, 0)
+		if err != nil {
+			t.Fatal(err)
+		}
+		c := newRotatedCompressor(s, 2, 1, 0)
+		for i := 0; i < segments; i++ {
+			c.submit(writeTestSegment(t, s, testSegmentData(uint64(i+1))))
+		}
+		waitFor(t, func() bool { return len(s.uncompressed()) == 0 })
+		c.close()
+
+		names := dirNames(t, dir)
+		if len(names) != maxFiles {
+			t.Errorf("files = %v, want %d segments", names, maxFiles)
+		}
+		for _, name := range names {
+			if strings.HasSuffix(name, tmpExt) {
+				t.Errorf("%s left behind", name)
+			}
+		}
+		for seq := uint64(segments - maxFiles + 1); seq <= segments; seq++ {
+			checkCompressedSegment(t, s, seq)
+		}
+		checkSegmentIndex(t, s)
+	})
+}
@@ -0,0 +1,225 @@
+package output
+
+import (
+	"errors"
+	"fmt"
+	"io/fs"
+	"log/slog"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+)
+
+// segment is one file of a segmentSet.
+type segment struct {
+	seq  uint64
+	size int64
+	ext  string // compressedExt once compressed after rotation
+}
+
+const (
+	// compressedExt is the suffix of segments compressed after rotation.
+	compressedExt = ".zst"
+	// tmpExt is the suffix of a compressed segment being written.
+	tmpExt = ".tmp"
+)
+
+// segmentSet names and retains the files of a rotating output. Files are
+// named <path>.<seq><suffix> with a monotonically increasing, zero-padded
+// sequence number, so rotating is a single create and never renames older files. The
+// closed segments are tracked in memory, oldest first; the directory is only
+// scanned once, when the set is opened, to pick up the segments of previous
+// runs. A segmentSet is safe for concurrent use, so that rotated segments can
+// be compressed in the background.
+type segmentSet struct {
+	mu       sync.Mutex
+	path     string
+	suffix   string // extension of compressed output, after the sequence number
+	maxFiles int    // closed segments to keep, 0 for no limit
+	maxBytes int64  // total size of closed segments to keep, 0 for no limit
+	sidecar  string // suffix of a file removed along with each segment, if any
+
+	next   uint64
+	closed []segment
+	total  int64
+}
+
+// segmentDigits is the zero padding of sequence numbers, so lexical and
+// numeric order match.
+const segmentDigits = 8
+
+// openSegmentSet opens the segments of path. suffix, such as ".zst", ends
+// the name of every segment of a compressed output, so that tools recognise
+// them; segments of such outputs are not compressed after rotation.
+func openSegmentSet(path, suffix string, maxFiles int, maxBytes int64) (*segmentSet, error) {
+	entries, err := os.ReadDir(filepath.Dir(path))
+	if err != nil && !errors.Is(err, fs.ErrNotExist) {
+		return nil, fmt.Errorf("failed to scan segments of %s: %w", path, err)
+	}
+	return newSegmentSet(path, suffix, maxFiles, maxBytes, entries), nil
+}
+
+// newSegmentSet creates a segmentSet from entries of its directory, sorted by
+// name. entries may hold only the files of this set, so that callers creating
+// many sets in one directory scan it once.
+func newSegmentSet(path, suffix string, maxFiles int, maxBytes int64, entries []fs.DirEntry) *segmentSet {
+	s := &segmentSet{path: path, suffix: suffix, maxFiles: maxFiles, maxBytes: maxBytes, next: 1}
+	dir := filepath.Dir(path)
+
+	// Entries are sorted by name, so a segment comes right before its
+	// compressed copy.
+	prefix := filepath.Base(path) + "."
+	for _, entry := range entries {
+		name := entry.Name()
+		if !entry.Type().IsRegular() || !strings.HasPrefix(name, prefix) {
+			continue
+		}
+		ext := ""
+		if suffix != "" {
+			trimmed, ok := strings.CutSuffix(name, suffix)
+			if !ok {
+				continue
+			}
+			name = trimmed
+		} else if trimmed, ok := strings.CutSuffix(name, compressedExt+tmpExt); ok {
+			// Left behind by an interrupted background compression.
+			if _, ok := segmentSeq(trimmed, prefix); ok {
+				os.Remove(filepath.Join(dir, name))
+			}
+			continue
+		} else if trimmed, ok := strings.CutSuffix(name, compressedExt); ok {
+			name, ext = trimmed, compressedExt
+		}
+		seq, ok := segmentSeq(name, prefix)
+		if !ok {
+			continue
+		}
+		info, err := entry.Info()
+		if err != nil {
+			continue
+		}
+
+		seg := segment{seq: seq, size: info.Size(), ext: ext}
+		if n := len(s.closed); n > 0 && s.closed[n-1].seq == seq {
+			// A crash between the rename of the compressed copy and the
+			// removal of the original: keep the compressed copy.
+			os.Remove(s.name(seq))
+			s.total -= s.closed[n-1].size
+			s.closed[n-1] = seg
+		} else {
+			s.closed = append(s.closed, seg)
+		}
+		s.total += seg.size
+		s.next = max(s.next, seq+1)
+	}
+	sort.Slice(s.closed, func(i, j int) bool { return s.closed[i].seq < s.closed[j].seq })
+
+	s.enforce()
+	return s
+}
+
+// segmentSeq parses the sequence number of a segment file name.
+func segmentSeq(name, prefix string) (uint64, bool) {
+	suffix, ok := strings.CutPrefix(name, prefix)
+	if !ok || suffix == "" {
+		return 0, false
+	}
+	seq, err := strconv.ParseUint(suffix, 10, 64)
+	return seq, err == nil
+}
+
+// name returns the file name of segment seq, before any compression after
+// rotation.
+func (s *segmentSet) name(seq uint64) string {
+	return s.stem(seq) + s.suffix
+}
+
+// stem returns the name of segment seq without its suffix, that sidecar
+// files are named after.
+func (s *segmentSet) stem(seq uint64) string {
+	return fmt.Sprintf("%s.%0*d", s.path, segmentDigits, seq)
+}
+
+// create creates the next segment.
+func (s *segmentSet) create() (*os.File, uint64, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	seq := s.next
+	f, err := os.OpenFile(s.name(seq), os.O_CREATE|os.O_EXCL|os.O_WRONLY|os.O_APPEND, 0644)
+	if err != nil {
+		return nil, 0, err
+	}
+	s.next++
+	return f, seq, nil
+}
+
+// add records a closed segment and removes the oldest segments beyond the
+// retention limits.
+func (s *segmentSet) add(seq uint64, size int64) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	s.closed = append(s.closed, segment{seq: seq, size: size})
+	s.total += size
+	s.enforce()
+}
+
+// uncompressed returns the closed segments not compressed yet, oldest first.
+func (s *segmentSet) uncompressed() []uint64 {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	var seqs []uint64
+	for _, seg := range s.closed {
+		if seg.ext == "" {
+			seqs = append(seqs, seg.seq)
+		}
+	}
+	return seqs
+}
+
+// replaceCompressed swaps segment seq for its compressed copy tmp: tmp is
+// renamed into place, the original removed and the index updated. If
+// retention removed the segment in the meantime, tmp is discarded instead.
+func (s *segmentSet) replaceCompressed(seq uint64, tmp string, size int64) error {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	i := sort.Search(len(s.closed), func(i int) bool { return s.closed[i].seq >= seq })
+	if i == len(s.closed) || s.closed[i].seq != seq || s.closed[i].ext != "" {
+		return os.Remove(tmp)
+	}
+
+	name := s.name(seq)
+	if err := os.Rename(tmp, name+compressedExt); err != nil {
+		os.Remove(tmp)
+		return err
+	}
+	s.total += size - s.closed[i].size
+	s.closed[i].size, s.closed[i].ext = size, compressedExt
+	err := os.Remove(name)
+	s.enforce()
+	return err
+}
+
+func (s *segmentSet) enforce() {
+	drop := 0
+	for drop < len(s.closed) &&
+		((s.maxFiles > 0 && len(s.closed)-drop > s.maxFiles) || (s.maxBytes > 0 && s.total > s.maxBytes)) {
+		seg := s.closed[drop]
+		name := s.name(seg.seq) + seg.ext
+		if err := os.Remove(name); err != nil && !errors.Is(err, fs.ErrNotExist) {
+			slog.Warn("Failed to remove old segment", "path", name, "error", err)
+		}
+		if s.sidecar != "" {
+			os.Remove(s.stem(seg.seq) + s.sidecar)
+		}
+		s.total -= seg.size
+		drop++
+	}
+	s.closed = s.closed[drop:]
+}
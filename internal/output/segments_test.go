@@ -0,0 +1,213 @@
+package output
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+func TestSegmentSet(t *testing.T) {
+	tests := []struct {
+		name     string
+		suffix   string
+		maxFiles int
+		maxBytes int64
+		files    map[string]int // name and size of the files of earlier runs
+		add      []int64        // sizes of segments written by this run
+
+		want      []string // files left, sorted
+		wantNext  uint64
+		wantTotal int64
+	}{
+		{
+			name:      "empty",
+			wantNext:  1,
+			want:      []string{},
+			wantTotal: 0,
+		},
+		{
+			name:      "earlier runs",
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000002": 20, "t.log.00000007.zst": 5},
+			add:       []int64{30},
+			want:      []string{"t.log.00000001", "t.log.00000002", "t.log.00000007.zst", "t.log.00000008"},
+			wantNext:  9,
+			wantTotal: 65,
+		},
+		{
+			name: "other files",
+			files: map[string]int{
+				"t.log.00000001":       10,
+				"t.log.current":        1,
+				"t.log.00000001.tsidx": 1,
+				"u.log.00000005":       1,
+				"t.log00000009":        1,
+			},
+			want:      []string{"t.log.00000001", "t.log.00000001.tsidx", "t.log.current", "t.log00000009", "u.log.00000005"},
+			wantNext:  2,
+			wantTotal: 10,
+		},
+		{
+			name:      "count limit on open",
+			maxFiles:  2,
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000002.zst": 10, "t.log.00000003": 10, "t.log.00000004": 10},
+			want:      []string{"t.log.00000003", "t.log.00000004"},
+			wantNext:  5,
+			wantTotal: 20,
+		},
+		{
+			name:      "count limit on add",
+			maxFiles:  2,
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000002": 10},
+			add:       []int64{10, 10},
+			want:      []string{"t.log.00000003", "t.log.00000004"},
+			wantNext:  5,
+			wantTotal: 20,
+		},
+		{
+			name:      "byte limit on open",
+			maxBytes:  50,
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000002": 20, "t.log.00000003": 30},
+			want:      []string{"t.log.00000002", "t.log.00000003"},
+			wantNext:  4,
+			wantTotal: 50,
+		},
+		{
+			name:      "byte limit on add",
+			maxBytes:  50,
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000002": 20},
+			add:       []int64{25},
+			want:      []string{"t.log.00000002", "t.log.00000003"},
+			wantNext:  4,
+			wantTotal: 45,
+		},
+		{
+			// A segment larger than the byte limit is not kept either.
+			name:      "byte limit below one segment",
+			maxBytes:  5,
+			files:     map[string]int{"t.log.00000001": 10},
+			add:       []int64{10},
+			want:      []string{},
+			wantNext:  3,
+			wantTotal: 0,
+		},
+		{
+			name:      "both limits",
+			maxFiles:  3,
+			maxBytes:  100,
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000002": 10, "t.log.00000003": 10, "t.log.00000004": 90},
+			want:      []string{"t.log.00000003", "t.log.00000004"},
+			wantNext:  5,
+			wantTotal: 100,
+		},
+		{
+			name:      "interrupted compression",
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000001.zst.tmp": 3, "t.log.00000002.zst.tmp": 3},
+			want:      []string{"t.log.00000001"},
+			wantNext:  2,
+			wantTotal: 10,
+		},
+		{
+			// A crash after the compressed copy was renamed into place.
+			name:      "original and compressed copy",
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000001.zst": 4, "t.log.00000002": 10},
+			want:      []string{"t.log.00000001.zst", "t.log.00000002"},
+			wantNext:  3,
+			wantTotal: 14,
+		},
+		{
+			name:      "original and compressed copy over the limit",
+			maxBytes:  10,
+			files:     map[string]int{"t.log.00000001": 10, "t.log.00000001.zst": 4, "t.log.00000002": 8},
+			want:      []string{"t.log.00000002"},
+			wantNext:  3,
+			wantTotal: 8,
+		},
+		{
+			// Segments of a compressed output all end with the suffix, and
+			// are not compressed after rotation.
+			name:      "compressed output",
+			suffix:    ".zst",
+			maxFiles:  2,
+			files:     map[string]int{"t.log.00000001.zst": 10, "t.log.00000002.zst": 10, "t.log.00000009": 10},
+			add:       []int64{10},
+			want:      []string{"t.log.00000002.zst", "t.log.00000003.zst", "t.log.00000009"},
+			wantNext:  4,
+			wantTotal: 20,
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			dir := t.TempDir()
+			for name, size := range tt.files {
+				if err := os.WriteFile(filepath.Join(dir, name), make([]byte, size), 0644); err != nil {
+					t.Fatal(err)
+				}
+			}
+			s, err := openSegmentSet(filepath.Join(dir, "t.log"), tt.suffix, tt.maxFiles, tt.maxBytes)
+			if err != nil {
+				t.Fatal(err)
+			}
+			for _, size := range tt.add {
+				f, seq, err := s.create()
+				if err != nil {
+					t.Fatal(err)
+				}
+				if _, err := f.Write(make([]byte, size)); err != nil {
+					t.Fatal(err)
+				}
+				f.Close()
+				s.add(seq, size)
+			}
+
+			if names := dirNames(t, dir); fmt.Sprint(names) != fmt.Sprint(tt.want) {
+				t.Errorf("files = %v, want %v", names, tt.want)
+			}
+			if s.next != tt.wantNext {
+				t.Errorf("next = %d, want %d", s.next, tt.wantNext)
+			}
+			if s.total != tt.wantTotal {
+				t.Errorf("total = %d, want %d", s.total, tt.wantTotal)
+			}
+			checkSegmentIndex(t, s)
+		})
+	}
+}
+
+// dirNames returns the names of the files in dir, sorted.
+func dirNames(t *testing.T, dir string) []string {
+	t.Helper()
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	names := []string{}
+	for _, e := range entries {
+		names = append(names, e.Name())
+	}
+	return names
+}
+
+// checkSegmentIndex checks that the closed segments of s are in order and
+// match the files they index.
+func checkSegmentIndex(t *testing.T, s *segmentSet) {
+	t.Helper()
+	var total int64
+	for i, seg := range s.closed {
+		info, err := os.Stat(s.name(seg.seq) + seg.ext)
+		if err != nil {
+			t.Errorf("segment %d: %v", seg.seq, err)
+			continue
+		}
+		if info.Size() != seg.size {
+			t.Errorf("segment %d has size %d, indexed %d", seg.seq, info.Size(), seg.size)
+		}
+		if i > 0 && s.closed[i-1].seq >= seg.seq {
+			t.Errorf("segments out of order: %v", s.closed)
+		}
+		total += seg.size
+	}
+	if total != s.total {
+		t.Errorf("indexed sizes sum to %d, total %d", total, s.total)
+	}
+}
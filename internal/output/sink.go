@@ -0,0 +1,176 @@
+package output
+
+import (
+	"log/slog"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"write-tracer/internal/event"
+	"write-tracer/internal/queue"
+)
+
+// Sink is an output of the tracer. Each sink is driven by its own worker
+// goroutine, so Write is never called concurrently for the same sink.
+type Sink interface {
+	// Name identifies the sink in logs and metrics.
+	Name() string
+	// Write consumes a chunk of records. The chunk is only valid until
+	// Write returns.
+	Write(c *Chunk) error
+	// Close flushes buffered output and releases the sink.
+	Close() error
+}
+
+// Chunk is a group of records encoded once and shared by every sink. JSON
+// holds the newline-terminated JSON lines and Records the same records with
+// their comm and data copied into the chunk, so the chunk does not depend on
+// the batch it was built from. Chunks are pooled and reference counted.
+type Chunk struct {
+	JSON    []byte
+	Records []event.Record
+	arena   []byte
+	refs    atomic.Int32
+}
+
+var chunkPool = sync.Pool{
+	New: func() any {
+		return &Chunk{
+			JSON:    make([]byte, 0, event.BatchSize*512),
+			Records: make([]event.Record, 0, event.BatchSize),
+			arena:   make([]byte, 0, event.BatchSize*128),
+		}
+	},
+}
+
+// NewChunk returns an empty chunk from the pool.
+func NewChunk() *Chunk {
+	c := chunkPool.Get().(*Chunk)
+	c.JSON = c.JSON[:0]
+	c.Records = c.Records[:0]
+	c.arena = c.arena[:0]
+	return c
+}
+
+// Add encodes rec into the chunk and keeps a copy of it.
+func (c *Chunk) Add(rec *event.Record) {
+	c.JSON = rec.AppendJSON(c.JSON)
+	c.JSON = append(c.JSON, '\n')
+
+	r := *rec
+	start := len(c.arena)
+	c.arena = append(c.arena, rec.Comm...)
+	c.arena = append(c.arena, rec.Data...)
+	r.Comm = c.arena[start : start+len(rec.Comm) : start+len(rec.Comm)]
+	r.Data = c.arena[start+len(rec.Comm):]
+	c.Records = append(c.Records, r)
+}
+
+// Len returns the number of records in the chunk.
+func (c *Chunk) Len() int {
+	return len(c.Records)
+}
+
+// Release drops one reference and recycles the chunk once none remain.
+func (c *Chunk) Release() {
+	if c.refs.Add(-1) == 0 {
+		clear(c.Records)
+		chunkPool.Put(c)
+	}
+}
+
+// sinkQueue is the bounded queue and worker of one sink.
+type sinkQueue struct {
+	sink   Sink
+	ch     chan *Chunk
+	policy queue.Policy
+	done   chan struct{}
+	log    *queue.LogLimiter
+}
+
+// Fanout delivers every published chunk to all sinks. Each sink has its own
+// bounded queue, overflow policy and worker, so a slow or failing sink only
+// fills its own queue and never stalls the producers or the other sinks
+// (unless its policy is Block).
+type Fanout struct {
+	queues []*sinkQueue
+}
+
+// NewFanout creates a fan-out without sinks.
+func NewFanout() *Fanout {
+	return &Fanout{}
+}
+
+// Add registers a sink with a queue of depth chunks and starts its worker.
+// The Spill policy is not supported for sinks and behaves like DropNewest.
+// Sinks must be added before the first Publish.
+func (f *Fanout) Add(sink Sink, depth int, policy queue.Policy) {
+	q := &sinkQueue{
+		sink:   sink,
+		ch:     make(chan *Chunk, depth),
+		policy: policy,
+		done:   make(chan struct{}),
+		log:    queue.NewLogLimiter(5 * time.Second),
+	}
+	f.queues = append(f.queues, q)
+	registerSinkQueue(sink.Name(), func() int { return len(q.ch) })
+	go q.run()
+}
+
+// Len returns the number of sinks.
+func (f *Fanout) Len() int {
+	return len(f.queues)
+}
+
+// Publish hands c to every sink. It takes ownership of c.
+func (f *Fanout) Publish(c *Chunk) {
+	if len(f.queues) == 0 {
+		c.refs.Store(1)
+		c.Release()
+		return
+	}
+
+	c.refs.Store(int32(len(f.queues)))
+	for _, q := range f.queues {
+		queue.Offer(q.ch, c, q.policy, q.drop)
+	}
+}
+
+// Close drains every queue and closes the sinks.
+func (f *Fanout) Close() {
+	for _, q := range f.queues {
+		close(q.ch)
+	}
+	for _, q := range f.queues {
+		<-q.done
+		if err := q.sink.Close(); err != nil {
+			slog.Warn("Sink close failed", "sink", q.sink.Name(), "error", err)
+		}
+	}
+}
+
+func (q *sinkQueue) run() {
+	defer close(q.done)
+
+	name := q.sink.Name()
+	for c := range q.ch {
+		start := time.Now()
+		err := q.sink.Write(c)
+		observeSinkWrite(name, time.Since(start), err)
+		if err != nil {
+			if suppressed, ok := q.log.Allow(); ok {
+				slog.Warn("Sink write failed", "sink", name, "error", err, "suppressed_warnings", suppressed)
+			}
+		}
+		c.Release()
+	}
+}
+
+func (q *sinkQueue) drop(c *Chunk) {
+	addSinkDropped(q.sink.Name(), c.Len())
+	if suppressed, ok := q.log.Allow(); ok {
+		slog.Warn("Sink queue full, dropping records", "sink", q.sink.Name(), "policy", q.policy.String(),
+			"count", c.Len(), "suppressed_warnings", suppressed)
+	}
+	c.Release()
+}
@@ -0,0 +1,166 @@
+package output
+
+import (
+	"errors"
+	"os"
+	"sync"
+	"time"
+
+	"golang.org/x/sys/unix"
+)
+
+const (
+	// stdoutSegmentSize is the size of one userspace buffer segment. Each
+	// segment becomes one iovec of the flushing writev call.
+	stdoutSegmentSize = 64 * 1024
+	// stdoutMaxIovecs keeps a single writev below the kernel's IOV_MAX.
+	stdoutMaxIovecs = 1024
+)
+
+// StdoutWriter is a buffered sink for standard output. Encoded chunks are
+// copied into a list of segments and flushed with one writev(2) per flush,
+// either once bufSize bytes are pending or every flushInterval, instead of
+// one write(2) per event. Close flushes whatever is still buffered.
+type StdoutWriter struct {
+	mu       sync.Mutex
+	fd       int
+	bufSize  int
+	segments [][]byte // pending data, one iovec each
+	free     [][]byte // recycled segments
+	pending  int
+	stop     chan struct{}
+	stopped  chan struct{}
+}
+
+// NewStdoutWriter creates a buffered writer for os.Stdout and starts its
+// periodic flusher.
+func NewStdoutWriter(bufSize int, flushInterval time.Duration) *StdoutWriter {
+	w := &StdoutWriter{
+		fd:      int(os.Stdout.Fd()),
+		bufSize: bufSize,
+		stop:    make(chan struct{}),
+		stopped: make(chan struct{}),
+	}
+	go w.flushLoop(flushInterval)
+	return w
+}
+
+// Name implements Sink.
+func (w *StdoutWriter) Name() string {
+	return "stdout"
+}
+
+// Write buffers the JSON lines of a chunk. They are copied, so the chunk may
+// be released once Write returns. Write is safe for concurrent use with the
+// periodic flusher and never splits a chunk across two flushes.
+func (w *StdoutWriter) Write(c *Chunk) error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+
+	lines := c.JSON
+
+	for len(lines) > 0 {
+		seg := w.tail()
+		n := copy(seg[len(seg):cap(seg)], lines)
+		w.segments[len(w.segments)-1] = seg[:len(seg)+n]
+		lines = lines[n:]
+		w.pending += n
+	}
+
+	if w.pending >= w.bufSize || len(w.segments) >= stdoutMaxIovecs {
+		return w.flushLocked()
+	}
+	return nil
+}
+
+// Flush writes all buffered data to stdout.
+func (w *StdoutWriter) Flush() error {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+	return w.flushLocked()
+}
+
+// Close stops the periodic flusher and flushes the remaining data.
+func (w *StdoutWriter) Close() error {
+	close(w.stop)
+	<-w.stopped
+	return w.Flush()
+}
+
+// tail returns the last segment, starting a new one if it is full.
+func (w *StdoutWriter) tail() []byte {
+	if n := len(w.segments); n > 0 {
+		if seg := w.segments[n-1]; len(seg) < cap(seg) {
+			return seg
+		}
+	}
+
+	var seg []byte
+	if n := len(w.free); n > 0 {
+		seg = w.free[n-1][:0]
+		w.free = w.free[:n-1]
+	} else {
+		seg = make([]byte, 0, stdoutSegmentSize)
+	}
+	w.segments = append(w.segments, seg)
+	return seg
+}
+
+func (w *StdoutWriter) flushLocked() error {
+	if w.pending == 0 {
+		return nil
+	}
+
+	// Recycle the segments before writevAll trims the iovecs in place.
+	for _, seg := range w.segments {
+		w.free = append(w.free, seg[:0])
+	}
+	err := writevAll(w.fd, w.segments)
+
+	clear(w.segments)
+	w.segments = w.segments[:0]
+	w.pending = 0
+	return err
+}
+
+func (w *StdoutWriter) flushLoop(interval time.Duration) {
+	defer close(w.stopped)
+
+	ticker := time.NewTicker(interval)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case <-w.stop:
+			return
+		case <-ticker.C:
+			w.Flush()
+		}
+	}
+}
+
+// writevAll writes every iovec, resuming after short writes and EINTR.
+// iovs is consumed in place.
+func writevAll(fd int, iovs [][]byte) error {
+	for len(iovs) > 0 {
+		n, err := unix.Writev(fd, iovs)
+		if err != nil {
+			if errors.Is(err, unix.EINTR) {
+				continue
+			}
+			return err
+		}
+		for n > 0 && len(iovs) > 0 {
+			if n < len(iovs[0]) {
+				iovs[0] = iovs[0][n:]
+				break
+			}
+			n -= len(iovs[0])
+			iovs = iovs[1:]
+		}
+		for len(iovs) > 0 && len(iovs[0]) == 0 {
+			iovs = iovs[1:]
+		}
+	}
+	return nil
+}
@@ -0,0 +1,595 @@
+// Package parquet writes captured records as Parquet files, so they can be
+// loaded by pandas, DuckDB or Spark without parsing JSON. The schema is fixed:
+//
+//	timestamp  INT64 (UINT_64)
+//	pid        INT32 (UINT_32)
+//	tid        INT32 (UINT_32)
+//	fd         INT32 (UINT_32)
+//	count      INT64 (UINT_64)
+//	comm       BYTE_ARRAY (UTF8), dictionary encoded
+//	data       BYTE_ARRAY
+//
+// All columns are required. Values are PLAIN encoded in version 1 data pages
+// of about 1 MiB, each column chunk compressed with its own codec, and the
+// integer columns carry min/max statistics so readers can skip row groups.
+package parquet
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"math/bits"
+	"strings"
+
+	"write-tracer/internal/event"
+
+	"github.com/klauspost/compress/s2"
+	"github.com/klauspost/compress/zstd"
+)
+
+// Codec is a Parquet compression codec.
+type Codec int32
+
+const (
+	Uncompressed Codec = 0
+	Snappy       Codec = 1
+	Gzip         Codec = 2
+	Zstd         Codec = 6
+)
+
+var codecNames = map[string]Codec{
+	"none":   Uncompressed,
+	"snappy": Snappy,
+	"gzip":   Gzip,
+	"zstd":   Zstd,
+}
+
+// Column indexes, in schema order.
+const (
+	colTimestamp = iota
+	colPID
+	colTID
+	colFD
+	colCount
+	colComm
+	colData
+	numColumns
+)
+
+// Parquet enum values used by the writer.
+const (
+	typeInt32     = 1
+	typeInt64     = 2
+	typeByteArray = 6
+
+	convertedNone   = -1
+	convertedUTF8   = 0
+	convertedUint32 = 13
+	convertedUint64 = 14
+
+	encodingPlain         = 0
+	encodingRLE           = 3
+	encodingRLEDictionary = 8
+
+	pageData       = 0
+	pageDictionary = 2
+
+	repetitionRequired = 0
+)
+
+const (
+	magic = "PAR1"
+	// pageSize is the uncompressed size at which a data page is cut.
+	pageSize = 1 << 20
+	// bitPackedRun is the number of values per bit-packed run of dictionary
+	// indices, the run length used by parquet-mr.
+	bitPackedRun = 63 * 8
+)
+
+type columnSpec struct {
+	name      string
+	typ       int32
+	converted int32
+}
+
+var schema = [numColumns]columnSpec{
+	colTimestamp: {"timestamp", typeInt64, convertedUint64},
+	colPID:       {"pid", typeInt32, convertedUint32},
+	colTID:       {"tid", typeInt32, convertedUint32},
+	colFD:        {"fd", typeInt32, convertedUint32},
+	colCount:     {"count", typeInt64, convertedUint64},
+	colComm:      {"comm", typeByteArray, convertedUTF8},
+	colData:      {"data", typeByteArray, convertedNone},
+}
+
+// Codecs holds the compression codec of each column.
+type Codecs [numColumns]Codec
+
+// ParseCodecs parses a compression setting: a codec for every column (none,
+// snappy, gzip or zstd), optionally followed by column=codec overrides, e.g.
+// "zstd,comm=none,timestamp=snappy".
+func ParseCodecs(s string) (Codecs, error) {
+	var c Codecs
+	for i, part := range strings.Split(s, ",") {
+		part = strings.TrimSpace(part)
+		name, value, override := strings.Cut(part, "=")
+		if !override {
+			if i != 0 {
+				return c, fmt.Errorf("default codec %q must come first", part)
+			}
+			value = name
+		}
+		codec, ok := codecNames[value]
+		if !ok {
+			return c, fmt.Errorf("unknown parquet codec %q (want none, snappy, gzip or zstd)", value)
+		}
+		if !override {
+			for col := range c {
+				c[col] = codec
+			}
+			continue
+		}
+		col := columnIndex(name)
+		if col < 0 {
+			return c, fmt.Errorf("unknown parquet column %q", name)
+		}
+		c[col] = codec
+	}
+	return c, nil
+}
+
+func columnIndex(name string) int {
+	for i, spec := range schema {
+		if spec.name == name {
+			return i
+		}
+	}
+	return -1
+}
+
+// column buffers the values of one column for the current row group.
+type column struct {
+	values    []byte // PLAIN encoded values (dictionary for comm)
+	pages     []page // data pages cut so far
+	pageStart int    // start of the current page in values
+	paged     int    // values in the pages cut so far
+	n         int    // values in the current row group
+	min       uint64
+	max       uint64
+
+	// comm only
+	dict    map[string]uint32
+	dictLen int
+	indices []uint32
+}
+
+type page struct {
+	end int // end offset in values
+	n   int // number of values
+}
+
+// chunkMeta is the metadata of one written column chunk.
+type chunkMeta struct {
+	offset           int64 // first page
+	dataOffset       int64
+	dictOffset       int64 // -1 without dictionary
+	uncompressedSize int64
+	compressedSize   int64
+	values           int64
+	min, max         uint64
+}
+
+type rowGroupMeta struct {
+	columns [numColumns]chunkMeta
+	rows    int64
+	size    int64
+}
+
+// Writer writes a Parquet file. Rows are buffered per row group and written
+// once rowGroupRows rows are pending, on Flush and on Close; the footer is
+// written by Close. A Writer is not safe for concurrent use.
+type Writer struct {
+	w            io.Writer
+	off          int64
+	codecs       Codecs
+	rowGroupRows int
+
+	cols      [numColumns]column
+	rows      int
+	rowGroups []rowGroupMeta
+	totalRows int64
+
+	meta    thriftWriter
+	pageBuf []byte
+	comp    []byte
+	gz      *gzip.Writer
+	gzBuf   bytes.Buffer
+	zstd    *zstd.Encoder
+	scratch []byte
+}
+
+// NewWriter starts a Parquet file on w.
+func NewWriter(w io.Writer, codecs Codecs, rowGroupRows int) (*Writer, error) {
+	pw := &Writer{w: w, codecs: codecs, rowGroupRows: max(rowGroupRows, 1)}
+	pw.cols[colComm].dict = make(map[string]uint32)
+	pw.resetColumns()
+
+	for _, c := range codecs {
+		if c == Zstd && pw.zstd == nil {
+			enc, err := zstd.NewWriter(nil, zstd.WithEncoderConcurrency(1))
+			if err != nil {
+				return nil, fmt.Errorf("failed to create zstd encoder: %w", err)
+			}
+			pw.zstd = enc
+		}
+	}
+
+	if err := pw.write([]byte(magic)); err != nil {
+		return nil, err
+	}
+	return pw, nil
+}
+
+// Size returns the number of bytes written so far, excluding buffered rows.
+func (w *Writer) Size() int64 {
+	return w.off
+}
+
+// Buffered returns the number of rows not yet written to a row group.
+func (w *Writer) Buffered() int {
+	return w.rows
+}
+
+// Write adds one row, writing the row group once it is full.
+func (w *Writer) Write(rec *event.Record) error {
+	w.appendUint64(colTimestamp, rec.Timestamp)
+	w.appendUint32(colPID, rec.PID)
+	w.appendUint32(colTID, rec.TID)
+	w.appendUint32(colFD, rec.FD)
+	w.appendUint64(colCount, rec.Count)
+	w.appendComm(rec.Comm)
+	w.appendBytes(colData, rec.Data)
+
+	w.rows++
+	if w.rows >= w.rowGroupRows {
+		return w.Flush()
+	}
+	return nil
+}
+
+// Flush writes the buffered rows as a row group.
+func (w *Writer) Flush() error {
+	if w.rows == 0 {
+		return nil
+	}
+
+	rg := rowGroupMeta{rows: int64(w.rows)}
+	for i := range w.cols {
+		meta, err := w.writeColumn(i)
+		if err != nil {
+			return err
+		}
+		rg.columns[i] = meta
+		rg.size += meta.uncompressedSize
+	}
+	w.rowGroups = append(w.rowGroups, rg)
+	w.totalRows += rg.rows
+	w.rows = 0
+	w.resetColumns()
+	return nil
+}
+
+// Close flushes the pending rows and writes the footer. It does not close the
+// underlying writer.
+func (w *Writer) Close() error {
+	if err := w.Flush(); err != nil {
+		return err
+	}
+
+	w.encodeFileMetaData()
+	footer := w.meta.buf
+	footer = binary.LittleEndian.AppendUint32(footer, uint32(len(footer)))
+	footer = append(footer, magic...)
+	w.meta.buf = footer
+	if err := w.write(footer); err != nil {
+		return err
+	}
+	if w.zstd != nil {
+		w.zstd.Close()
+	}
+	return nil
+}
+
+func (w *Writer) resetColumns() {
+	for i := range w.cols {
+		c := &w.cols[i]
+		c.values = c.values[:0]
+		c.pages = c.pages[:0]
+		c.pageStart, c.paged, c.n = 0, 0, 0
+		c.min, c.max = math.MaxUint64, 0
+		c.indices = c.indices[:0]
+		c.dictLen = 0
+	}
+	clear(w.cols[colComm].dict)
+}
+
+func (w *Writer) appendUint32(col int, v uint32) {
+	c := &w.cols[col]
+	c.values = binary.LittleEndian.AppendUint32(c.values, v)
+	c.stats(uint64(v))
+	c.added()
+}
+
+func (w *Writer) appendUint64(col int, v uint64) {
+	c := &w.cols[col]
+	c.values = binary.LittleEndian.AppendUint64(c.values, v)
+	c.stats(v)
+	c.added()
+}
+
+func (w *Writer) appendBytes(col int, v []byte) {
+	c := &w.cols[col]
+	c.values = binary.LittleEndian.AppendUint32(c.values, uint32(len(v)))
+	c.values = append(c.values, v...)
+	c.added()
+}
+
+// appendComm adds a comm to the row group dictionary and records its index.
+func (w *Writer) appendComm(v []byte) {
+	c := &w.cols[colComm]
+	idx, ok := c.dict[string(v)]
+	if !ok {
+		idx = uint32(c.dictLen)
+		c.dict[string(v)] = idx
+		c.dictLen++
+		c.values = binary.LittleEndian.AppendUint32(c.values, uint32(len(v)))
+		c.values = append(c.values, v...)
+	}
+	c.indices = append(c.indices, idx)
+	c.n++
+}
+
+func (c *column) stats(v uint64) {
+	c.min = min(c.min, v)
+	c.max = max(c.max, v)
+}
+
+// added accounts for a value appended to values and cuts a page once the
+// current one reaches pageSize.
+func (c *column) added() {
+	c.n++
+	if len(c.values)-c.pageStart >= pageSize {
+		c.pages = append(c.pages, page{end: len(c.values), n: c.n - c.paged})
+		c.pageStart = len(c.values)
+		c.paged = c.n
+	}
+}
+
+// writeColumn writes the pages of one column chunk and returns its metadata.
+func (w *Writer) writeColumn(col int) (chunkMeta, error) {
+	c := &w.cols[col]
+	meta := chunkMeta{offset: w.off, dictOffset: -1, values: int64(c.n), min: c.min, max: c.max}
+
+	if col == colComm {
+		meta.dictOffset = w.off
+		if err := w.writePage(col, &meta, pageDictionary, c.values, c.dictLen); err != nil {
+			return meta, err
+		}
+		meta.dataOffset = w.off
+		w.scratch = appendIndices(w.scratch[:0], c.indices, c.dictLen)
+		return meta, w.writePage(col, &meta, pageData, w.scratch, c.n)
+	}
+
+	meta.dataOffset = w.off
+	start := 0
+	for _, p := range c.pages {
+		if err := w.writePage(col, &meta, pageData, c.values[start:p.end], p.n); err != nil {
+			return meta, err
+		}
+		start = p.end
+	}
+	if c.paged < c.n {
+		return meta, w.writePage(col, &meta, pageData, c.values[start:], c.n-c.paged)
+	}
+	return meta, nil
+}
+
+// writePage compresses and writes one page with its header.
+func (w *Writer) writePage(col int, meta *chunkMeta, typ int32, data []byte, n int) error {
+	body, err := w.compress(w.codecs[col], data)
+	if err != nil {
+		return err
+	}
+
+	t := &w.meta
+	t.reset()
+	t.begin()
+	t.i32(1, typ)
+	t.i32(2, int32(len(data)))
+	t.i32(3, int32(len(body)))
+	if typ == pageDictionary {
+		t.structField(7)
+		t.i32(1, int32(n))
+		t.i32(2, encodingPlain)
+		t.end()
+	} else {
+		encoding := int32(encodingPlain)
+		if col == colComm {
+			encoding = encodingRLEDictionary
+		}
+		t.structField(5)
+		t.i32(1, int32(n))
+		t.i32(2, encoding)
+		t.i32(3, encodingRLE)
+		t.i32(4, encodingRLE)
+		t.end()
+	}
+	t.end()
+
+	meta.uncompressedSize += int64(len(t.buf) + len(data))
+	meta.compressedSize += int64(len(t.buf) + len(body))
+	if err := w.write(t.buf); err != nil {
+		return err
+	}
+	return w.write(body)
+}
+
+func (w *Writer) compress(codec Codec, data []byte) ([]byte, error) {
+	switch codec {
+	case Snappy:
+		w.comp = s2.EncodeSnappy(w.comp[:cap(w.comp)], data)
+		return w.comp, nil
+	case Gzip:
+		w.gzBuf.Reset()
+		if w.gz == nil {
+			w.gz = gzip.NewWriter(&w.gzBuf)
+		} else {
+			w.gz.Reset(&w.gzBuf)
+		}
+		if _, err := w.gz.Write(data); err != nil {
+			return nil, err
+		}
+		if err := w.gz.Close(); err != nil {
+			return nil, err
+		}
+		return w.gzBuf.Bytes(), nil
+	case Zstd:
+		w.comp = w.zstd.EncodeAll(data, w.comp[:0])
+		return w.comp, nil
+	default:
+		return data, nil
+	}
+}
+
+// appendIndices encodes dictionary indices for an RLE_DICTIONARY page: the
+// bit width followed by bit-packed runs of the RLE/bit-packing hybrid.
+func appendIndices(dst []byte, indices []uint32, dictLen int) []byte {
+	width := max(bits.Len32(uint32(dictLen-1)), 1)
+	dst = append(dst, byte(width))
+
+	for len(indices) > 0 {
+		run := indices[:min(len(indices), bitPackedRun)]
+		indices = indices[len(run):]
+
+		groups := (len(run) + 7) / 8
+		dst = binary.AppendUvarint(dst, uint64(groups)<<1|1)
+		var acc uint64
+		var nbits int
+		for i := 0; i < groups*8; i++ {
+			var v uint32
+			if i < len(run) {
+				v = run[i]
+			}
+			acc |= uint64(v) << nbits
+			nbits += width
+			for nbits >= 8 {
+				dst = append(dst, byte(acc))
+				acc >>= 8
+				nbits -= 8
+			}
+		}
+	}
+	return dst
+}
+
+func (w *Writer) write(b []byte) error {
+	n, err := w.w.Write(b)
+	w.off += int64(n)
+	return err
+}
+
+// encodeFileMetaData encodes the footer into w.meta.
+func (w *Writer) encodeFileMetaData() {
+	t := &w.meta
+	t.reset()
+	t.begin()
+	t.i32(1, 1)
+
+	t.list(2, thriftStruct, numColumns+1)
+	t.begin()
+	t.string(4, "schema")
+	t.i32(5, numColumns)
+	t.end()
+	for _, spec := range schema {
+		t.begin()
+		t.i32(1, spec.typ)
+		t.i32(3, repetitionRequired)
+		t.string(4, spec.name)
+		if spec.converted != convertedNone {
+			t.i32(6, spec.converted)
+		}
+		t.end()
+	}
+
+	t.i64(3, w.totalRows)
+
+	t.list(4, thriftStruct, len(w.rowGroups))
+	for i := range w.rowGroups {
+		rg := &w.rowGroups[i]
+		t.begin()
+		t.list(1, thriftStruct, numColumns)
+		for col := range rg.columns {
+			w.encodeColumnChunk(col, &rg.columns[col])
+		}
+		t.i64(2, rg.size)
+		t.i64(3, rg.rows)
+		t.end()
+	}
+
+	t.string(6, "write-tracer")
+
+	// column_orders: TYPE_ORDER for every column, which makes readers use the
+	// min_value/max_value statistics.
+	t.list(7, thriftStruct, numColumns)
+	for i := 0; i < numColumns; i++ {
+		t.begin()
+		t.structField(1)
+		t.end()
+		t.end()
+	}
+	t.end()
+}
+
+func (w *Writer) encodeColumnChunk(col int, m *chunkMeta) {
+	t := &w.meta
+	spec := schema[col]
+
+	t.begin()
+	t.i64(2, m.offset)
+	t.structField(3)
+	t.i32(1, spec.typ)
+	if col == colComm {
+		t.listI32(2, encodingPlain, encodingRLE, encodingRLEDictionary)
+	} else {
+		t.listI32(2, encodingPlain, encodingRLE)
+	}
+	t.listString(3, spec.name)
+	t.i32(4, int32(w.codecs[col]))
+	t.i64(5, m.values)
+	t.i64(6, m.uncompressedSize)
+	t.i64(7, m.compressedSize)
+	t.i64(9, m.dataOffset)
+	if m.dictOffset >= 0 {
+		t.i64(11, m.dictOffset)
+	}
+	if spec.typ != typeByteArray && m.values > 0 {
+		t.structField(12)
+		t.i64(3, 0)
+		t.binary(5, plainValue(w.scratch[:0], spec.typ, m.max))
+		t.binary(6, plainValue(w.scratch[:0], spec.typ, m.min))
+		t.end()
+	}
+	t.end()
+	t.end()
+}
+
+// plainValue returns v PLAIN encoded as the given physical type.
+func plainValue(dst []byte, typ int32, v uint64) []byte {
+	if typ == typeInt32 {
+		return binary.LittleEndian.AppendUint32(dst, uint32(v))
+	}
+	return binary.LittleEndian.AppendUint64(dst, v)
+}
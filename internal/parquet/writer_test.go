@@ -0,0 +1,492 @@
+package parquet
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math/bits"
+	"strings"
+	"testing"
+
+	"write-tracer/internal/event"
+
+	"github.com/klauspost/compress/s2"
+	"github.com/klauspost/compress/zstd"
+)
+
+// thriftFields is a decoded Thrift struct: field id to value, where values
+// are int64, bool, []byte, []any or thriftFields.
+type thriftFields map[int16]any
+
+// thriftReader decodes the Thrift compact protocol, independently of
+// thriftWriter, in full rather than only the types the writer emits.
+type thriftReader struct {
+	t   *testing.T
+	buf []byte
+}
+
+func (r *thriftReader) byte() byte {
+	if len(r.buf) == 0 {
+		r.t.Fatal("thrift: unexpected end of input")
+	}
+	b := r.buf[0]
+	r.buf = r.buf[1:]
+	return b
+}
+
+func (r *thriftReader) uvarint() uint64 {
+	v, n := binary.Uvarint(r.buf)
+	if n <= 0 {
+		r.t.Fatal("thrift: malformed varint")
+	}
+	r.buf = r.buf[n:]
+	return v
+}
+
+func (r *thriftReader) varint() int64 {
+	v, n := binary.Varint(r.buf)
+	if n <= 0 {
+		r.t.Fatal("thrift: malformed varint")
+	}
+	r.buf = r.buf[n:]
+	return v
+}
+
+func (r *thriftReader) value(typ byte) any {
+	switch typ {
+	case 1, 2: // boolean true, false
+		return typ == 1
+	case 3: // i8
+		return int64(int8(r.byte()))
+	case 4, thriftI32, thriftI64:
+		return r.varint()
+	case 7: // double
+		if len(r.buf) < 8 {
+			r.t.Fatal("thrift: short double")
+		}
+		v := r.buf[:8]
+		r.buf = r.buf[8:]
+		return v
+	case thriftBinary:
+		n := r.uvarint()
+		if uint64(len(r.buf)) < n {
+			r.t.Fatal("thrift: short binary")
+		}
+		v := r.buf[:n]
+		r.buf = r.buf[n:]
+		return v
+	case thriftList, 10: // list, set
+		h := r.byte()
+		n, elem := uint64(h>>4), h&0xf
+		if n == 15 {
+			n = r.uvarint()
+		}
+		l := make([]any, n)
+		for i := range l {
+			if elem == 1 || elem == 2 {
+				// Booleans in lists are one byte each.
+				l[i] = r.byte() == 1
+				continue
+			}
+			l[i] = r.value(elem)
+		}
+		return l
+	case thriftStruct:
+		return r.readStruct()
+	}
+	r.t.Fatalf("thrift: unexpected type %d", typ)
+	return nil
+}
+
+func (r *thriftReader) readStruct() thriftFields {
+	s := make(thriftFields)
+	var last int16
+	for {
+		h := r.byte()
+		if h == 0 {
+			return s
+		}
+		typ := h & 0xf
+		id := last + int16(h>>4)
+		if h>>4 == 0 {
+			id = int16(r.varint())
+		}
+		s[id] = r.value(typ)
+		last = id
+	}
+}
+
+func (s thriftFields) int(t *testing.T, id int16) int64 {
+	t.Helper()
+	v, ok := s[id].(int64)
+	if !ok {
+		t.Fatalf("field %d = %v, want an integer", id, s[id])
+	}
+	return v
+}
+
+func (s thriftFields) str(t *testing.T, id int16) string {
+	t.Helper()
+	v, ok := s[id].([]byte)
+	if !ok {
+		t.Fatalf("field %d = %v, want a string", id, s[id])
+	}
+	return string(v)
+}
+
+func (s thriftFields) list(t *testing.T, id int16) []any {
+	t.Helper()
+	v, ok := s[id].([]any)
+	if !ok {
+		t.Fatalf("field %d = %v, want a list", id, s[id])
+	}
+	return v
+}
+
+func (s thriftFields) child(t *testing.T, id int16) thriftFields {
+	t.Helper()
+	v, ok := s[id].(thriftFields)
+	if !ok {
+		t.Fatalf("field %d = %v, want a struct", id, s[id])
+	}
+	return v
+}
+
+func decompress(t *testing.T, codec Codec, body []byte, size int) []byte {
+	t.Helper()
+	var out []byte
+	var err error
+	switch codec {
+	case Uncompressed:
+		out = body
+	case Snappy:
+		out, err = s2.Decode(nil, body)
+	case Gzip:
+		var zr *gzip.Reader
+		if zr, err = gzip.NewReader(bytes.NewReader(body)); err == nil {
+			out, err = io.ReadAll(zr)
+		}
+	case Zstd:
+		var zr *zstd.Decoder
+		if zr, err = zstd.NewReader(nil); err == nil {
+			out, err = zr.DecodeAll(body, nil)
+			zr.Close()
+		}
+	default:
+		t.Fatalf("unexpected codec %d", codec)
+	}
+	if err != nil {
+		t.Fatalf("codec %d: %v", codec, err)
+	}
+	if len(out) != size {
+		t.Fatalf("page decompressed to %d bytes, header says %d", len(out), size)
+	}
+	return out
+}
+
+// decodeIndices decodes n values of the RLE/bit-packing hybrid encoding,
+// preceded by their bit width.
+func decodeIndices(t *testing.T, b []byte, n int) []uint32 {
+	t.Helper()
+	width := int(b[0])
+	b = b[1:]
+	var out []uint32
+	for len(out) < n {
+		h, k := binary.Uvarint(b)
+		if k <= 0 {
+			t.Fatal("malformed run header")
+		}
+		b = b[k:]
+		if h&1 == 0 {
+			// RLE run: the value in ceil(width/8) bytes.
+			var v uint32
+			for i := 0; i < (width+7)/8; i++ {
+				v |= uint32(b[i]) << (8 * i)
+			}
+			b = b[(width+7)/8:]
+			for i := uint64(0); i < h>>1; i++ {
+				out = append(out, v)
+			}
+			continue
+		}
+		values := int(h>>1) * 8
+		for i := 0; i < values; i++ {
+			var v uint32
+			for j := 0; j < width; j++ {
+				bit := i*width + j
+				v |= uint32(b[bit/8]>>(bit%8)&1) << j
+			}
+			out = append(out, v)
+		}
+		b = b[values*width/8:]
+	}
+	return out[:n]
+}
+
+// testRecords returns n records with a handful of comms and payloads of up
+// to dataLen bytes, empty ones included.
+func testRecords(n, dataLen int) []event.Record {
+	comms := []string{"python", "mpi_rank", "", "nccl-watchdog"}
+	recs := make([]event.Record, n)
+	for i := range recs {
+		data := []byte(fmt.Sprintf("line %d ", i))
+		data = append(data, strings.Repeat("x", i%dataLen)...)
+		recs[i] = event.Record{
+			Timestamp: 1_700_000_000_000_000_000 + uint64(i)*1000,
+			Count:     uint64(len(data)),
+			PID:       uint32(1000 + i%7),
+			TID:       uint32(2000 + i%11),
+			FD:        uint32(1 + i%2),
+			Comm:      []byte(comms[i%len(comms)]),
+			Data:      data,
+		}
+	}
+	return recs
+}
+
+// readColumnChunk decodes the pages of a column chunk and returns its values
+// as strings, integers in decimal.
+func readColumnChunk(t *testing.T, file []byte, col int, meta thriftFields, codec Codec) []string {
+	t.Helper()
+	start := meta.int(t, 9)
+	if dict, ok := meta[11]; ok {
+		start = dict.(int64)
+	}
+	end := start + meta.int(t, 7)
+	r := &thriftReader{t: t, buf: file[start:end]}
+
+	var dict []string
+	var values []string
+	for len(r.buf) > 0 {
+		header := r.readStruct()
+		size, compressed := int(header.int(t, 2)), int(header.int(t, 3))
+		body := decompress(t, codec, r.buf[:compressed], size)
+		r.buf = r.buf[compressed:]
+
+		switch header.int(t, 1) {
+		case pageDictionary:
+			h := header.child(t, 7)
+			dict = decodePlain(t, typeByteArray, body, int(h.int(t, 1)))
+		case pageData:
+			h := header.child(t, 5)
+			n := int(h.int(t, 1))
+			if col == colComm {
+				if h.int(t, 2) != encodingRLEDictionary {
+					t.Fatalf("comm page encoding %d", h.int(t, 2))
+				}
+				for _, i := range decodeIndices(t, body, n) {
+					values = append(values, dict[i])
+				}
+				continue
+			}
+			values = append(values, decodePlain(t, schema[col].typ, body, n)...)
+		default:
+			t.Fatalf("unexpected page type %d", header.int(t, 1))
+		}
+	}
+	return values
+}
+
+func decodePlain(t *testing.T, typ int32, b []byte, n int) []string {
+	t.Helper()
+	values := make([]string, 0, n)
+	for i := 0; i < n; i++ {
+		switch typ {
+		case typeInt32:
+			values = append(values, fmt.Sprint(binary.LittleEndian.Uint32(b)))
+			b = b[4:]
+		case typeInt64:
+			values = append(values, fmt.Sprint(binary.LittleEndian.Uint64(b)))
+			b = b[8:]
+		case typeByteArray:
+			l := binary.LittleEndian.Uint32(b)
+			values = append(values, string(b[4:4+l]))
+			b = b[4+l:]
+		}
+	}
+	if len(b) != 0 {
+		t.Fatalf("%d bytes left after %d values", len(b), n)
+	}
+	return values
+}
+
+func recordValue(rec *event.Record, col int) string {
+	switch col {
+	case colTimestamp:
+		return fmt.Sprint(rec.Timestamp)
+	case colPID:
+		return fmt.Sprint(rec.PID)
+	case colTID:
+		return fmt.Sprint(rec.TID)
+	case colFD:
+		return fmt.Sprint(rec.FD)
+	case colCount:
+		return fmt.Sprint(rec.Count)
+	case colComm:
+		return string(rec.Comm)
+	default:
+		return string(rec.Data)
+	}
+}
+
+func TestWriterRoundTrip(t *testing.T) {
+	tests := []struct {
+		codecs    string
+		rows      int
+		groupRows int
+		dataLen   int
+	}{
+		{"none", 10, 100, 16},
+		{"snappy", 1000, 400, 64},
+		{"gzip", 1000, 400, 64},
+		{"zstd", 1000, 400, 64},
+		{"zstd,comm=none,data=gzip,timestamp=snappy", 1000, 400, 64},
+		// Data pages of the data column are cut at pageSize.
+		{"snappy", 6000, 2500, 1200},
+	}
+	for _, tt := range tests {
+		t.Run(fmt.Sprintf("%s/%d", tt.codecs, tt.rows), func(t *testing.T) {
+			codecs, err := ParseCodecs(tt.codecs)
+			if err != nil {
+				t.Fatal(err)
+			}
+			recs := testRecords(tt.rows, tt.dataLen)
+			var buf bytes.Buffer
+			w, err := NewWriter(&buf, codecs, tt.groupRows)
+			if err != nil {
+				t.Fatal(err)
+			}
+			for i := range recs {
+				if err := w.Write(&recs[i]); err != nil {
+					t.Fatal(err)
+				}
+			}
+			if err := w.Close(); err != nil {
+				t.Fatal(err)
+			}
+			file := buf.Bytes()
+
+			// PAR1, the pages, the footer, its length and PAR1.
+			if !bytes.HasPrefix(file, []byte(magic)) || !bytes.HasSuffix(file, []byte(magic)) {
+				t.Fatal("missing magic")
+			}
+			footerLen := int(binary.LittleEndian.Uint32(file[len(file)-8:]))
+			footerStart := len(file) - 8 - footerLen
+			r := &thriftReader{t: t, buf: file[footerStart : len(file)-8]}
+			fmd := r.readStruct()
+			if len(r.buf) != 0 {
+				t.Fatalf("%d bytes after FileMetaData", len(r.buf))
+			}
+
+			if v := fmd.int(t, 1); v != 1 {
+				t.Errorf("version = %d", v)
+			}
+			elems := fmd.list(t, 2)
+			if len(elems) != numColumns+1 || elems[0].(thriftFields).int(t, 5) != numColumns {
+				t.Fatalf("schema = %v", elems)
+			}
+			for col, spec := range schema {
+				e := elems[col+1].(thriftFields)
+				if e.str(t, 4) != spec.name || e.int(t, 1) != int64(spec.typ) || e.int(t, 3) != repetitionRequired {
+					t.Errorf("schema element %d = %v", col, e)
+				}
+			}
+			if n := fmd.int(t, 3); n != int64(tt.rows) {
+				t.Errorf("num_rows = %d, want %d", n, tt.rows)
+			}
+
+			groups := fmd.list(t, 4)
+			if want := (tt.rows + tt.groupRows - 1) / tt.groupRows; len(groups) != want {
+				t.Fatalf("%d row groups, want %d", len(groups), want)
+			}
+			next := int64(len(magic))
+			row := 0
+			for g, v := range groups {
+				rg := v.(thriftFields)
+				rows := int(rg.int(t, 3))
+				if want := min(tt.groupRows, tt.rows-row); rows != want {
+					t.Errorf("row group %d: %d rows, want %d", g, rows, want)
+				}
+				groupRecs := recs[row : row+rows]
+				row += rows
+
+				for col, c := range rg.list(t, 1) {
+					chunk := c.(thriftFields)
+					meta := chunk.child(t, 3)
+					// Chunks are back to back, starting at their first page.
+					offset := chunk.int(t, 2)
+					first := meta.int(t, 9)
+					if dict, ok := meta[11]; ok {
+						first = dict.(int64)
+					}
+					if offset != next || first != offset {
+						t.Fatalf("row group %d column %d at %d, first page %d, want %d", g, col, offset, first, next)
+					}
+					next = offset + meta.int(t, 7)
+
+					if path := meta.list(t, 3); len(path) != 1 || string(path[0].([]byte)) != schema[col].name {
+						t.Errorf("column %d path = %v", col, path)
+					}
+					codec := Codec(meta.int(t, 4))
+					if codec != codecs[col] {
+						t.Errorf("column %d codec = %d, want %d", col, codec, codecs[col])
+					}
+					if n := meta.int(t, 5); n != int64(rows) {
+						t.Errorf("column %d num_values = %d, want %d", col, n, rows)
+					}
+
+					values := readColumnChunk(t, file, col, meta, codec)
+					if len(values) != rows {
+						t.Fatalf("row group %d column %d: %d values, want %d", g, col, len(values), rows)
+					}
+					for i := range groupRecs {
+						if want := recordValue(&groupRecs[i], col); values[i] != want {
+							t.Fatalf("row group %d column %d row %d = %q, want %q", g, col, i, values[i], want)
+						}
+					}
+
+					if schema[col].typ == typeByteArray {
+						continue
+					}
+					lo, hi := ^uint64(0), uint64(0)
+					for _, value := range values {
+						var v uint64
+						fmt.Sscan(value, &v)
+						lo, hi = min(lo, v), max(hi, v)
+					}
+					stats := meta.child(t, 12)
+					if got := stats.str(t, 6); got != string(plainValue(nil, schema[col].typ, lo)) {
+						t.Errorf("column %d min_value = %x, want %d", col, got, lo)
+					}
+					if got := stats.str(t, 5); got != string(plainValue(nil, schema[col].typ, hi)) {
+						t.Errorf("column %d max_value = %x, want %d", col, got, hi)
+					}
+				}
+			}
+			if next != int64(footerStart) {
+				t.Errorf("last column chunk ends at %d, footer starts at %d", next, footerStart)
+			}
+		})
+	}
+}
+
+func TestAppendIndices(t *testing.T) {
+	for _, dictLen := range []int{1, 2, 3, 255, 256, 1000} {
+		indices := make([]uint32, bitPackedRun*2+13)
+		for i := range indices {
+			indices[i] = uint32(i*7) % uint32(dictLen)
+		}
+		b := appendIndices(nil, indices, dictLen)
+		if width := int(b[0]); width != max(bits.Len32(uint32(dictLen-1)), 1) {
+			t.Errorf("dictionary of %d: bit width %d", dictLen, width)
+		}
+		got := decodeIndices(t, b, len(indices))
+		for i := range indices {
+			if got[i] != indices[i] {
+				t.Fatalf("dictionary of %d: index %d = %d, want %d", dictLen, i, got[i], indices[i])
+			}
+		}
+	}
+}
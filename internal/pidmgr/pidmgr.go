@@ -4,6 +4,7 @@
 package pidmgr
 
 import (
+	"bytes"
 	"context"
 	"fmt"
 	"log/slog"
@@ -20,6 +21,7 @@ type TrackedProcess struct {
 	ParentPID    uint32
 	ThreadIDs    []uint32
 	RegisteredAt time.Time
+	Labels       map[string]string // given at registration, such as a job id
 }
 
 // PIDRegistry manages the set of tracked parent PIDs and their threads.
@@ -28,8 +30,18 @@ type PIDRegistry struct {
 	trackedPids   map[uint32]*TrackedProcess // parent PID -> process info
 	ebpfMap       *ebpf.Map                  // tracked_pids eBPF map
 	checkInterval time.Duration
+	onUnregister  []func(pid uint32)
+
+	ownerMu sync.Mutex        // taken after mu when both are held
+	owners  map[uint32]uint32 // PID -> registered ancestor, 0 if none
 }
 
+// maxOwners bounds the owner cache; it is reset when full.
+const maxOwners = 65536
+
+// maxOwnerDepth bounds the /proc parent chain walked by Owner.
+const maxOwnerDepth = 64
+
 // New creates a new PIDRegistry with the given eBPF tracked_pids map.
 // checkInterval controls how often process liveness is checked (default 5s).
 func New(ebpfMap *ebpf.Map, checkInterval time.Duration) *PIDRegistry {
@@ -40,12 +52,110 @@ func New(ebpfMap *ebpf.Map, checkInterval time.Duration) *PIDRegistry {
 		trackedPids:   make(map[uint32]*TrackedProcess),
 		ebpfMap:       ebpfMap,
 		checkInterval: checkInterval,
+		owners:        make(map[uint32]uint32),
+	}
+}
+
+// OnUnregister adds a function called with the PID of every registration
+// that ends, whether through UnregisterPID or because the process exited.
+// It is called without the registry lock held.
+func (r *PIDRegistry) OnUnregister(fn func(pid uint32)) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.onUnregister = append(r.onUnregister, fn)
+}
+
+// notifyUnregistered runs the OnUnregister hooks for pids.
+func (r *PIDRegistry) notifyUnregistered(pids []uint32) {
+	r.mu.RLock()
+	hooks := r.onUnregister
+	r.mu.RUnlock()
+
+	for _, pid := range pids {
+		for _, fn := range hooks {
+			fn(pid)
+		}
+	}
+}
+
+// Owner returns the registration pid belongs to: pid itself when it is
+// registered, else its closest registered ancestor, found by walking the
+// parent chain in /proc. Children forked by a tracked process are tracked
+// too, so this groups a job's processes under the PID that was registered.
+// Results are cached until the owner is unregistered.
+func (r *PIDRegistry) Owner(pid uint32) (uint32, bool) {
+	r.ownerMu.Lock()
+	owner, cached := r.owners[pid]
+	r.ownerMu.Unlock()
+	if cached {
+		return owner, owner != 0
+	}
+
+	r.mu.RLock()
+	owner = 0
+	for p, depth := pid, 0; p > 1 && depth < maxOwnerDepth; depth++ {
+		if _, ok := r.trackedPids[p]; ok {
+			owner = p
+			break
+		}
+		ppid, err := r.readParent(p)
+		if err != nil {
+			break
+		}
+		p = ppid
+	}
+
+	// Cache under r.mu, so that a registration ending meanwhile, which
+	// drops the owners cached for it, cannot leave a stale one behind.
+	r.ownerMu.Lock()
+	if len(r.owners) >= maxOwners {
+		clear(r.owners)
+	}
+	r.owners[pid] = owner
+	r.ownerMu.Unlock()
+	r.mu.RUnlock()
+	return owner, owner != 0
+}
+
+// dropOwner forgets the cached owners resolved to pid.
+func (r *PIDRegistry) dropOwner(pid uint32) {
+	r.ownerMu.Lock()
+	defer r.ownerMu.Unlock()
+	for p, owner := range r.owners {
+		if owner == pid || p == pid {
+			delete(r.owners, p)
+		}
 	}
 }
 
-// RegisterPID adds a parent PID and all its threads to the tracking registry.
-// Returns the number of threads found, or an error if the process doesn't exist.
-func (r *PIDRegistry) RegisterPID(pid uint32) (int, error) {
+// readParent returns the parent PID of pid from /proc/<pid>/stat.
+func (r *PIDRegistry) readParent(pid uint32) (uint32, error) {
+	stat, err := os.ReadFile(fmt.Sprintf("/proc/%d/stat", pid))
+	if err != nil {
+		return 0, err
+	}
+	// The command name is in parentheses and may contain spaces, so
+	// fields are counted from the last closing one: "pid (comm) state ppid".
+	i := bytes.LastIndexByte(stat, ')')
+	if i < 0 {
+		return 0, fmt.Errorf("malformed stat for PID %d", pid)
+	}
+	fields := bytes.Fields(stat[i+1:])
+	if len(fields) < 2 {
+		return 0, fmt.Errorf("malformed stat for PID %d", pid)
+	}
+	ppid, err := strconv.ParseUint(string(fields[1]), 10, 32)
+	if err != nil {
+		return 0, fmt.Errorf("malformed stat for PID %d: %w", pid, err)
+	}
+	return uint32(ppid), nil
+}
+
+// RegisterPID adds a parent PID and all its threads to the tracking registry,
+// with optional labels describing it, such as a job id or rank. Labels must
+// not be modified afterwards. Returns the number of threads found, or an
+// error if the process doesn't exist.
+func (r *PIDRegistry) RegisterPID(pid uint32, labels map[string]string) (int, error) {
 	r.mu.Lock()
 	defer r.mu.Unlock()
 
@@ -76,8 +186,15 @@ func (r *PIDRegistry) RegisterPID(pid uint32) (int, error) {
 		ParentPID:    pid,
 		ThreadIDs:    tids,
 		RegisteredAt: time.Now(),
+		Labels:       labels,
 	}
 
+	// Cached lookups may have resolved to no owner, or to an ancestor of
+	// the new registration.
+	r.ownerMu.Lock()
+	clear(r.owners)
+	r.ownerMu.Unlock()
+
 	slog.Info("Registered PID for tracking", "pid", pid, "threads", len(tids))
 	return len(tids), nil
 }
@@ -85,10 +202,9 @@ func (r *PIDRegistry) RegisterPID(pid uint32) (int, error) {
 // UnregisterPID removes a parent PID and all its threads from tracking.
 func (r *PIDRegistry) UnregisterPID(pid uint32) error {
 	r.mu.Lock()
-	defer r.mu.Unlock()
-
 	proc, exists := r.trackedPids[pid]
 	if !exists {
+		r.mu.Unlock()
 		return fmt.Errorf("PID %d is not registered", pid)
 	}
 
@@ -100,7 +216,11 @@ func (r *PIDRegistry) UnregisterPID(pid uint32) error {
 	}
 
 	delete(r.trackedPids, pid)
+	r.dropOwner(pid)
+	r.mu.Unlock()
+
 	slog.Info("Unregistered PID from tracking", "pid", pid)
+	r.notifyUnregistered([]uint32{pid})
 	return nil
 }
 
@@ -116,6 +236,16 @@ func (r *PIDRegistry) List() []TrackedProcess {
 	return result
 }
 
+// Labels returns the labels given when pid was registered, or nil.
+func (r *PIDRegistry) Labels(pid uint32) map[string]string {
+	r.mu.RLock()
+	defer r.mu.RUnlock()
+	if proc, ok := r.trackedPids[pid]; ok {
+		return proc.Labels
+	}
+	return nil
+}
+
 // IsRegistered checks if a PID is currently registered.
 func (r *PIDRegistry) IsRegistered(pid uint32) bool {
 	r.mu.RLock()
@@ -146,8 +276,7 @@ func (r *PIDRegistry) StartLivenessMonitor(ctx context.Context) {
 // checkLiveness removes any tracked PIDs whose processes have terminated.
 func (r *PIDRegistry) checkLiveness() {
 	r.mu.Lock()
-	defer r.mu.Unlock()
-
+	var removed []uint32
 	for pid, proc := range r.trackedPids {
 		if !r.processExists(pid) {
 			// Remove threads from eBPF map
@@ -155,9 +284,14 @@ func (r *PIDRegistry) checkLiveness() {
 				_ = r.ebpfMap.Delete(tid)
 			}
 			delete(r.trackedPids, pid)
+			r.dropOwner(pid)
+			removed = append(removed, pid)
 			slog.Info("Auto-removed terminated process", "pid", pid)
 		}
 	}
+	r.mu.Unlock()
+
+	r.notifyUnregistered(removed)
 }
 
 // processExists checks if a process with the given PID exists.
@@ -0,0 +1,117 @@
+// Package queue defines the overflow policies shared by the bounded queues of
+// the event pipeline, together with helpers to apply them to channels and to
+// keep overflow logging cheap.
+package queue
+
+import (
+	"fmt"
+	"sync"
+	"time"
+)
+
+// Policy selects what happens when a bounded queue is full.
+type Policy int
+
+const (
+	// Block waits for room, pushing backpressure upstream. For the ring
+	// buffer reader this lets the kernel ring buffer absorb the burst.
+	Block Policy = iota
+	// DropNewest discards the value being offered.
+	DropNewest
+	// DropOldest evicts queued values until the new one fits.
+	DropOldest
+	// Spill moves overflow to disk. Callers that support it handle spilling
+	// themselves; Offer treats it like DropNewest.
+	Spill
+)
+
+var policyNames = map[Policy]string{
+	Block:      "block",
+	DropNewest: "drop-newest",
+	DropOldest: "drop-oldest",
+	Spill:      "spill",
+}
+
+func (p Policy) String() string {
+	if name, ok := policyNames[p]; ok {
+		return name
+	}
+	return fmt.Sprintf("Policy(%d)", int(p))
+}
+
+// ParsePolicy parses a policy name as accepted on the command line.
+func ParsePolicy(s string) (Policy, error) {
+	for p, name := range policyNames {
+		if name == s {
+			return p, nil
+		}
+	}
+	return 0, fmt.Errorf("unknown backpressure policy %q (want block, drop-newest, drop-oldest or spill)", s)
+}
+
+// Offer delivers v to ch according to p and reports whether v was queued.
+// Values that end up discarded, v itself under DropNewest and Spill or the
+// evicted queued values under DropOldest, are passed to drop. Offer only
+// blocks under Block.
+func Offer[T any](ch chan T, v T, p Policy, drop func(T)) bool {
+	select {
+	case ch <- v:
+		return true
+	default:
+	}
+
+	switch p {
+	case Block:
+		ch <- v
+		return true
+	case DropOldest:
+		for {
+			select {
+			case old := <-ch:
+				drop(old)
+			default:
+			}
+			select {
+			case ch <- v:
+				return true
+			default:
+			}
+		}
+	default:
+		drop(v)
+		return false
+	}
+}
+
+// LogLimiter rate-limits a log statement that may fire on every overflow.
+// Call sites check Allow before building the log record, so suppressed calls
+// cost a clock read and no allocation.
+type LogLimiter struct {
+	mu         sync.Mutex
+	interval   time.Duration
+	last       time.Time
+	suppressed int
+}
+
+// NewLogLimiter allows at most one log record per interval.
+func NewLogLimiter(interval time.Duration) *LogLimiter {
+	return &LogLimiter{interval: interval}
+}
+
+// Allow reports whether the caller may log now and, if so, how many calls
+// were suppressed since the previous record.
+func (l *LogLimiter) Allow() (suppressed int, ok bool) {
+	now := time.Now()
+
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	if !l.last.IsZero() && now.Sub(l.last) < l.interval {
+		l.suppressed++
+		return 0, false
+	}
+	suppressed = l.suppressed
+	l.last = now
+	l.suppressed = 0
+	return suppressed, true
+}
@@ -0,0 +1,198 @@
+package tracefile
+
+import (
+	"encoding/json"
+	"fmt"
+	"os"
+	"slices"
+)
+
+// IndexVersion is the version of the segment index format.
+const IndexVersion = 1
+
+// IndexExt is the suffix of the index sidecar of a segment, appended to the
+// segment name before any compression applied after rotation.
+const IndexExt = ".idx"
+
+// Index summarizes one closed output segment, so that queries can skip the
+// segments, and the parts of a segment, that cannot hold matching records.
+// Offsets count bytes of the uncompressed stream: for uncompressed segments
+// they are file offsets, for compressed ones readers decompress and discard
+// up to them. Every checkpoint starts at a record (or block) boundary.
+type Index struct {
+	Version      int          `json:"version"`
+	Format       string       `json:"format"` // config.FileFormat value
+	Records      int          `json:"records"`
+	Bytes        int64        `json:"bytes"` // uncompressed size
+	MinTimestamp uint64       `json:"min_timestamp"`
+	MaxTimestamp uint64       `json:"max_timestamp"`
+	PIDs         []uint32     `json:"pids"`
+	TIDs         []uint32     `json:"tids"`
+	FDs          []uint32     `json:"fds"`
+	Checkpoints  []Checkpoint `json:"checkpoints"`
+}
+
+// Checkpoint is a position in a segment and the timestamp range of the
+// records between it and the next checkpoint. Records are not required to
+// be in timestamp order, so ranges of successive checkpoints may overlap.
+type Checkpoint struct {
+	Offset       int64  `json:"offset"`
+	MinTimestamp uint64 `json:"min_timestamp"`
+	MaxTimestamp uint64 `json:"max_timestamp"`
+}
+
+// Range is a byte range [Start, End) of a segment; End is -1 for the end of
+// the segment.
+type Range struct {
+	Start, End int64
+}
+
+// Contains reports whether the segment may hold records in the timestamp
+// range [from, to] from the given pid, tid and fd. Negative ids match any.
+func (idx *Index) Contains(from, to uint64, pid, tid, fd int64) bool {
+	if idx.Records == 0 || idx.MaxTimestamp < from || idx.MinTimestamp > to {
+		return false
+	}
+	has := func(set []uint32, id int64) bool {
+		if id < 0 {
+			return true
+		}
+		_, ok := slices.BinarySearch(set, uint32(id))
+		return ok
+	}
+	return has(idx.PIDs, pid) && has(idx.TIDs, tid) && has(idx.FDs, fd)
+}
+
+// Ranges returns the byte ranges of the segment holding the records in the
+// timestamp range [from, to], merging adjacent checkpoints.
+func (idx *Index) Ranges(from, to uint64) []Range {
+	var ranges []Range
+	for i, cp := range idx.Checkpoints {
+		if cp.MaxTimestamp < from || cp.MinTimestamp > to {
+			continue
+		}
+		end := int64(-1)
+		if i+1 < len(idx.Checkpoints) {
+			end = idx.Checkpoints[i+1].Offset
+		}
+		if n := len(ranges); n > 0 && ranges[n-1].End == cp.Offset {
+			ranges[n-1].End = end
+		} else {
+			ranges = append(ranges, Range{Start: cp.Offset, End: end})
+		}
+	}
+	return ranges
+}
+
+// IndexBuilder accumulates the index of the segment being written.
+type IndexBuilder struct {
+	interval int64
+	idx      Index
+	last     int64 // offset of the last checkpoint
+	pids     map[uint32]struct{}
+	tids     map[uint32]struct{}
+	fds      map[uint32]struct{}
+}
+
+// NewIndexBuilder creates an IndexBuilder adding a checkpoint once at least
+// interval bytes were written since the previous one.
+func NewIndexBuilder(format string, interval int64) *IndexBuilder {
+	b := &IndexBuilder{
+		interval: max(interval, 1),
+		pids:     make(map[uint32]struct{}),
+		tids:     make(map[uint32]struct{}),
+		fds:      make(map[uint32]struct{}),
+	}
+	b.idx.Format = format
+	b.Reset()
+	return b
+}
+
+// Add records data written at offset: records records with timestamps in
+// [minTS, maxTS], and ids, a list of (pid, tid, fd) triplets.
+func (b *IndexBuilder) Add(offset int64, records int, minTS, maxTS uint64, ids []uint32) {
+	if records == 0 {
+		return
+	}
+	idx := &b.idx
+	n := len(idx.Checkpoints)
+	if n == 0 || offset-b.last >= b.interval {
+		idx.Checkpoints = append(idx.Checkpoints, Checkpoint{Offset: offset, MinTimestamp: minTS, MaxTimestamp: maxTS})
+		b.last = offset
+	} else {
+		cp := &idx.Checkpoints[n-1]
+		cp.MinTimestamp = min(cp.MinTimestamp, minTS)
+		cp.MaxTimestamp = max(cp.MaxTimestamp, maxTS)
+	}
+
+	if idx.Records == 0 {
+		idx.MinTimestamp, idx.MaxTimestamp = minTS, maxTS
+	}
+	idx.MinTimestamp = min(idx.MinTimestamp, minTS)
+	idx.MaxTimestamp = max(idx.MaxTimestamp, maxTS)
+	idx.Records += records
+
+	for i := 0; i+2 < len(ids); i += 3 {
+		b.pids[ids[i]] = struct{}{}
+		b.tids[ids[i+1]] = struct{}{}
+		b.fds[ids[i+2]] = struct{}{}
+	}
+}
+
+// Len returns the number of records added since the last Reset.
+func (b *IndexBuilder) Len() int {
+	return b.idx.Records
+}
+
+// Finish returns the index of a segment of size uncompressed bytes. The
+// index is valid until the next Reset.
+func (b *IndexBuilder) Finish(size int64) *Index {
+	idx := &b.idx
+	idx.Bytes = size
+	idx.PIDs = sortedSet(idx.PIDs[:0], b.pids)
+	idx.TIDs = sortedSet(idx.TIDs[:0], b.tids)
+	idx.FDs = sortedSet(idx.FDs[:0], b.fds)
+	return idx
+}
+
+// Reset starts the index of a new segment.
+func (b *IndexBuilder) Reset() {
+	b.idx = Index{Version: IndexVersion, Format: b.idx.Format, Checkpoints: b.idx.Checkpoints[:0]}
+	b.last = 0
+	clear(b.pids)
+	clear(b.tids)
+	clear(b.fds)
+}
+
+func sortedSet(dst []uint32, set map[uint32]struct{}) []uint32 {
+	for id := range set {
+		dst = append(dst, id)
+	}
+	slices.Sort(dst)
+	return dst
+}
+
+// WriteIndex writes idx to path.
+func WriteIndex(path string, idx *Index) error {
+	data, err := json.Marshal(idx)
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(path, data, 0644)
+}
+
+// ReadIndex reads the index at path.
+func ReadIndex(path string) (*Index, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	var idx Index
+	if err := json.Unmarshal(data, &idx); err != nil {
+		return nil, fmt.Errorf("invalid index %s: %w", path, err)
+	}
+	if idx.Version != IndexVersion {
+		return nil, fmt.Errorf("index %s: unsupported version %d", path, idx.Version)
+	}
+	return &idx, nil
+}
@@ -0,0 +1,80 @@
+package tracefile
+
+import (
+	"fmt"
+	"math"
+	"testing"
+)
+
+func testIndex() *Index {
+	return &Index{
+		Version:      IndexVersion,
+		Records:      40,
+		MinTimestamp: 100,
+		MaxTimestamp: 400,
+		PIDs:         []uint32{1, 3},
+		TIDs:         []uint32{1, 3, 4},
+		FDs:          []uint32{1},
+		Checkpoints: []Checkpoint{
+			{Offset: 0, MinTimestamp: 100, MaxTimestamp: 150},
+			{Offset: 1000, MinTimestamp: 160, MaxTimestamp: 200},
+			// Records out of timestamp order.
+			{Offset: 2000, MinTimestamp: 120, MaxTimestamp: 320},
+			{Offset: 3000, MinTimestamp: 310, MaxTimestamp: 400},
+		},
+	}
+}
+
+func TestIndexContains(t *testing.T) {
+	tests := []struct {
+		from, to     uint64
+		pid, tid, fd int64
+		want         bool
+	}{
+		{0, math.MaxUint64, -1, -1, -1, true},
+		{0, 99, -1, -1, -1, false},
+		{401, 500, -1, -1, -1, false},
+		{0, 100, -1, -1, -1, true},
+		{400, 500, -1, -1, -1, true},
+		{201, 299, -1, -1, -1, true}, // no checkpoint either, but within the segment
+		{0, math.MaxUint64, 3, -1, -1, true},
+		{0, math.MaxUint64, 2, -1, -1, false},
+		{0, math.MaxUint64, 1, 4, 1, true},
+		{0, math.MaxUint64, 1, 2, -1, false},
+		{0, math.MaxUint64, -1, -1, 2, false},
+		{0, 50, 1, 1, 1, false},
+	}
+	idx := testIndex()
+	for _, tt := range tests {
+		if got := idx.Contains(tt.from, tt.to, tt.pid, tt.tid, tt.fd); got != tt.want {
+			t.Errorf("Contains(%d, %d, %d, %d, %d) = %v, want %v", tt.from, tt.to, tt.pid, tt.tid, tt.fd, got, tt.want)
+		}
+	}
+
+	if (&Index{}).Contains(0, math.MaxUint64, -1, -1, -1) {
+		t.Error("an empty segment contains records")
+	}
+}
+
+func TestIndexRanges(t *testing.T) {
+	tests := []struct {
+		from, to uint64
+		want     []Range
+	}{
+		{0, math.MaxUint64, []Range{{0, -1}}},
+		{0, 99, nil},
+		{401, 500, nil},
+		{100, 100, []Range{{0, 1000}}},
+		{160, 190, []Range{{1000, 3000}}},
+		// Checkpoints 0 and 2, not 1 between them.
+		{130, 130, []Range{{0, 1000}, {2000, 3000}}},
+		{330, 400, []Range{{3000, -1}}},
+		{201, 309, []Range{{2000, 3000}}},
+	}
+	idx := testIndex()
+	for _, tt := range tests {
+		if got := idx.Ranges(tt.from, tt.to); fmt.Sprint(got) != fmt.Sprint(tt.want) {
+			t.Errorf("Ranges(%d, %d) = %v, want %v", tt.from, tt.to, got, tt.want)
+		}
+	}
+}
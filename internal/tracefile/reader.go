@@ -0,0 +1,161 @@
+package tracefile
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"hash/crc32"
+	"io"
+
+	"write-tracer/internal/event"
+)
+
+// Reader decodes blocks from a trace file.
+type Reader struct {
+	r     *bufio.Reader
+	buf   []byte
+	comms [][]byte
+	recs  []event.Record
+}
+
+// NewReader creates a reader for the blocks in r.
+func NewReader(r io.Reader) *Reader {
+	return &Reader{r: bufio.NewReaderSize(r, 256*1024)}
+}
+
+// Next decodes the next block. The records' Comm and Data point into the
+// reader's buffer and are only valid until the next call. Next returns io.EOF
+// once the input ends on a block boundary and io.ErrUnexpectedEOF if it ends
+// inside a block.
+func (r *Reader) Next() (BlockHeader, []event.Record, error) {
+	var hdr [headerSize]byte
+	if _, err := io.ReadFull(r.r, hdr[:]); err != nil {
+		return BlockHeader{}, nil, err
+	}
+	if string(hdr[:len(magic)]) != magic {
+		return BlockHeader{}, nil, fmt.Errorf("%w: bad magic %q", ErrCorrupt, hdr[:len(magic)])
+	}
+	n := binary.LittleEndian.Uint32(hdr[len(magic):])
+	if n < crcSize || n > maxBlockSize {
+		return BlockHeader{}, nil, fmt.Errorf("%w: block length %d", ErrCorrupt, n)
+	}
+
+	if cap(r.buf) < int(n) {
+		r.buf = make([]byte, n)
+	}
+	r.buf = r.buf[:n]
+	if _, err := io.ReadFull(r.r, r.buf); err != nil {
+		if errors.Is(err, io.EOF) {
+			err = io.ErrUnexpectedEOF
+		}
+		return BlockHeader{}, nil, err
+	}
+
+	body := r.buf[:n-crcSize]
+	if crc32.Checksum(body, castagnoli) != binary.LittleEndian.Uint32(r.buf[n-crcSize:]) {
+		return BlockHeader{}, nil, fmt.Errorf("%w: checksum mismatch", ErrCorrupt)
+	}
+	return r.decode(body)
+}
+
+func (r *Reader) decode(b []byte) (BlockHeader, []event.Record, error) {
+	d := decoder{b: b}
+
+	var h BlockHeader
+	h.Version = d.uvarint()
+	if d.err == nil && h.Version != Version {
+		return h, nil, fmt.Errorf("unsupported trace schema version %d", h.Version)
+	}
+	h.Host = string(d.bytes())
+	h.BaseTimestamp = d.uvarint()
+
+	r.comms = r.comms[:0]
+	for n := d.count(); n > 0 && d.err == nil; n-- {
+		r.comms = append(r.comms, d.bytes())
+	}
+
+	r.recs = r.recs[:0]
+	ts := h.BaseTimestamp
+	for n := d.count(); n > 0 && d.err == nil; n-- {
+		ts += uint64(d.varint())
+		rec := event.Record{
+			Timestamp: ts,
+			PID:       uint32(d.uvarint()),
+			TID:       uint32(d.uvarint()),
+			FD:        uint32(d.uvarint()),
+			Count:     d.uvarint(),
+		}
+		comm := d.uvarint()
+		if comm >= uint64(len(r.comms)) {
+			d.fail()
+			break
+		}
+		rec.Comm = r.comms[comm]
+		rec.Data = d.bytes()
+		r.recs = append(r.recs, rec)
+	}
+
+	if d.err == nil && len(d.b) != 0 {
+		d.fail()
+	}
+	if d.err != nil {
+		return h, nil, d.err
+	}
+	return h, r.recs, nil
+}
+
+// decoder reads varint fields from a block body, recording the first error.
+type decoder struct {
+	b   []byte
+	err error
+}
+
+func (d *decoder) fail() {
+	if d.err == nil {
+		d.err = fmt.Errorf("%w: truncated or malformed field", ErrCorrupt)
+	}
+	d.b = nil
+}
+
+func (d *decoder) uvarint() uint64 {
+	v, n := binary.Uvarint(d.b)
+	if n <= 0 {
+		d.fail()
+		return 0
+	}
+	d.b = d.b[n:]
+	return v
+}
+
+func (d *decoder) varint() int64 {
+	v, n := binary.Varint(d.b)
+	if n <= 0 {
+		d.fail()
+		return 0
+	}
+	d.b = d.b[n:]
+	return v
+}
+
+// count reads an element count, bounded by the remaining bytes so a corrupt
+// count cannot drive a huge loop.
+func (d *decoder) count() uint64 {
+	n := d.uvarint()
+	if n > uint64(len(d.b)) {
+		d.fail()
+		return 0
+	}
+	return n
+}
+
+func (d *decoder) bytes() []byte {
+	n := d.uvarint()
+	if n > uint64(len(d.b)) {
+		d.fail()
+		return nil
+	}
+	v := d.b[:n:n]
+	d.b = d.b[n:]
+	return v
+}
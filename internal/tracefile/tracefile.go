@@ -0,0 +1,143 @@
+// Package tracefile implements the compact binary trace format written by the
+// file sink with --file-format=binary, and the segment index sidecars written
+// with --file-index.
+//
+// A trace file is a sequence of self-contained blocks, so rotated, truncated
+// or concatenated files stay decodable block by block. Each block is:
+//
+//	magic      "WTRB"
+//	length     uint32 little endian, bytes that follow up to and including the CRC
+//	version    uvarint, schema version (currently 1)
+//	host       uvarint length + bytes
+//	base       uvarint, timestamp of the first record
+//	comms      uvarint count, then uvarint length + bytes per interned comm
+//	records    uvarint count, then per record:
+//	             timestamp  zigzag varint delta from the previous record
+//	             pid, tid, fd, count, comm index  uvarint each
+//	             data       uvarint length + bytes
+//	crc        uint32 little endian, CRC-32C of version through records
+//
+// Records keep the order in which they were written; timestamps are not
+// required to be monotonic, hence the signed deltas.
+package tracefile
+
+import (
+	"encoding/binary"
+	"errors"
+	"hash/crc32"
+
+	"write-tracer/internal/event"
+)
+
+// Version is the schema version written in every block header.
+const Version = 1
+
+const (
+	magic      = "WTRB"
+	headerSize = len(magic) + 4
+	crcSize    = 4
+	// maxBlockSize bounds the block length accepted by the reader.
+	maxBlockSize = 64 << 20
+)
+
+var (
+	// ErrCorrupt is returned for blocks that fail validation.
+	ErrCorrupt = errors.New("corrupt trace block")
+
+	castagnoli = crc32.MakeTable(crc32.Castagnoli)
+)
+
+// BlockHeader describes one block.
+type BlockHeader struct {
+	Version       uint64
+	Host          string
+	BaseTimestamp uint64
+}
+
+// Encoder appends blocks. Its scratch state is reused between blocks, so an
+// Encoder must not be used concurrently.
+type Encoder struct {
+	host  []byte
+	block uint64
+	comms map[string]*commSlot
+	table [][]byte
+}
+
+// commSlot is the index of a comm in the table of the current block. Slots
+// outlive blocks so that comms seen before are interned without allocating.
+type commSlot struct {
+	block uint64
+	index uint64
+}
+
+// maxInterned bounds the comms remembered across blocks; the map is reset
+// between blocks once it reaches this size.
+const maxInterned = 4096
+
+// NewEncoder creates an encoder that stamps every block with host.
+func NewEncoder(host string) *Encoder {
+	return &Encoder{host: []byte(host), comms: make(map[string]*commSlot)}
+}
+
+// AppendBlock appends one block holding recs to dst and returns the extended
+// buffer. An empty recs appends nothing.
+func (e *Encoder) AppendBlock(dst []byte, recs []event.Record) []byte {
+	if len(recs) == 0 {
+		return dst
+	}
+
+	if len(e.comms) >= maxInterned {
+		clear(e.comms)
+	}
+	e.block++
+	e.table = e.table[:0]
+	for i := range recs {
+		// The string conversion in a map index does not allocate.
+		slot := e.comms[string(recs[i].Comm)]
+		if slot == nil {
+			slot = &commSlot{}
+			e.comms[string(recs[i].Comm)] = slot
+		}
+		if slot.block != e.block {
+			slot.block = e.block
+			slot.index = uint64(len(e.table))
+			e.table = append(e.table, recs[i].Comm)
+		}
+	}
+
+	start := len(dst)
+	dst = append(dst, magic...)
+	dst = binary.LittleEndian.AppendUint32(dst, 0)
+	body := len(dst)
+
+	dst = binary.AppendUvarint(dst, Version)
+	dst = appendBytes(dst, e.host)
+	dst = binary.AppendUvarint(dst, recs[0].Timestamp)
+	dst = binary.AppendUvarint(dst, uint64(len(e.table)))
+	for _, comm := range e.table {
+		dst = appendBytes(dst, comm)
+	}
+
+	dst = binary.AppendUvarint(dst, uint64(len(recs)))
+	prev := recs[0].Timestamp
+	for i := range recs {
+		r := &recs[i]
+		dst = binary.AppendVarint(dst, int64(r.Timestamp-prev))
+		prev = r.Timestamp
+		dst = binary.AppendUvarint(dst, uint64(r.PID))
+		dst = binary.AppendUvarint(dst, uint64(r.TID))
+		dst = binary.AppendUvarint(dst, uint64(r.FD))
+		dst = binary.AppendUvarint(dst, r.Count)
+		dst = binary.AppendUvarint(dst, e.comms[string(r.Comm)].index)
+		dst = appendBytes(dst, r.Data)
+	}
+
+	dst = binary.LittleEndian.AppendUint32(dst, crc32.Checksum(dst[body:], castagnoli))
+	binary.LittleEndian.PutUint32(dst[start+len(magic):], uint32(len(dst)-body))
+	return dst
+}
+
+func appendBytes(dst, b []byte) []byte {
+	dst = binary.AppendUvarint(dst, uint64(len(b)))
+	return append(dst, b...)
+}
@@ -0,0 +1,213 @@
+package tracefile
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"hash/crc32"
+	"io"
+	"math"
+	"testing"
+
+	"write-tracer/internal/event"
+)
+
+func testRecord(ts uint64, comm, data string) event.Record {
+	return event.Record{
+		Timestamp: ts,
+		Count:     uint64(len(data)),
+		PID:       1234,
+		TID:       1235,
+		FD:        1,
+		Comm:      []byte(comm),
+		Data:      []byte(data),
+	}
+}
+
+// sameRecords compares records by value, empty and nil slices alike.
+func sameRecords(a, b []event.Record) bool {
+	if len(a) != len(b) {
+		return false
+	}
+	for i := range a {
+		x, y := a[i], b[i]
+		if x.Timestamp != y.Timestamp || x.Count != y.Count || x.PID != y.PID || x.TID != y.TID || x.FD != y.FD ||
+			!bytes.Equal(x.Comm, y.Comm) || !bytes.Equal(x.Data, y.Data) {
+			return false
+		}
+	}
+	return true
+}
+
+// readAll decodes every block of b, copying the records out of the reader.
+func readAll(t *testing.T, b []byte) ([]BlockHeader, [][]event.Record, error) {
+	t.Helper()
+	r := NewReader(bytes.NewReader(b))
+	var headers []BlockHeader
+	var blocks [][]event.Record
+	for {
+		h, recs, err := r.Next()
+		if err != nil {
+			if errors.Is(err, io.EOF) {
+				err = nil
+			}
+			return headers, blocks, err
+		}
+		copied := make([]event.Record, len(recs))
+		for i := range recs {
+			copied[i] = recs[i].Clone()
+		}
+		headers = append(headers, h)
+		blocks = append(blocks, copied)
+	}
+}
+
+func TestRoundTrip(t *testing.T) {
+	tests := []struct {
+		name   string
+		blocks [][]event.Record
+	}{
+		{"no blocks", nil},
+		{"one record", [][]event.Record{{testRecord(100, "bash", "hello\n")}}},
+		{"empty comm and data", [][]event.Record{{testRecord(100, "", ""), testRecord(101, "", "")}}},
+		{"non-monotonic timestamps", [][]event.Record{{
+			testRecord(1_000_000, "a", "x"),
+			testRecord(999_000, "a", "y"),
+			testRecord(math.MaxUint64, "a", "z"),
+			testRecord(0, "a", "w"),
+			testRecord(1_000_000, "a", "v"),
+		}}},
+		{"comms reused across blocks", [][]event.Record{
+			{testRecord(1, "python", "a"), testRecord(2, "mpi_rank", "b"), testRecord(3, "python", "c")},
+			// Known comms in another order, and a new one.
+			{testRecord(4, "mpi_rank", "d"), testRecord(5, "nccl", "e"), testRecord(6, "python", "f")},
+			// A subset of the known comms only.
+			{testRecord(7, "nccl", "g")},
+		}},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			enc := NewEncoder("node1")
+			var b []byte
+			for _, recs := range tt.blocks {
+				b = enc.AppendBlock(b, recs)
+			}
+			headers, blocks, err := readAll(t, b)
+			if err != nil {
+				t.Fatal(err)
+			}
+			if len(blocks) != len(tt.blocks) {
+				t.Fatalf("decoded %d blocks, want %d", len(blocks), len(tt.blocks))
+			}
+			for i, recs := range tt.blocks {
+				want := BlockHeader{Version: Version, Host: "node1", BaseTimestamp: recs[0].Timestamp}
+				if headers[i] != want {
+					t.Errorf("block %d header = %+v, want %+v", i, headers[i], want)
+				}
+				if !sameRecords(blocks[i], recs) {
+					t.Errorf("block %d = %v, want %v", i, blocks[i], recs)
+				}
+			}
+		})
+	}
+}
+
+func TestAppendEmptyBlock(t *testing.T) {
+	enc := NewEncoder("node1")
+	if b := enc.AppendBlock([]byte("x"), nil); string(b) != "x" {
+		t.Errorf("AppendBlock(nil) = %q, want the input unchanged", b)
+	}
+}
+
+func TestCommTableReset(t *testing.T) {
+	// More comms than are interned across blocks: the table is reset
+	// between blocks and every block stays self-contained.
+	enc := NewEncoder("")
+	var b []byte
+	var want [][]event.Record
+	for i := 0; i < 3; i++ {
+		recs := make([]event.Record, maxInterned)
+		for j := range recs {
+			recs[j] = testRecord(uint64(j), fmt.Sprintf("c%d", (i*maxInterned/2+j)%(2*maxInterned)), "")
+		}
+		b = enc.AppendBlock(b, recs)
+		want = append(want, recs)
+	}
+	_, blocks, err := readAll(t, b)
+	if err != nil || len(blocks) != len(want) {
+		t.Fatalf("decoded %d blocks, error %v", len(blocks), err)
+	}
+	for i := range want {
+		if !sameRecords(blocks[i], want[i]) {
+			t.Errorf("block %d differs after the comm table reset", i)
+		}
+	}
+}
+
+func TestCorruptBlocks(t *testing.T) {
+	enc := NewEncoder("node1")
+	first := enc.AppendBlock(nil, []event.Record{testRecord(100, "bash", "hello")})
+	two := enc.AppendBlock(append([]byte(nil), first...), []event.Record{testRecord(200, "bash", "world")})
+	body := len(magic) + 4
+
+	// withCRC recomputes the checksum of a modified block.
+	withCRC := func(b []byte) []byte {
+		crc := len(b) - crcSize
+		binary.LittleEndian.PutUint32(b[crc:], crc32.Checksum(b[body:crc], castagnoli))
+		return b
+	}
+	modified := func(f func(b []byte) []byte) []byte {
+		return f(append([]byte(nil), first...))
+	}
+
+	tests := []struct {
+		name  string
+		input []byte
+		want  error
+		// blocks decoded before the error
+		good int
+	}{
+		{"flipped data byte", modified(func(b []byte) []byte {
+			b[len(b)-crcSize-1] ^= 1
+			return b
+		}), ErrCorrupt, 0},
+		{"flipped crc", modified(func(b []byte) []byte {
+			b[len(b)-1] ^= 1
+			return b
+		}), ErrCorrupt, 0},
+		{"bad magic", modified(func(b []byte) []byte {
+			b[0] = 'X'
+			return b
+		}), ErrCorrupt, 0},
+		{"bad length", modified(func(b []byte) []byte {
+			binary.LittleEndian.PutUint32(b[len(magic):], maxBlockSize+1)
+			return b
+		}), ErrCorrupt, 0},
+		{"malformed field with valid crc", modified(func(b []byte) []byte {
+			// A comm index past the comm table: it precedes the data
+			// length and the data.
+			b[len(b)-crcSize-len("hello")-2] = 5
+			return withCRC(b)
+		}), ErrCorrupt, 0},
+		{"truncated header", first[:5], io.ErrUnexpectedEOF, 0},
+		{"truncated body", first[:len(first)-1], io.ErrUnexpectedEOF, 0},
+		{"truncated second block", two[:len(two)-3], io.ErrUnexpectedEOF, 1},
+		{"corrupt second block", func() []byte {
+			b := append([]byte(nil), two...)
+			b[len(b)-crcSize-1] ^= 1
+			return b
+		}(), ErrCorrupt, 1},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			_, blocks, err := readAll(t, tt.input)
+			if !errors.Is(err, tt.want) {
+				t.Errorf("error = %v, want %v", err, tt.want)
+			}
+			if len(blocks) != tt.good {
+				t.Errorf("decoded %d blocks before the error, want %d", len(blocks), tt.good)
+			}
+		})
+	}
+}
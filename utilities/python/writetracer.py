@@ -19,12 +19,14 @@ class WriteTracer:
         self.pid = None
         self.logger = logging.getLogger(__name__)
 
-    def register(self, pid=None):
+    def register(self, pid=None, labels=None):
         """
         Register a PID for tracking.
         
         Args:
             pid (int, optional): The PID to register. Defaults to the current process ID.
+            labels (dict, optional): Labels describing the registration, such as
+                {"job": "1234", "rank": "0"}, usable in --loki-labels templates.
             
         Returns:
             bool: True if registration was successful, False otherwise.
@@ -36,7 +38,7 @@ class WriteTracer:
         try:
             response = requests.post(
                 f"{self.base_url}/pids",
-                json={"pid": pid},
+                json={"pid": pid, "labels": labels} if labels else {"pid": pid},
                 headers={"Content-Type": "application/json"},
                 timeout=2
             )
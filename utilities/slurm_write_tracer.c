@@ -8,6 +8,7 @@
  * Configuration is read from /etc/write-tracer/plugin.conf (default).
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -142,9 +143,19 @@ int slurm_spank_init(spank_t sp, int ac, char **av) {
 // Called for each task initialization
 int slurm_spank_task_init(spank_t sp, int ac, char **av) {
     pid_t pid = getpid();
-    char json_payload[64];
-    
-    snprintf(json_payload, sizeof(json_payload), "{\"pid\": %d}", pid);
+    uint32_t job_id = 0, rank = 0;
+    char json_payload[128];
+
+    // Job id and rank are sent as registration labels, so the tracer can
+    // label its output per job rather than per process.
+    if (spank_get_item(sp, S_JOB_ID, &job_id) == ESPANK_SUCCESS &&
+        spank_get_item(sp, S_TASK_GLOBAL_ID, &rank) == ESPANK_SUCCESS) {
+        snprintf(json_payload, sizeof(json_payload),
+                 "{\"pid\": %d, \"labels\": {\"job\": \"%u\", \"rank\": \"%u\"}}",
+                 pid, job_id, rank);
+    } else {
+        snprintf(json_payload, sizeof(json_payload), "{\"pid\": %d}", pid);
+    }
     
     if (send_request("/pids", json_payload, "POST") == 0) {
         // slurm_info("write-tracer: Registered PID %d", pid);